@@ -0,0 +1,67 @@
+// Copyright (c) 2011 Prime Focus Film.
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions
+// are met:
+//
+// Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+// Redistributions in binary form must reproduce the above copyright
+// notice, this list of conditions and the following disclaimer in the
+// documentation and/or other materials provided with the
+// distribution. Neither the name of Prime Focus Film nor the
+// names of its contributors may be used to endorse or promote
+// products derived from this software without specific prior written
+// permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+// FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+// COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+// INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+// HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+// OF THE POSSIBILITY OF SUCH DAMAGE.
+
+
+#include "field3D_Dispatch.h"
+
+using namespace std;
+
+namespace Field3DTools {
+
+ChannelLayout fieldLayout( SupportedFieldTypeEnum type ) {
+	if( type >= MACField_Half          ) return MAC_CHANNEL;
+	if( type >= DenseVectorField_Half  ) return VECTOR_CHANNEL;
+	return SCALAR_CHANNEL;
+}
+
+const char *fieldTypeName( SupportedFieldTypeEnum type ) {
+	static const char *NAMES[] = {
+			"dense-scalar-half" , "dense-scalar-float" , "dense-scalar-double" ,
+			"sparse-scalar-half", "sparse-scalar-float", "sparse-scalar-double",
+			"dense-vector-half" , "dense-vector-float" , "dense-vector-double" ,
+			"sparse-vector-half", "sparse-vector-float", "sparse-vector-double",
+			"mac-half"          , "mac-float"          , "mac-double"          };
+	return ( type >= 0 && type < TypeUnsupported ) ? NAMES[type] : "unsupported";
+}
+
+
+// only records the type of the layer
+struct ProbeVisitor {
+	template<class FieldType>
+	bool operator()( FieldType &, SupportedFieldTypeEnum ) { return true; }
+};
+
+bool getFieldValueType( Field3D::Field3DInputFile *inFile , const string &name , SupportedFieldTypeEnum &type , const string &partition ) {
+	ProbeVisitor probe;
+	return dispatchLayer(inFile, partition, name, probe, type);
+}
+
+}
@@ -0,0 +1,466 @@
+// Copyright (c) 2011 Prime Focus Film.
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions
+// are met:
+//
+// Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+// Redistributions in binary form must reproduce the above copyright
+// notice, this list of conditions and the following disclaimer in the
+// documentation and/or other materials provided with the
+// distribution. Neither the name of Prime Focus Film nor the
+// names of its contributors may be used to endorse or promote
+// products derived from this software without specific prior written
+// permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+// FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+// COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+// INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+// HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+// OF THE POSSIBILITY OF SUCH DAMAGE.
+
+
+#ifndef FIELD3D_DISPATCH_H
+#define FIELD3D_DISPATCH_H
+
+#include <string>
+
+#include "field3D_Tools.h"
+#include "field3D_Resample.h"
+#include "field3D_Stream.h"
+
+// Field3D layers are typed by their value type and their class. Instead of
+// hand written chains trying every combination in turn ( each one reading the
+// layer again ), the combinations are listed once as type lists :
+//  - a layer is read once per candidate value type, Field3D only reads the
+//    data of the one matching the file,
+//  - its class is then found from className(), and the concrete field is
+//    handed to a visitor whose operator() is instantiated for each of them.
+// Adding a value type or a field class is done in the lists below.
+
+namespace Field3DTools {
+
+// ---------------------  Type lists
+
+struct NullType {};
+
+template<class Head, class Tail>
+struct TypeList {
+	typedef Head head;
+	typedef Tail tail;
+};
+
+// value types of the layers which can be read
+typedef TypeList< Field3D::half, TypeList< float, TypeList< double, NullType > > > ValueTypes;
+
+// value types the cache formats write ( see FieldDataTypeEnum ). Maya hands
+// floats, so double would only double the size of the caches.
+typedef TypeList< Field3D::half, TypeList< float, NullType > > ExportTypes;
+
+template<typename T> struct ValueIndex;
+template<> struct ValueIndex<Field3D::half>  { enum { value = 0 }; };
+template<> struct ValueIndex<float>          { enum { value = 1 }; };
+template<> struct ValueIndex<double>         { enum { value = 2 }; };
+
+template<typename T> struct ExportDataType;
+template<> struct ExportDataType<Field3D::half> { enum { value = HALF  }; };
+template<> struct ExportDataType<float>         { enum { value = FLOAT }; };
+
+template<typename Data_T>
+struct BaseType                            { typedef Data_T type; };
+template<typename Base_T>
+struct BaseType< FIELD3D_VEC3_T<Base_T> >  { typedef Base_T type; };
+
+
+// ---------------------  Field classes
+
+// className() of the field, the SupportedFieldTypeEnum of its half scalar
+// and half vector layers ( float and double follow ), and the field itself
+struct DenseClass {
+	static const char *name() { return "DenseField"; }
+	enum { scalarId = DenseScalarField_Half , vectorId = DenseVectorField_Half };
+	template<typename Data_T> struct apply { typedef Field3D::DenseField<Data_T> type; };
+};
+
+struct SparseClass {
+	static const char *name() { return "SparseField"; }
+	enum { scalarId = SparseScalarField_Half , vectorId = SparseVectorField_Half };
+	template<typename Data_T> struct apply { typedef Field3D::SparseField<Data_T> type; };
+};
+
+// vector layers only
+struct MACClass {
+	static const char *name() { return "MACField"; }
+	enum { scalarId = TypeUnsupported , vectorId = MACField_Half };
+	template<typename Data_T> struct apply { typedef Field3D::MACField<Data_T> type; };
+};
+
+typedef TypeList< DenseClass, TypeList< SparseClass, TypeList< MACClass, NullType > > > FieldClasses;
+
+template<class Class, typename Data_T>
+struct FieldTypeId {
+	enum {
+		vector    = VoxelComponents<Data_T>::value == 3 ,
+		base      = vector ? (int) Class::vectorId : (int) Class::scalarId ,
+		supported = base != TypeUnsupported ,
+		value     = supported ? base + ValueIndex< typename BaseType<Data_T>::type >::value : (int) TypeUnsupported
+	};
+};
+
+// SCALAR_CHANNEL, VECTOR_CHANNEL or MAC_CHANNEL
+ChannelLayout fieldLayout( SupportedFieldTypeEnum type );
+
+// "dense-scalar-half", ... "mac-double"
+const char *fieldTypeName( SupportedFieldTypeEnum type );
+
+
+// ---------------------  Dispatch
+
+// the concrete field handed to the visitor, unless the class
+// doesn't hold this value type ( scalar MAC fields )
+template<class Class, typename Data_T, bool supported = FieldTypeId<Class,Data_T>::supported>
+struct VisitField {
+	template<class Visitor>
+	static bool run( Field3D::Field<Data_T> &, Visitor &, SupportedFieldTypeEnum &type ) {
+		type = TypeUnsupported;
+		return false;
+	}
+};
+
+template<class Class, typename Data_T>
+struct VisitField<Class, Data_T, true> {
+	template<class Visitor>
+	static bool run( Field3D::Field<Data_T> &field, Visitor &visitor, SupportedFieldTypeEnum &type ) {
+		typedef typename Class::template apply<Data_T>::type FieldType;
+		type = (SupportedFieldTypeEnum) FieldTypeId<Class,Data_T>::value;
+		return visitor( static_cast<FieldType &>(field), type );
+	}
+};
+
+template<class ClassList>
+struct ClassDispatch;
+
+template<>
+struct ClassDispatch<NullType> {
+	template<typename Data_T, class Visitor>
+	static bool run( const std::string &, Field3D::Field<Data_T> &, Visitor &, SupportedFieldTypeEnum &type ) {
+		type = TypeUnsupported;
+		return false;
+	}
+};
+
+template<class Class, class Tail>
+struct ClassDispatch< TypeList<Class,Tail> > {
+	template<typename Data_T, class Visitor>
+	static bool run( const std::string &className, Field3D::Field<Data_T> &field, Visitor &visitor, SupportedFieldTypeEnum &type ) {
+		if( className != Class::name() ) return ClassDispatch<Tail>::run(className, field, visitor, type);
+		return VisitField<Class, Data_T>::run(field, visitor, type);
+	}
+};
+
+// scalar and vector layers are read through different calls
+template<typename T, bool vector>
+struct LayerReader {
+	typedef T Data_T;
+	static typename Field3D::Field<Data_T>::Vec read( Field3D::Field3DInputFile *in, const std::string &partition, const std::string &name ) {
+		return readScalarLayers<T>(in, partition, name);
+	}
+};
+
+template<typename T>
+struct LayerReader<T, true> {
+	typedef FIELD3D_VEC3_T<T> Data_T;
+	static typename Field3D::Field<Data_T>::Vec read( Field3D::Field3DInputFile *in, const std::string &partition, const std::string &name ) {
+		return readVectorLayers<T>(in, partition, name);
+	}
+};
+
+// false when none of the value types matches the layer,
+// result is the one of the visitor otherwise
+template<class ValueList, bool vector>
+struct LayerDispatch;
+
+template<bool vector>
+struct LayerDispatch<NullType, vector> {
+	template<class Visitor>
+	static bool run( Field3D::Field3DInputFile *, const std::string &, const std::string &, Visitor &, SupportedFieldTypeEnum &, bool & ) {
+		return false;
+	}
+};
+
+template<typename T, class Tail, bool vector>
+struct LayerDispatch< TypeList<T,Tail>, vector > {
+	template<class Visitor>
+	static bool run( Field3D::Field3DInputFile *in, const std::string &partition, const std::string &name, Visitor &visitor, SupportedFieldTypeEnum &type, bool &result ) {
+		typedef typename LayerReader<T, vector>::Data_T Data_T;
+
+		typename Field3D::Field<Data_T>::Vec layers;
+		{
+			PROFILE_SCOPE("hdf5_read", name);
+			layers = LayerReader<T, vector>::read(in, partition, name);
+		}
+		if( layers.empty() ) return LayerDispatch<Tail, vector>::run(in, partition, name, visitor, type, result);
+
+		result = ClassDispatch<FieldClasses>::run(layers[0]->className(), *layers[0], visitor, type);
+		return true;
+	}
+};
+
+// layers a dispatch looks for, the layout of a channel tells which one it is
+enum LayerKinds { SCALAR_LAYERS = 1 , VECTOR_LAYERS = 2 , ANY_LAYERS = 3 };
+
+// Reads the layer once and calls visitor( field, type ) with its concrete
+// class, a template operator() being instantiated for every combination :
+//   template<class FieldType> bool operator()( FieldType &field, SupportedFieldTypeEnum type );
+// Returns what the visitor returned, false when the layer wasn't found or
+// its class isn't supported ( type is then TypeUnsupported ).
+template<class Visitor>
+bool dispatchLayer(
+		Field3D::Field3DInputFile *in        ,
+		const std::string         &partition ,
+		const std::string         &name      ,
+		Visitor                   &visitor   ,
+		SupportedFieldTypeEnum    &type      ,
+		int                        kinds     = ANY_LAYERS )
+{
+	type = TypeUnsupported;
+
+	bool result = false;
+	bool found  = false;
+	if( kinds & SCALAR_LAYERS ) found = LayerDispatch<ValueTypes, false>::run(in, partition, name, visitor, type, result);
+	if( ( kinds & VECTOR_LAYERS ) && !found ) found = LayerDispatch<ValueTypes, true >::run(in, partition, name, visitor, type, result);
+
+	if( !found ) {
+		ERROR( "Failed to read " + name + " : Layer not found in " + ( partition.empty() ? std::string("the file") : partition ) );
+		return false;
+	}
+	if( type == TypeUnsupported ) {
+		ERROR( "Failed to read " + name + " : not a dense field, a sparse field nor a MAC field of half, float or double" );
+		return false;
+	}
+	return result;
+}
+
+// calls visitor.apply<T>() with the value type of dataType, the writers
+// being instantiated for each of the export types
+template<class ExportList>
+struct ExportDispatch;
+
+template<>
+struct ExportDispatch<NullType> {
+	template<class Visitor>
+	static bool run( FieldDataTypeEnum, Visitor & ) { return false; }
+};
+
+template<typename T, class Tail>
+struct ExportDispatch< TypeList<T,Tail> > {
+	template<class Visitor>
+	static bool run( FieldDataTypeEnum dataType, Visitor &visitor ) {
+		if( dataType != (int) ExportDataType<T>::value ) return ExportDispatch<Tail>::run(dataType, visitor);
+		return visitor.template apply<T>();
+	}
+};
+
+template<class Visitor>
+bool dispatchDataType( FieldDataTypeEnum dataType, Visitor &visitor ) {
+	return ExportDispatch<ExportTypes>::run(dataType, visitor);
+}
+
+
+// ---------------------  Read Field3d field into raw arrays
+
+// type of the layer ( read once )
+bool getFieldValueType( Field3D::Field3DInputFile *inFile , const std::string &name, SupportedFieldTypeEnum &type, const std::string &partition = std::string() ) ;
+
+// decodes any supported field into Maya's layout ( see copyVoxels )
+template<typename Dest_T>
+class DecodeVisitor {
+public:
+	DecodeVisitor( const std::string &name, ChannelLayout layout, Dest_T *data, size_t values ) :
+		m_name(name), m_layout(layout), m_data(data), m_values(values), m_staggeredRes(0) {}
+
+	template<class FieldType>
+	bool operator()( FieldType &field, SupportedFieldTypeEnum type ) {
+		// staggered sparse layers hold a face component of MAC channels ( see writeSparseMACField )
+		const bool staggered = isStaggered(field);
+		if( ( staggered ? MAC_CHANNEL : fieldLayout(type) ) != m_layout ) {
+			ERROR( "Failed to read " + m_name + " : stored as " + fieldTypeName(type) + ", which doesn't match the channel" );
+			return false;
+		}
+
+		const Field3D::V3i r      = channelResolution(field);
+		const unsigned int res[3] = { (unsigned int) r.x, (unsigned int) r.y, (unsigned int) r.z };
+		if( staggered && m_staggeredRes != Field3D::V3i(0) && m_staggeredRes != r ) {
+			ERROR( "Failed to read " + m_name + " : its face components don't have the same resolution" );
+			return false;
+		}
+		if( staggered ) m_staggeredRes = r;
+		const size_t       values = channelValues(m_layout, res);
+		// a smaller layer would leave the end of the ( pooled ) buffer
+		// to the previous frame, and doesn't share its strides anyway
+		if( values != m_values ) {
+			ERROR( "Failed to read " + m_name + " : the layer doesn't have the resolution of the channel" );
+			return false;
+		}
+
+		DEBUG( "Start copy " );
+		PROFILE_SCOPE("convert", m_name);
+#if defined(FIELD3D_PROFILING)
+		const Field3D::V3i copied = field.dataResolution();
+		PROFILE_COUNT("bytes_out", (long long) ( staggered ? (size_t) copied.x * copied.y * copied.z : values ) * sizeof(Dest_T));
+#endif
+		if( !staggered ) {
+			copyVoxels(field, m_data);
+		}
+		else if( !copyStaggeredVoxels(field, m_data) ) {
+			ERROR( "Failed to read " + m_name + " : stored as " + fieldTypeName(type) + ", which can't hold staggered faces" );
+			return false;
+		}
+		DEBUG( "End copy " );
+		return true;
+	}
+
+private:
+	const std::string &m_name   ;
+	ChannelLayout      m_layout ;
+	Dest_T            *m_data   ;
+	size_t             m_values ;
+	Field3D::V3i       m_staggeredRes ;   // of the face components read so far
+};
+
+// Dest_T is float or double : the buffer is handed to Maya in one go and
+// holds values of the channel's layout. Only the layers of this layout are
+// looked for, type is set to the stored one.
+template<typename Dest_T>
+bool readField(
+		Field3D::Field3DInputFile *in        ,
+		const std::string         &partition ,
+		const std::string         &fieldName ,
+		ChannelLayout              layout    ,
+		Dest_T                    *data      ,
+		size_t                     values    ,
+		SupportedFieldTypeEnum    &type      )
+{
+	DecodeVisitor<Dest_T> decode(fieldName, layout, data, values);
+
+	// a MAC channel of the sparse formats : one layer per face component
+	if( layout == MAC_CHANNEL && hasStaggeredLayers(in, partition, fieldName) ) {
+		for(int axis=0; axis<3; axis++) {
+			if( !dispatchLayer(in, partition, staggeredLayerName(fieldName, axis), decode, type, SCALAR_LAYERS) ) return false;
+		}
+		return true;
+	}
+	return dispatchLayer(in, partition, fieldName, decode, type, layout == SCALAR_CHANNEL ? SCALAR_LAYERS : VECTOR_LAYERS);
+}
+
+
+// ---------------------  Write raw arrays into Field3D files
+
+// a scalar channel in the export type handed to apply() : sparse fields with
+// their block order, big dense fields streamed, dense float ones always written
+// from Maya's buffer ( see field3D_Stream.h )
+class ScalarChannelWriter {
+public:
+	ScalarChannelWriter(
+			Field3D::Field3DOutputFile *out        ,
+			const std::string          &fileName   ,
+			const char *                fluidName  ,
+			const char *                fieldName  ,
+			unsigned int                res[3]     ,
+			double                      transform[4][4] ,
+			float *                     data       ,
+			FieldTypeEnum               type       ,
+			int                         blockOrder = SPARSE_BLOCK_ORDER ) :
+		m_out(out), m_fileName(fileName), m_fluidName(fluidName), m_fieldName(fieldName), m_res(res),
+		m_transform(transform), m_data(data), m_type(type), m_blockOrder(blockOrder) {}
+
+	template<typename ExportType>
+	bool apply() {
+		if( m_type == SPARSE )
+			return writeSparseScalarField<ExportType>(m_out, m_fluidName, m_fieldName, m_res, m_transform, m_data, m_blockOrder);
+
+		// float channels go straight from Maya's buffer whatever their size
+		const size_t bytes = (size_t) m_res[0] * m_res[1] * m_res[2] * sizeof(ExportType);
+		if( IsFloat<ExportType>::value ? useZeroCopyWrite() : useStreamedWrite(bytes) )
+			return writeDenseFieldStreamed<ExportType>(m_out, m_fileName, m_fluidName, m_fieldName, m_res, m_transform, m_data, NULL, NULL);
+
+		return writeDenseScalarField<ExportType>(m_out, m_fluidName, m_fieldName, m_res, m_transform, m_data);
+	}
+
+private:
+	Field3D::Field3DOutputFile *m_out        ;
+	const std::string          &m_fileName   ;
+	const char *                m_fluidName  ;
+	const char *                m_fieldName  ;
+	unsigned int               *m_res        ;
+	double                    (*m_transform)[4] ;
+	float *                     m_data       ;
+	FieldTypeEnum               m_type       ;
+	int                         m_blockOrder ;
+};
+
+// a vector channel from its three components : a MAC field ( three staggered
+// sparse layers in the sparse formats, see STAGGERED_METADATA ), or a dense field
+// streamed when it's big ( see field3D_Stream.h )
+class VectorChannelWriter {
+public:
+	VectorChannelWriter(
+			Field3D::Field3DOutputFile *out        ,
+			const std::string          &fileName   ,
+			const char *                fluidName  ,
+			const char *                fieldName  ,
+			unsigned int                res[3]     ,
+			double                      transform[4][4] ,
+			const float *               a          ,
+			const float *               b          ,
+			const float *               c          ,
+			bool                        mac        ,
+			FieldTypeEnum               type       = DENSE ,
+			int                         blockOrder = SPARSE_BLOCK_ORDER ,
+			const float *               mask       = NULL ) :
+		m_out(out), m_fileName(fileName), m_fluidName(fluidName), m_fieldName(fieldName), m_res(res),
+		m_transform(transform), m_a(a), m_b(b), m_c(c), m_mac(mac), m_type(type), m_blockOrder(blockOrder), m_mask(mask) {}
+
+	template<typename ExportType>
+	bool apply() {
+		// only MAC channels are sparse, unless FIELD3D_SPARSE_VELOCITY is 0
+		if( m_mac && m_type == SPARSE && sparseVelocity() != VELOCITY_DENSE )
+			return writeSparseMACField<ExportType>(m_out, m_fluidName, m_fieldName, m_res, m_transform, m_a, m_b, m_c, m_blockOrder, m_mask);
+
+		if( m_mac )
+			return writeMACVectorField<ExportType>(m_out, m_fluidName, m_fieldName, m_res, m_transform, m_a, m_b, m_c);
+
+		const size_t bytes = (size_t) m_res[0] * m_res[1] * m_res[2] * 3 * sizeof(ExportType);
+		if( useStreamedWrite(bytes) )
+			return writeDenseFieldStreamed<ExportType>(m_out, m_fileName, m_fluidName, m_fieldName, m_res, m_transform, m_a, m_b, m_c);
+
+		return writeDenseVectorField<ExportType>(m_out, m_fluidName, m_fieldName, m_res, m_transform, m_a, m_b, m_c);
+	}
+
+private:
+	Field3D::Field3DOutputFile *m_out        ;
+	const std::string          &m_fileName   ;
+	const char *                m_fluidName  ;
+	const char *                m_fieldName  ;
+	unsigned int               *m_res        ;
+	double                    (*m_transform)[4] ;
+	const float *               m_a, *m_b, *m_c ;
+	bool                        m_mac        ;
+	FieldTypeEnum               m_type       ;
+	int                         m_blockOrder ;
+	const float *               m_mask       ;   // density, NULL to cull by magnitude
+};
+
+}
+
+#endif
@@ -0,0 +1,92 @@
+// Copyright (c) 2011 Prime Focus Film.
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions
+// are met:
+//
+// Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+// Redistributions in binary form must reproduce the above copyright
+// notice, this list of conditions and the following disclaimer in the
+// documentation and/or other materials provided with the
+// distribution. Neither the name of Prime Focus Film nor the
+// names of its contributors may be used to endorse or promote
+// products derived from this software without specific prior written
+// permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+// FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+// COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+// INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+// HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+// OF THE POSSIBILITY OF SUCH DAMAGE.
+
+
+#include "field3D_FieldPool.h"
+
+#include <cstdlib>
+
+using namespace std;
+
+namespace Field3DTools {
+
+// one current pool per thread, like the profiler's sessions
+static __thread FieldPool *currentPool = NULL;
+
+FieldPool *currentFieldPool() {
+	return currentPool;
+}
+
+ScopedFieldPool::ScopedFieldPool( FieldPool &pool ) : m_previous(currentPool) {
+	currentPool = &pool;
+}
+
+ScopedFieldPool::~ScopedFieldPool() {
+	currentPool = m_previous;
+}
+
+
+// ------------------------------------------- POOL
+
+FieldPool::FieldPool() {
+}
+
+FieldPool::~FieldPool() {
+	clear();
+}
+
+void *FieldPool::rawBuffer( const string &key, size_t bytes ) {
+	Buffer &buffer = m_buffers.insert( make_pair(key, Buffer()) ).first->second;
+	if( bytes == 0 ) bytes = 1;
+
+	// only grows : frames of an auto-resized fluid go back and forth
+	if( buffer.data == NULL || buffer.bytes < bytes ) {
+		free(buffer.data);
+		buffer.data  = NULL;
+		buffer.bytes = 0;
+		if( posix_memalign(&buffer.data, 64, bytes) != 0 ) {
+			buffer.data = NULL;
+			return NULL;
+		}
+		buffer.bytes = bytes;
+	}
+	return buffer.data;
+}
+
+void FieldPool::clear() {
+	m_fields.clear();
+	for(map<string, Buffer>::iterator it=m_buffers.begin(); it!=m_buffers.end(); ++it) {
+		free(it->second.data);
+	}
+	m_buffers.clear();
+}
+
+}
@@ -0,0 +1,140 @@
+// Copyright (c) 2011 Prime Focus Film.
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions
+// are met:
+//
+// Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+// Redistributions in binary form must reproduce the above copyright
+// notice, this list of conditions and the following disclaimer in the
+// documentation and/or other materials provided with the
+// distribution. Neither the name of Prime Focus Film nor the
+// names of its contributors may be used to endorse or promote
+// products derived from this software without specific prior written
+// permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+// FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+// COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+// INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+// HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+// OF THE POSSIBILITY OF SUCH DAMAGE.
+
+
+#ifndef FIELD3D_FIELDPOOL_H
+#define FIELD3D_FIELDPOOL_H
+
+#include <map>
+#include <string>
+#include <vector>
+#include <typeinfo>
+
+#include <Field3D/Field.h>
+
+// Fields and staging buffers reused from a frame to the next.
+//
+// Writing a channel used to allocate a whole field and free it right after
+// writeScalarLayer(), for every channel of every frame. A FieldPool keeps
+// one field per field type and one buffer per value type : as long as the
+// resolution doesn't change ( auto-resize ), a frame reuses the storage of
+// the previous one.
+//
+// Like the profiler's sessions, a pool is made current for the calling
+// thread ( see ScopedFieldPool ), so the Field3DTools templates use it
+// without knowing about it. Without any current pool they allocate as before.
+
+namespace Field3DTools {
+
+class FieldPool {
+public:
+	FieldPool();
+	~FieldPool();
+
+	// a field of the given type, to be resized by the caller, the slot keeps
+	// apart the fields of a type written with different metadata
+	template< class FieldType >
+	typename FieldType::Ptr field( const char *slot = "" );
+
+	// buffer of at least count values, aligned on a cache line, valid until
+	// the next call for the same value type and slot ( several buffers of
+	// the same type are needed at once when resampling )
+	template< typename T >
+	T *buffer( size_t count, const char *slot = "" ) { return static_cast<T*>( rawBuffer(std::string(typeid(T).name()) + slot, count * sizeof(T)) ); }
+
+	// release everything
+	void clear();
+
+private:
+	FieldPool            ( const FieldPool & );
+	FieldPool &operator= ( const FieldPool & );
+
+	void *rawBuffer( const std::string &key, size_t bytes );
+
+	struct Buffer {
+		Buffer() : data(NULL), bytes(0) {}
+		void    *data  ;
+		size_t   bytes ;
+	};
+
+	std::map< std::string, Field3D::FieldBase::Ptr >  m_fields  ;
+	std::map< std::string, Buffer >                   m_buffers ;
+};
+
+
+template< class FieldType >
+typename FieldType::Ptr FieldPool::field( const char *slot )
+{
+	Field3D::FieldBase::Ptr &pooled = m_fields[ std::string(typeid(FieldType).name()) + slot ];
+	typename FieldType::Ptr  result = Field3D::field_dynamic_cast<FieldType>(pooled);
+	if( !result ) {
+		result = typename FieldType::Ptr( new FieldType );
+		pooled = result;
+	}
+	return result;
+}
+
+
+// current pool of the calling thread, NULL if none
+FieldPool *currentFieldPool();
+
+// makes a pool current for the lifetime of this object
+class ScopedFieldPool {
+public:
+	ScopedFieldPool( FieldPool &pool );
+	~ScopedFieldPool();
+private:
+	FieldPool *m_previous;
+};
+
+
+// field from the current pool, or a new one
+template< class FieldType >
+typename FieldType::Ptr newField( const char *slot = "" )
+{
+	FieldPool *pool = currentFieldPool();
+	if( pool ) return pool->field<FieldType>(slot);
+	return typename FieldType::Ptr( new FieldType );
+}
+
+// buffer from the current pool, or from the fallback vector
+template< typename T >
+T *stagingBuffer( std::vector<T> &fallback, size_t count )
+{
+	FieldPool *pool = currentFieldPool();
+	if( pool ) return pool->buffer<T>(count);
+	fallback.resize(count);
+	return count ? &fallback[0] : NULL;
+}
+
+}
+
+#endif
@@ -0,0 +1,245 @@
+// Copyright (c) 2011 Prime Focus Film.
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions
+// are met:
+//
+// Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+// Redistributions in binary form must reproduce the above copyright
+// notice, this list of conditions and the following disclaimer in the
+// documentation and/or other materials provided with the
+// distribution. Neither the name of Prime Focus Film nor the
+// names of its contributors may be used to endorse or promote
+// products derived from this software without specific prior written
+// permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+// FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+// COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+// INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+// HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+// OF THE POSSIBILITY OF SUCH DAMAGE.
+
+
+#include "field3D_FilePool.h"
+#include "field3D_Tools.h"
+#include "field3D_Staging.h"
+#include "tinyLogger.h"
+
+#include <Field3D/InitIO.h>
+
+#include <sys/stat.h>
+#include <pthread.h>
+#include <cstdio>
+#include <cstdlib>
+
+using namespace std;
+
+namespace Field3DTools {
+
+static pthread_once_t initIOOnce = PTHREAD_ONCE_INIT;
+
+static void initIOImpl() {
+	Field3D::initIO();
+}
+
+void initIO() {
+	pthread_once(&initIOOnce, initIOImpl);
+}
+
+
+// ------------------------------------------- INPUT FILE
+
+InputFile::InputFile() : m_hasPartitions(false) {
+}
+
+const vector<string> &InputFile::partitionNames() {
+	IlmThread::Lock lock(m_mutex);
+	if( !m_hasPartitions ) {
+		getPartitionNames(&file, m_partitions);
+		m_hasPartitions = true;
+	}
+	return m_partitions;
+}
+
+string InputFile::partition( const string &fluidName ) {
+	return findPartition(partitionNames(), fluidName);
+}
+
+const vector<string> &InputFile::fieldNames( const string &partition ) {
+	IlmThread::Lock lock(m_mutex);
+	map<string, vector<string> >::iterator it = m_names.find(partition);
+	if( it == m_names.end() ) {
+		it = m_names.insert( make_pair(partition, vector<string>()) ).first;
+		getFieldNames(&file, it->second, partition);
+	}
+	return it->second;
+}
+
+bool InputFile::fieldsResolution( unsigned int (&res)[3] , const string &partition ) {
+	IlmThread::Lock lock(m_mutex);
+	map<string, Resolution>::iterator it = m_resolutions.find(partition);
+	if( it == m_resolutions.end() ) {
+		Resolution resolution;
+		resolution.found = getFieldsResolution(&file, resolution.res, partition);
+		it = m_resolutions.insert( make_pair(partition, resolution) ).first;
+	}
+	res[0] = it->second.res[0];
+	res[1] = it->second.res[1];
+	res[2] = it->second.res[2];
+	return it->second.found;
+}
+
+
+// ------------------------------------------- POOL
+
+// the last user of a file closes it, whatever the thread
+static void deleteInputFile( InputFile *file ) {
+	HDF5Lock lock;
+	delete file;
+}
+
+static bool fileStamp( const string &path, long long &size, long long &mtime ) {
+	struct stat st;
+	if( stat(path.c_str(), &st) != 0 ) return false;
+	size  = (long long) st.st_size;
+	mtime = (long long) st.st_mtim.tv_sec * 1000000000LL + st.st_mtim.tv_nsec;
+	return true;
+}
+
+
+InputFilePool &InputFilePool::instance() {
+	static InputFilePool pool;
+	return pool;
+}
+
+InputFilePool::InputFilePool() : m_capacity(16), m_clock(0) {
+	const char *capacity = getenv("FIELD3D_FILE_POOL_SIZE");
+	if( capacity ) m_capacity = (size_t) atoi(capacity);
+}
+
+
+InputFileHandle InputFilePool::open( const string &path ) {
+
+	long long size = 0, mtime = 0;
+	if( !fileStamp(path, size, mtime) ) {
+		ERROR( "Opening of " + path + " failed : File not found" );
+		return InputFileHandle();
+	}
+
+	// handles dropped by the pool are closed once the lock is released
+	vector<InputFileHandle> released;
+	{
+		IlmThread::Lock lock(m_mutex);
+		InputFileHandle pooled = find(path, size, mtime, released);
+		if( pooled ) return pooled;
+	}
+
+	// small files on network storage are read in one go ( see field3D_Staging.h )
+	string openPath = path;
+	const bool staged = useStagedRead(path, size) && stageFile(path, openPath);
+
+	initIO();
+	InputFileHandle handle( new InputFile, deleteInputFile );
+	bool opened;
+	{
+		HDF5Lock lock;
+		opened = handle->file.open(openPath);
+	}
+
+	// HDF5 keeps the copy opened, tmpfs frees it once the file is closed
+	if( staged ) remove(openPath.c_str());
+	if( !opened ) {
+		ERROR( "Opening of " + path + " failed : Unknown reason" );
+		return InputFileHandle();
+	}
+
+	IlmThread::Lock lock(m_mutex);
+
+	// another reader opened it meanwhile : its handle is shared, this one
+	// is closed once the lock is released
+	InputFileHandle pooled = find(path, size, mtime, released);
+	if( pooled ) return pooled;
+
+	if( m_capacity == 0 ) return handle;
+
+	// evict the least recently used file
+	if( m_entries.size() >= m_capacity ) {
+		vector<Entry>::iterator oldest = m_entries.begin();
+		for(vector<Entry>::iterator it=m_entries.begin(); it!=m_entries.end(); ++it) {
+			if( it->lastUse < oldest->lastUse ) oldest = it;
+		}
+		release(oldest, released);
+	}
+
+	Entry entry;
+	entry.path    = path;
+	entry.size    = size;
+	entry.mtime   = mtime;
+	entry.lastUse = m_clock;
+	entry.handle  = handle;
+	m_entries.push_back(entry);
+
+	return handle;
+}
+
+
+void InputFilePool::release( vector<Entry>::iterator entry, vector<InputFileHandle> &released ) {
+	released.push_back(entry->handle);
+	m_entries.erase(entry);
+}
+
+
+InputFileHandle InputFilePool::find( const string &path, long long size, long long mtime, vector<InputFileHandle> &released ) {
+	m_clock++;
+
+	// already opened : only reuse it if the file didn't change
+	for(vector<Entry>::iterator it=m_entries.begin(); it!=m_entries.end(); ++it) {
+		if( it->path != path ) continue;
+		if( it->size == size && it->mtime == mtime ) {
+			it->lastUse = m_clock;
+			return it->handle;
+		}
+		release(it, released);
+		break;
+	}
+	return InputFileHandle();
+}
+
+
+void InputFilePool::invalidate( const string &path ) {
+	vector<InputFileHandle> released;
+	IlmThread::Lock lock(m_mutex);
+	for(vector<Entry>::iterator it=m_entries.begin(); it!=m_entries.end(); ++it) {
+		if( it->path == path ) {
+			release(it, released);
+			return;
+		}
+	}
+}
+
+
+void InputFilePool::clear() {
+	vector<InputFileHandle> released;
+	IlmThread::Lock lock(m_mutex);
+	while( !m_entries.empty() ) release(m_entries.begin(), released);
+}
+
+
+void InputFilePool::setCapacity( size_t capacity ) {
+	vector<InputFileHandle> released;
+	IlmThread::Lock lock(m_mutex);
+	m_capacity = capacity;
+	while( m_entries.size() > m_capacity ) release(m_entries.begin(), released);
+}
+
+}
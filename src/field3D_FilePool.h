@@ -0,0 +1,136 @@
+// Copyright (c) 2011 Prime Focus Film.
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions
+// are met:
+//
+// Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+// Redistributions in binary form must reproduce the above copyright
+// notice, this list of conditions and the following disclaimer in the
+// documentation and/or other materials provided with the
+// distribution. Neither the name of Prime Focus Film nor the
+// names of its contributors may be used to endorse or promote
+// products derived from this software without specific prior written
+// permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+// FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+// COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+// INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+// HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+// OF THE POSSIBILITY OF SUCH DAMAGE.
+
+
+#ifndef FIELD3D_FILEPOOL_H
+#define FIELD3D_FILEPOOL_H
+
+#include <string>
+#include <vector>
+#include <map>
+
+#include <boost/shared_ptr.hpp>
+
+#include <OpenEXR/IlmThreadMutex.h>
+
+#include <Field3D/Field3DFile.h>
+
+
+namespace Field3DTools {
+
+// Field3D::initIO() only needs to be called once per process
+void initIO();
+
+
+// An opened Field3D file along with the informations the plugin queries
+// again and again ( layer names, resolution ). They are computed lazily
+// and kept as long as the handle lives, since a pooled file never changes.
+// A handle may be shared by several readers running in parallel.
+class InputFile {
+public:
+	InputFile();
+
+	Field3D::Field3DInputFile       file;
+
+	// one partition per fluid ( see Field3DTools::findPartition )
+	const std::vector<std::string> &partitionNames   ();
+	std::string                     partition        ( const std::string &fluidName );
+
+	// an empty partition stands for the whole file
+	const std::vector<std::string> &fieldNames       ( const std::string &partition = std::string() );
+	bool                            fieldsResolution ( unsigned int (&res)[3] , const std::string &partition = std::string() );
+
+private:
+	struct Resolution {
+		bool          found  ;
+		unsigned int  res[3] ;
+	};
+
+	IlmThread::Mutex                                    m_mutex          ;
+	bool                                                m_hasPartitions  ;
+	std::vector<std::string>                            m_partitions     ;
+	std::map<std::string, std::vector<std::string> >    m_names          ;
+	std::map<std::string, Resolution>                   m_resolutions    ;
+};
+
+typedef boost::shared_ptr<InputFile> InputFileHandle;
+
+
+// Pool of opened input files keyed by path, size and modification time.
+//
+// Maya opens, rewinds and re-opens the same files over and over during
+// playback. The pool keeps the last used files opened ( LRU ) so that
+// opening an already opened frame costs a stat() call. Handles are shared :
+// a file evicted from the pool stays opened until its last user drops it.
+// Files are staged and opened outside of the pool's lock, readers of other
+// files don't wait for them.
+class InputFilePool {
+public:
+	static InputFilePool &instance();
+
+	// returns an opened file, or an empty handle on failure
+	InputFileHandle open       ( const std::string &path );
+
+	// forget a file, e.g. before it gets overwritten
+	void            invalidate ( const std::string &path );
+
+	// close every pooled file ( plugin unload )
+	void            clear      ();
+
+	void            setCapacity( size_t capacity );
+
+private:
+	InputFilePool();
+
+	struct Entry {
+		std::string      path    ;
+		long long        size    ;
+		long long        mtime   ;   // in ns
+		unsigned long    lastUse ;
+		InputFileHandle  handle  ;
+	};
+
+	// m_mutex being held : the pooled handle of this version of the file, and
+	// the removal of an entry. The handles the pool drops are moved to released,
+	// declared before the lock : the last user closes the file under the HDF5
+	// lock, which must not be waited for with the pool locked.
+	InputFileHandle      find       ( const std::string &path, long long size, long long mtime, std::vector<InputFileHandle> &released );
+	void                 release    ( std::vector<Entry>::iterator entry, std::vector<InputFileHandle> &released );
+
+	std::vector<Entry>   m_entries  ;
+	size_t               m_capacity ;
+	unsigned long        m_clock    ;
+	IlmThread::Mutex     m_mutex    ;
+};
+
+}
+
+#endif
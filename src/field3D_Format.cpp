@@ -33,6 +33,11 @@
 #include "field3D_Format.h"
 #include "maya_Tools.h"
 #include "tinyLogger.h"
+#include "field3D_Stream.h"
+#include "field3D_Resample.h"
+#include "field3D_Staging.h"
+#include "field3D_Dispatch.h"
+#include "field3D_Subframe.h"
 
 #include <maya/MArgList.h>
 #include <maya/MStatus.h>
@@ -45,6 +50,9 @@
 #include <maya/MMatrix.h>
 
 
+#include <algorithm>
+#include <cstring>
+#include <list>
 #include <stack>
 #include <iostream>
 using namespace std;
@@ -63,6 +71,27 @@ string extractChannelName(const MString &name) {
 }
 
 
+// element type of the Maya arrays
+template<class T> struct MayaArrayTraits;
+template<> struct MayaArrayTraits<MFloatArray>  { typedef float  value_type; };
+template<> struct MayaArrayTraits<MDoubleArray> { typedef double value_type; };
+
+
+// referenced files are stored by name, next to the file referencing them
+string fileBaseName(const string &path) {
+	size_t pos=path.rfind('/');
+	return pos==string::npos ? path : path.substr(pos+1);
+}
+
+string fileDirectory(const string &path) {
+	size_t pos=path.rfind('/');
+	return pos==string::npos ? string() : path.substr(0,pos+1);
+}
+
+// referenced channels kept decoded by a reader
+const size_t DECODED_CHANNELS = 4;
+
+
 template<typename T>
 string display3(T tab[3]){
 	stringstream sres;
@@ -79,63 +108,112 @@ Field3dCacheFormat::Field3dCacheFormat(
 		Field3DTools::FieldDataTypeEnum data_type
 ) {
 
-	Field3D::initIO();
-	m_inFile         = new Field3DInputFile()  ;
-	m_outFile        = new Field3DOutputFile() ;
+	Field3DTools::initIO();
+	m_inFile         = NULL  ;
+	m_outFile        = NULL  ;
+	m_mode           = kRead ;
 	m_isFileOpened   = false ;
 	m_ReadNameStack  = true  ;
 	m_offset[0]      = 0.0   ;
 	m_offset[1]      = 0.0   ;
 	m_offset[2]      = 0.0   ;
+	m_nextWeight     = 0.0f  ;
+	m_pairFrames     = 1     ;
 
 	FIELD_TYPE       = type      ;
 	FIELD_DATA_TYPE  = data_type ;
+
+	setCurrentName("");
 }
 
 
 Field3dCacheFormat::~Field3dCacheFormat() {
+	if( m_isFileOpened ) close();
+	Field3DTools::HDF5Lock lock;
+	delete m_outFile;
 }
 
 
 MStatus Field3dCacheFormat::open(const MString& fileName, FileAccessMode mode) {
 
-	// delete previous Field3dFile :
-	// Field3DInput/Output/File ::clear() and close()
-	// doesn't seem to work properly
-	delete m_inFile;
-	delete m_outFile;
+	// the session is named after the first file of the cache
+	if( m_profile.name.empty() ) m_profile.name = fileName.asChar();
+	PROFILE_SESSION(m_profile);
+	PROFILE_SCOPE("open", "");
+	PROFILE_COUNT("file_opens", 1);
 
-	m_inFile  = new Field3DInputFile();
-	m_outFile = new Field3DOutputFile();
+	// drop the previous input files, they stay opened in the pool
+	m_inHandle.reset();
+	m_nextHandle.reset();
+	m_inFile = NULL;
+
+	// delete previous output file :
+	// Field3DOutputFile::clear() and close()
+	// doesn't seem to work properly
+	{
+		Field3DTools::HDF5Lock lock;
+		delete m_outFile;
+		m_outFile = NULL;
+	}
 
 	m_ReadNameStack = true;
 
 	if( mode == kReadWrite || mode == kRead ) {
 
-		// open the file
-		if(!m_inFile->open(fileName.asChar())) {
-			ERROR( string("Opening of") +  fileName.asChar() + "failed : Unknown reason" );
+		// open the file, or reuse it if it's already opened. A missing
+		// frame is synthesized from the cached frames around it.
+		const bool subframe = mode == kRead && Field3DTools::subframeMode() != Field3DTools::SUBFRAME_OFF && !Field3DTools::fileExists(fileName.asChar());
+		if( subframe ) {
+			openSubframe(fileName.asChar());
+		}
+		else {
+			// the channels decoded for the last frame pair are of no use
+			// anymore, the pooled files keep the pair alive otherwise
+			m_frameChannels.clear();
+			m_inHandle = Field3DTools::InputFilePool::instance().open(fileName.asChar());
+		}
+		if(!m_inHandle) {
 			m_isFileOpened = false;
 			return MS::kFailure;
 		}
+		m_inFile = &m_inHandle->file;
 
 		// retreive the offset from the global meta-data
 		const Field3D::V3f er(-999.999,-999.999,-999.999);
 		Field3D::V3f off = m_inFile->metadata().vecFloatMetadata("Offset", er);
-		if(off==er) return MS::kFailure ;
+		if(off==er) {
+			// not one of our files : nothing may be read from it, rewind() included
+			ERROR( string("Opening of ") + fileName.asChar() + " failed : no offset metadata" );
+			m_inHandle.reset();
+			m_nextHandle.reset();
+			m_inFile       = NULL;
+			m_isFileOpened = false;
+			return MS::kFailure ;
+		}
 
 		m_offset[0] = off[0];
 		m_offset[1] = off[1];
 		m_offset[2] = off[2];
 
+		PROFILE_COUNT("file_bytes_read", Field3DProfiler::fileSize(fileName.asChar()));
 		DEBUG(string("Opening ") + fileName.asChar() + " in read mode");
 
 	}
 
 	if( mode == kReadWrite || mode == kWrite ) {
 
-		// create the file
-		if(!m_outFile->create(fileName.asChar(),Field3DOutputFile::OverwriteMode)) {
+		// a pooled reader of this file would be outdated
+		Field3DTools::InputFilePool::instance().invalidate(fileName.asChar());
+
+		// create the file, or its staged copy published on close()
+		m_writePath = Field3DTools::useStagedWrite() ? Field3DTools::stagedPath(fileName.asChar()) : string(fileName.asChar());
+		m_outFile = new Field3DOutputFile();
+		bool created;
+		{
+			Field3DTools::HDF5Lock lock;
+			created = m_outFile->create(m_writePath,Field3DOutputFile::OverwriteMode);
+		}
+		if(!created) {
 			ERROR( string("Creation of ") + fileName.asChar() + "failed : Unknown reason" );
 			m_isFileOpened = false;
 			return MS::kFailure;
@@ -153,6 +231,7 @@ MStatus Field3dCacheFormat::open(const MString& fileName, FileAccessMode mode) {
 
 	// everything is ok from there
 	m_filename     = fileName.asChar();
+	m_mode         = mode;
 	m_isFileOpened = true;
 
 	return MS::kSuccess ;
@@ -164,13 +243,44 @@ MStatus Field3dCacheFormat::isValid() {
 }
 
 MStatus Field3dCacheFormat::rewind() {
+	// the file is already opened : only restart the name stack
+	if( m_isFileOpened && m_inFile && m_mode == kRead ) {
+		m_ReadNameStack = true;
+		return MS::kSuccess;
+	}
 	return open(MString(m_filename.c_str()), kRead);
 }
 
 void Field3dCacheFormat::close() {
-	m_inFile->close();
-	m_outFile->close();
+	PROFILE_SESSION(m_profile);
+	{
+		// hdf5 flushes most of the data when the file is closed
+		PROFILE_SCOPE("close", "");
+		Field3DTools::HDF5Lock lock;
+		if(m_outFile) {
+			if(m_isFileOpened) m_outFile->writeGlobalMetadata();
+			m_outFile->close();
+		}
+	}
+	m_inHandle.reset();
+	m_nextHandle.reset();
+	m_inFile = NULL;
+
+	// one sequential write to the destination
+	if( m_isFileOpened && m_mode != kRead && m_writePath != m_filename ) {
+		PROFILE_SCOPE("publish", "");
+		Field3DTools::publishStagedFile(m_writePath, m_filename);
+		Field3DTools::InputFilePool::instance().invalidate(m_filename);
+	}
+
+	if( m_isFileOpened && m_mode != kRead ) {
+		PROFILE_COUNT("file_bytes_written", Field3DProfiler::fileSize(m_filename));
+	}
 	m_isFileOpened=false;
+
+#if defined(FIELD3D_PROFILING)
+	Field3DProfiler::dumpIfRequested(m_profile);
+#endif
 }
 
 
@@ -181,13 +291,16 @@ MStatus Field3dCacheFormat::writeHeader(const MString& /*version*/, MTime& /*sta
 	// Offset only needs to be kept separately for Maya.
 	// We can't write it as a HDF5 partition's attribute nor
 	// metadata since Field3D doesn't provide access to the
-	// low-level HDF5 file. So we have 2 options : write it per
-	// field, but it's a bit redundant. Instead we choose to
-	// write it as a global metadata since this plugin
-	// is supposed to export individual fluid from Maya
-	// sharing the same mapping
-	string fluidName = extractFluidName (m_currentName);  // "fluidName_channelName" => fluidName
+	// low-level HDF5 file. Several fluids can share the file,
+	// each one in its own partition, so the offset is stored
+	// as a global metadata per fluid by writeArray().
+	// The global "Offset" of the header's fluid is kept for
+	// the files read by older versions of the plugin.
+	// Global metadata are written once, when the file is closed.
+	if(!m_outFile) return MS::kFailure;
+	m_outFile->metadata().setStrMetadata("Info","File generated by Maya");
 
+	const string fluidName = m_fluidName;
 	if(fluidName.empty()) {
 		// TODO : find out why this fluidName can be empty
 		return MS::kSuccess;
@@ -202,11 +315,8 @@ MStatus Field3dCacheFormat::writeHeader(const MString& /*version*/, MTime& /*sta
 	MayaTools::getNodeValue( fluid, "dynamicOffsetY" , m_offset[1]);
 	MayaTools::getNodeValue( fluid, "dynamicOffsetZ" , m_offset[2]);
 
-	// write global metadata attached to the file
 	const Field3D::V3f off(m_offset[0], m_offset[1], m_offset[2]);
-	m_outFile->metadata().setStrMetadata("Info","File generated by Maya");
 	m_outFile->metadata().setVecFloatMetadata("Offset",off);
-	m_outFile->writeGlobalMetadata();
 
 	//	hid_t m_file;
 	//	File::Partition::Ptr newPart(new File::Partition);
@@ -218,20 +328,31 @@ MStatus Field3dCacheFormat::writeHeader(const MString& /*version*/, MTime& /*sta
 }
 
 
+void Field3dCacheFormat::setCurrentName(const MString &name) {
+	m_currentName = name;
+	m_fluidName   = extractFluidName(name);
+	m_channelName = extractChannelName(name);
+	m_channel     = &MayaTools::findChannel(m_channelName);
+}
+
+
 MStatus Field3dCacheFormat::findChannelName(const MString& name) {
 
-	string channelName = extractChannelName(name);
-	string fluidNName  = extractFluidName(name);
+	PROFILE_SESSION(m_profile);
+
+	const string channelName = extractChannelName(name);
+	const string fluidNName  = extractFluidName(name);
 
 	// resolution and offset are implicitely present
-	if( channelName=="resolution" || channelName=="offset" ) {
-		m_currentName=name;
+	if( MayaTools::isImplicitChannel(MayaTools::findChannel(channelName)) ) {
+		setCurrentName(name);
 		return MS::kSuccess;
 	}
 
 	// parse channel names present in the field3d file
-	vector<string> channels;
-	Field3DTools::getFieldNames( m_inFile , channels);
+	if(!m_inHandle) return MS::kFailure;
+	PROFILE_SCOPE("find_channel", channelName);
+	const vector<string> &channels = m_inHandle->fieldNames( m_inHandle->partition(fluidNName) );
 
 	// iterate through channels and look for the needed one
 	if( find( channels.begin(), channels.end(), channelName ) == channels.end() ) {
@@ -240,14 +361,12 @@ MStatus Field3dCacheFormat::findChannelName(const MString& name) {
 	}
 
 	// name was found , record it
-	m_currentName = name;
+	setCurrentName(name);
 	DEBUG(channelName + " found in the stack.");
 	return MS::kSuccess;
 
 }
 
-#include <stack>
-
 MStatus Field3dCacheFormat::readChannelName(MString& name)
 //
 //  Given that the right time has already been found, find the name
@@ -258,34 +377,43 @@ MStatus Field3dCacheFormat::readChannelName(MString& name)
 //
 {
 
-	static stack<string> channelNameStack;
-	string fluidName = extractFluidName(m_currentName);
+	if(!m_inHandle) return MS::kFailure;
+	const string fluidName = m_fluidName;
 
 	// re-read the name stack if needed, add extra name
 	// resolution and offset since they don't exists as
-	// separate fields in the file
+	// separate fields in the file. Each fluid of the file
+	// has its own partition, named after it.
 	if(m_ReadNameStack) {
-		vector<string> tmp;
-		Field3DTools::getFieldNames(m_inFile , tmp);
-		channelNameStack.push(fluidName + string("_resolution"));
-		channelNameStack.push(fluidName + string("_offset"));
-		for(vector<string>::iterator i=tmp.begin();i!=tmp.end(); ++i) {
-			channelNameStack.push(fluidName + "_" + *i);
+		m_channelNameStack = stack<string>();
+		const vector<string> &partitions = m_inHandle->partitionNames();
+		for(vector<string>::const_iterator p=partitions.begin();p!=partitions.end(); ++p) {
+
+			// single fluid files keep the name of the reading fluid
+			string prefix = *p;
+			if(partitions.size()==1 && !fluidName.empty()) prefix = fluidName;
+
+			const vector<string> &tmp = m_inHandle->fieldNames(*p);
+			m_channelNameStack.push(prefix + string("_resolution"));
+			m_channelNameStack.push(prefix + string("_offset"));
+			for(vector<string>::const_iterator i=tmp.begin();i!=tmp.end(); ++i) {
+				m_channelNameStack.push(prefix + "_" + *i);
+			}
 		}
 		m_ReadNameStack=false;
 	}
 
 	// if there are some remaining names in the stack
 	// return MS::kSuccess
-	if(!channelNameStack.empty()) {
-		name=channelNameStack.top().c_str();
-		channelNameStack.pop();
-		m_currentName = name;
-		DEBUG(m_currentName + " succesfully read from the name stack")
+	if(!m_channelNameStack.empty()) {
+		name=m_channelNameStack.top().c_str();
+		m_channelNameStack.pop();
+		setCurrentName(name);
+		DEBUG(m_currentName + " succesfully read from the name stack");
 		return MS::kSuccess;
 	}
 
-	DEBUG("No more name to read in the name stack")
+	DEBUG("No more name to read in the name stack");
 	return MS::kFailure;
 
 }
@@ -294,21 +422,114 @@ MStatus Field3dCacheFormat::readChannelName(MString& name)
 
 MStatus Field3dCacheFormat::writeChannelName(const MString& name)
 {
-	m_currentName = name;
+	setCurrentName(name);
 	return MS::kSuccess;
 }
 
 
 
+int Field3dCacheFormat::sparseBlockOrder( const string &fluidName, const string &channelName, const unsigned int resolution[3], const float *data ) {
+
+	const string key = fluidName + "_" + channelName;
+	map<string,int>::const_iterator it = m_blockOrders.find(key);
+	if( it != m_blockOrders.end() ) return it->second;
+
+	// auto : tuned on the first frame written, then kept for the whole cache
+	int blockOrder = Field3DTools::blockOrderSetting( Field3DTools::formatName(FIELD_TYPE, FIELD_DATA_TYPE), channelName );
+	if( blockOrder == Field3DTools::BLOCK_ORDER_AUTO && data == NULL ) {
+		// MAC channels aren't tuned, the costs are measured on voxels
+		blockOrder = Field3DTools::SPARSE_BLOCK_ORDER;
+	}
+	else if( blockOrder == Field3DTools::BLOCK_ORDER_AUTO ) {
+		PROFILE_SCOPE("block_order_tuning", channelName);
+		blockOrder = Field3DTools::tuneBlockOrder(resolution, data, NULL, NULL, FIELD_DATA_TYPE);
+	}
+
+	m_blockOrders[key] = blockOrder;
+	return blockOrder;
+}
+
+
+bool Field3dCacheFormat::writeReference( const string &fluidName, const string &channelName, unsigned int resolution[3], double transform[4][4], Field3DTools::ChannelLayout layout, const float *a, const float *b, const float *c ) {
+
+	if( !Field3DTools::useChannelDedup() || a == NULL ) return false;
+
+	// values of each component, faces for MAC channels
+	const size_t voxels = (size_t) resolution[0] * resolution[1] * resolution[2];
+	size_t count[3] = { voxels, voxels, voxels };
+	if( layout == Field3DTools::MAC_CHANNEL ) {
+		count[0] = (size_t) (resolution[0]+1) * resolution[1] * resolution[2];
+		count[1] = (size_t) resolution[0] * (resolution[1]+1) * resolution[2];
+		count[2] = (size_t) resolution[0] * resolution[1] * (resolution[2]+1);
+	}
+
+	unsigned long long hash;
+	{
+		PROFILE_SCOPE("content_hash", channelName);
+		hash = Field3DTools::contentHash(resolution, 3 * sizeof(unsigned int), layout);
+		hash = Field3DTools::contentHash(transform, 16 * sizeof(double), hash);
+		hash = Field3DTools::contentHash(a, count[0] * sizeof(float), hash);
+		if( b ) hash = Field3DTools::contentHash(b, count[1] * sizeof(float), hash);
+		if( c ) hash = Field3DTools::contentHash(c, count[2] * sizeof(float), hash);
+	}
+
+	const string key  = fluidName + "_" + channelName;
+	const string file = fileBaseName(m_filename);
+	map<string,ChannelRecord>::const_iterator it = m_channelRecords.find(key);
+
+	// the same file may be written again when a frame is cached twice
+	if( it != m_channelRecords.end() && it->second.hash == hash && it->second.file != file ) {
+		const bool vector = layout != Field3DTools::SCALAR_CHANNEL;
+		if( Field3DTools::writeReferenceLayer(m_outFile, fluidName.c_str(), channelName.c_str(), resolution, transform, vector) ) {
+			m_outFile->metadata().setStrMetadata(Field3DTools::referenceMetadataName(fluidName, channelName), it->second.file);
+			PROFILE_COUNT("referenced_layers", 1);
+			DEBUG(channelName + " is unchanged since " + it->second.file);
+			return true;
+		}
+		WARNING("Failed to write a reference for " + channelName + ", writing its data");
+	}
+
+	// written from this file on, the caller drops it if the write fails
+	ChannelRecord &record = m_channelRecords[key];
+	record.hash = hash;
+	record.file = file;
+	return false;
+}
+
+
+vector<char> *Field3dCacheFormat::decodedChannel( list<DecodedChannel> &channels, size_t capacity, const Field3DTools::InputFileHandle &file, const string &key, size_t bytes, bool &found ) {
+
+	for( list<DecodedChannel>::iterator it = channels.begin(); it != channels.end(); ++it ) {
+		// a file rewritten since has a new handle
+		if( it->file.get() == file.get() && it->key == key ) {
+			found = it->data.size() == bytes;
+			channels.splice(channels.begin(), channels, it);
+			return &channels.front().data;
+		}
+	}
+
+	found = false;
+	if( capacity && channels.size() >= capacity ) channels.pop_back();
+	channels.push_front(DecodedChannel());
+	channels.front().file = file;
+	channels.front().key  = key;
+	return &channels.front().data;
+}
+
+
 template< class T > // T is MFloatArray or MDoubleArray
-MStatus Field3dCacheFormat::writeArray( T &/*array*/ ) {
+MStatus Field3dCacheFormat::writeArray( T &array ) {
+
+	PROFILE_SESSION(m_profile);
+	Field3DTools::ScopedFieldPool fieldPool(m_fieldPool);
 
-	// "fluidName_channelName" => channelName
-	// "fluidName_channelName" => fluidName
-	string channelName = extractChannelName ( m_currentName );
-	string fluidName   = extractFluidName   ( m_currentName );
+	// resolved by writeChannelName()
+	const string                       &channelName = m_channelName ;
+	const string                       &fluidName   = m_fluidName   ;
+	const MayaTools::ChannelDescriptor &channel     = *m_channel    ;
 
 	LOG("Writing channel " + channelName ) ;
+	if(!m_outFile) return MS::kFailure;
 
 	if(fluidName.empty()) {
 		// TODO : find out why this fluidName can be empty
@@ -319,11 +540,12 @@ MStatus Field3dCacheFormat::writeArray( T &/*array*/ ) {
 	//   so we don't need to store it in a specific extra location.
 	// _ Offset is stored in a global metadata while invoking writeHeader()
 	//   see this function for more explanations
-	if( channelName=="resolution" || channelName=="offset" ) {
+	if( MayaTools::isImplicitChannel(channel) ) {
 		return MS::kSuccess;
 	}
 
 	// maya node
+	PROFILE_START(mayaAccess);
 	MFnFluid fluid;
 	CHECK_MSTATUS_AND_RETURN_IT( MayaTools::getFluidNode(fluidName,fluid) );
 
@@ -339,6 +561,21 @@ MStatus Field3dCacheFormat::writeArray( T &/*array*/ ) {
 	double dimension[3]={0.0,0.0,0.0};
 	fluid.getDimensions(dimension[0], dimension[1], dimension[2]);
 
+	// dynamic offset of this fluid == {0.0,0.0,0.0} if auto-resize is off
+	float offset[3]={0.0,0.0,0.0};
+	MayaTools::getNodeValue( fluid, "dynamicOffsetX" , offset[0]);
+	MayaTools::getNodeValue( fluid, "dynamicOffsetY" , offset[1]);
+	MayaTools::getNodeValue( fluid, "dynamicOffsetZ" , offset[2]);
+	PROFILE_STOP(mayaAccess, "maya_access", channelName);
+
+	// recorded per fluid, written with the global metadata on close()
+	const Field3D::V3f off(offset[0], offset[1], offset[2]);
+	const Field3D::V3f er(-999.999,-999.999,-999.999);
+	m_outFile->metadata().setVecFloatMetadata(Field3DTools::offsetMetadataName(fluidName), off);
+	if( m_outFile->metadata().vecFloatMetadata("Offset", er) == er ) {
+		m_outFile->metadata().setVecFloatMetadata("Offset", off);
+	}
+
 	// move the center to [0,1]
 	double mapTo01[4][4] = {
 			{ 1.0  , 0.0  , 0.0  , 0.0 } ,
@@ -353,7 +590,7 @@ MStatus Field3dCacheFormat::writeArray( T &/*array*/ ) {
 			{ dimension[0] , 0.0          , 0.0          , 0.0 } ,
 			{ 0.0          , dimension[1] , 0.0          , 0.0 } ,
 			{ 0.0          , 0.0          , dimension[2] , 0.0 } ,
-			{ m_offset[0]  , m_offset[1]  , m_offset[2]  , 1.0 }
+			{ offset[0]    , offset[1]    , offset[2]    , 1.0 }
 	};
 	MMatrix autoResizeTransf  = MMatrix(autoResize);
 
@@ -362,111 +599,114 @@ MStatus Field3dCacheFormat::writeArray( T &/*array*/ ) {
 	MMatrix resTransf    = mapTo01Transf * autoResizeTransf * parentTransf ;
 	resTransf.get(transform);
 
-	// test the type of array
-	bool density     = ( channelName == "density"     );
-	bool pressure    = ( channelName == "pressure"    );
-	bool fuel        = ( channelName == "fuel"        );
-	bool temperature = ( channelName == "temperature" );
-	bool falloff     = ( channelName == "falloff"     );
-	bool color       = ( channelName == "color"       );
-	bool coord       = ( channelName == "coord"       );
-	bool velocity    = ( channelName == "velocity"    );
+	// fetch the raw data, channels Maya doesn't give access to are written
+	// from the array holding one value per voxel, or three ( a vector layer )
+	const size_t voxels = (size_t) resolution[0] * resolution[1] * resolution[2];
+	Field3DTools::ChannelLayout layout = channel.layout;
+	float *a = NULL, *b = NULL, *c = NULL;
+	if( channel.accessor ) {
+		(*channel.accessor)(fluid, a, b, c);
+	}
+	else if( array.length() == voxels || array.length() == 3 * voxels ) {
+		const size_t components = array.length() / voxels;
+		layout = components == 3 ? Field3DTools::VECTOR_CHANNEL : Field3DTools::SCALAR_CHANNEL;
+
+		// Maya's array interleaves the components of a voxel
+		a = m_fieldPool.buffer<float>(array.length(), "custom");
+		if( a && components == 3 ) {
+			b = a + voxels;
+			c = b + voxels;
+			for(size_t i=0; i<voxels; i++) {
+				a[i] = (float) array[3*i  ];
+				b[i] = (float) array[3*i+1];
+				c[i] = (float) array[3*i+2];
+			}
+		}
+		else if( a ) {
+			for(size_t i=0; i<voxels; i++) a[i] = (float) array[i];
+		}
+	}
+	else {
+		WARNING( "Channel " + channelName + " not written : its values don't match the voxels of the fluid" );
+		return MS::kSuccess;
+	}
 
 	// test the field type
-	if ( density || pressure || fuel || temperature  || falloff) {
-
-		// pointer to the read function we'll call based on the dynamic type
-		bool (*writeScalarFuncPtr) (
-				Field3D::Field3DOutputFile * ,
-				const char *                 ,
-				const char *                 ,
-				unsigned int [3]             ,
-				double       [4][4]          ,
-				float *                      ) = NULL ;
-
-		// fetch the raw data
-		float *         data = NULL                ;
-		if(density)     data = fluid.density()     ;
-		if(pressure)    data = fluid.pressure()    ;
-		if(fuel)        data = fluid.fuel()        ;
-		if(temperature) data = fluid.temperature() ;
-		if(falloff)     data = fluid.falloff()     ;
-
-		// select the propers function
-		if ( FIELD_TYPE == Field3DTools::DENSE && FIELD_DATA_TYPE == Field3DTools::HALF)
-			writeScalarFuncPtr = &Field3DTools::writeDenseScalarField <Field3D::half> ;
-
-		else if ( FIELD_TYPE == Field3DTools::DENSE && FIELD_DATA_TYPE == Field3DTools::FLOAT)
-			writeScalarFuncPtr = &Field3DTools::writeDenseScalarField <float>;
-
-		else if ( FIELD_TYPE == Field3DTools::SPARSE && FIELD_DATA_TYPE == Field3DTools::HALF)
-			writeScalarFuncPtr = &Field3DTools::writeSparseScalarField <Field3D::half> ;
-
-		else if ( FIELD_TYPE == Field3DTools::SPARSE && FIELD_DATA_TYPE == Field3DTools::FLOAT)
-			writeScalarFuncPtr = &Field3DTools::writeSparseScalarField <float>;
+	if ( layout == Field3DTools::SCALAR_CHANNEL ) {
 
-		else {
-			ERROR( "Writing of " + channelName + " file failed : Unknown Types");
-			return MS::kFailure;
+		float *data = a;
+		if( writeReference(fluidName, channelName, resolution, transform, Field3DTools::SCALAR_CHANNEL, data, NULL, NULL) ) {
+			return MS::kSuccess;
+		}
+
+		// storage of the channel, or the format's one
+		Field3DTools::FieldTypeEnum fieldType = channel.storage == MayaTools::DENSE_STORAGE ? Field3DTools::DENSE : FIELD_TYPE;
+
+		// block order of sparse fields, set or tuned once per channel
+		int blockOrder = Field3DTools::SPARSE_BLOCK_ORDER;
+		if( fieldType != Field3DTools::DENSE && data != NULL ) {
+			blockOrder = sparseBlockOrder(fluidName, channelName, resolution, data);
 		}
 
-		// write this field
-		bool res = (*writeScalarFuncPtr)(m_outFile, fluidName.c_str(), channelName.c_str(), resolution, transform, data);
+		// f3d-auto-* : dense or sparse, for this channel and this frame
+		if( fieldType == Field3DTools::AUTO && data != NULL ) {
+			PROFILE_SCOPE("auto_measure", channelName);
+			Field3DTools::Occupancy occupancy;
+			Field3DTools::measureOccupancy(resolution, blockOrder, data, NULL, NULL, occupancy);
+			fieldType = Field3DTools::chooseFieldType(occupancy, blockOrder, 1, FIELD_DATA_TYPE);
+			PROFILE_COUNT( fieldType == Field3DTools::SPARSE ? "auto_sparse_layers" : "auto_dense_layers", 1 );
+		}
+		if( fieldType == Field3DTools::AUTO ) fieldType = Field3DTools::DENSE;
+
+		// recorded in every file, as each frame may be read on its own
+		if( fieldType == Field3DTools::SPARSE ) {
+			m_outFile->metadata().setIntMetadata(Field3DTools::blockOrderMetadataName(fluidName, channelName), blockOrder);
+			PROFILE_COUNT( Field3DTools::blockOrderCounter(blockOrder), 1 );
+		}
+
+		// in the export type of the format ( see field3D_Dispatch.h )
+		Field3DTools::ScalarChannelWriter writer(m_outFile, m_writePath, fluidName.c_str(), channelName.c_str(), resolution, transform, data, fieldType, blockOrder);
+		const bool res = Field3DTools::dispatchDataType(FIELD_DATA_TYPE, writer);
 		if(!res) {
 			ERROR( "Writing of " + channelName + " file failed : Unknown reason ( see above for an explanation ? )");
+			m_channelRecords.erase(fluidName + "_" + channelName);
 			return MS::kFailure;
 		}
 	}
 
-	else if (color || coord || velocity) {
-
-		// fetch the raw data
-		float        *a = NULL, *b = NULL, *c = NULL ;
-		if(color)    fluid.getColors(a,b,c)          ;
-		if(coord)    fluid.getCoordinates(a,b,c)     ;
-		if(velocity) fluid.getVelocity(a,b,c)        ;
-
-		// pointer to the read function we'll call based on the dynamic type
-		bool (*writeVectorFuncPtr) (
-				Field3D::Field3DOutputFile * ,
-				const char *                 ,
-				const char *                 ,
-				unsigned int [3]             ,
-				double       [4][4]          ,
-				const float *                ,
-				const float *                ,
-				const float *                ) = NULL;
-
-		// color and coord must not be stored as sparse fields
-		// as we don't know how the threshold can affect them
-		if ( FIELD_DATA_TYPE == Field3DTools::HALF && !velocity)
-			writeVectorFuncPtr = &Field3DTools::writeDenseVectorField <Field3D::half> ;
-
-		else if ( FIELD_DATA_TYPE == Field3DTools::FLOAT && !velocity)
-			writeVectorFuncPtr = &Field3DTools::writeDenseVectorField <float> ;
-
-		else if ( FIELD_DATA_TYPE == Field3DTools::HALF && velocity)
-			writeVectorFuncPtr = &Field3DTools::writeMACVectorField <Field3D::half> ;
-
-		else if ( FIELD_DATA_TYPE == Field3DTools::FLOAT && velocity)
-			writeVectorFuncPtr = &Field3DTools::writeMACVectorField <float> ;
+	else {
 
-		else {
-			ERROR( "Writing of " + channelName + " file failed : Unknown Types");
-			return MS::kFailure;
+		const bool velocity = channel.storage == MayaTools::MAC_STORAGE;
+		if( writeReference(fluidName, channelName, resolution, transform, layout, a, b, c) ) {
+			return MS::kSuccess;
 		}
 
-		// write this field
-		bool res = (*writeVectorFuncPtr)(
-				m_outFile           ,
-				fluidName.c_str()   ,
-				channelName.c_str() ,
-				resolution          ,
-				transform           ,
-				a, b, c	);
+		// vector channels are dense, as we don't know how the threshold
+		// can affect them, velocity is a MAC field ( see maya_Channels.cpp )
+		// made of three sparse layers of faces in f3d-sparse unless FIELD3D_SPARSE_VELOCITY is 0
+		Field3DTools::FieldTypeEnum fieldType  = Field3DTools::DENSE;
+		int                         blockOrder = Field3DTools::SPARSE_BLOCK_ORDER;
+		float                      *mask       = NULL;
+		if( velocity && FIELD_TYPE == Field3DTools::SPARSE && Field3DTools::sparseVelocity() != Field3DTools::VELOCITY_DENSE ) {
+			fieldType  = Field3DTools::SPARSE;
+			blockOrder = sparseBlockOrder(fluidName, channelName, resolution, NULL);
+			m_outFile->metadata().setIntMetadata(Field3DTools::blockOrderMetadataName(fluidName, channelName), blockOrder);
+			PROFILE_COUNT( Field3DTools::blockOrderCounter(blockOrder), 1 );
+
+			// without density, the blocks are culled by magnitude
+			const MayaTools::ChannelDescriptor &density = MayaTools::findChannel("density");
+			if( Field3DTools::sparseVelocity() == Field3DTools::VELOCITY_DENSITY_MASK && density.accessor ) {
+				float *unused0 = NULL, *unused1 = NULL;
+				(*density.accessor)(fluid, mask, unused0, unused1);
+			}
+		}
+		Field3DTools::VectorChannelWriter writer(m_outFile, m_writePath, fluidName.c_str(), channelName.c_str(), resolution, transform, a, b, c, velocity,
+		                                         fieldType, blockOrder, mask);
+		const bool res = Field3DTools::dispatchDataType(FIELD_DATA_TYPE, writer);
 
 		if(!res) {
 			ERROR( "Writing of " + channelName + " file failed : Unknown reason ( see above for an explanation ? )");
+			m_channelRecords.erase(fluidName + "_" + channelName);
 			return MS::kFailure;
 		}
 	}
@@ -493,176 +733,252 @@ MStatus Field3dCacheFormat::readHeader() {
 	return m_isFileOpened ? MS::kSuccess : MS::kFailure ;
 }
 
+// the channels are handed to Maya at the resolution of the fluid they're
+// read into, the file's one is kept when the fluid can't be found
+static void targetResolution( const string &fluidName, unsigned int resolution[3] ) {
+	MFnFluid     fluid;
+	unsigned int target[3] = {0,0,0};
+	if( MayaTools::getFluidNode(fluidName, fluid) != MS::kSuccess ) return;
+	if( fluid.getResolution(target[0], target[1], target[2]) != MS::kSuccess ) return;
+	if( target[0] == 0 || target[1] == 0 || target[2] == 0 ) return;
+	copy(target, target+3, resolution);
+}
+
 unsigned Field3dCacheFormat::readArraySize() {
-	string channelName = extractChannelName(m_currentName);
-	string fluidName   = extractFluidName(m_currentName);
+	PROFILE_SESSION(m_profile);
 
 	DEBUG("Reading " + m_currentName);
-	if(channelName=="resolution" || channelName=="offset") {
-		return 3;
+	if( MayaTools::isImplicitChannel(*m_channel) ) {
+		return m_channel->components;
 	}
 
-	// get resolution of the first field found
+	// get resolution of the first field found in the fluid's partition
 	unsigned int resolution[3] = {0,0,0};
-	Field3DTools::getFieldsResolution( m_inFile , resolution);
+	if(!m_inHandle) return 0;
+	{
+		PROFILE_SCOPE("resolution", m_channelName);
+		m_inHandle->fieldsResolution(resolution, m_inHandle->partition(m_fluidName));
+	}
+	if( Field3DTools::channelValues(m_channel->layout, resolution) == 0 ) return 0;
+
+	// readArray() resamples the layers when the fluid's resolution differs
+	targetResolution(m_fluidName, resolution);
+	return (unsigned) Field3DTools::channelValues(m_channel->layout, resolution);
+
+}
+
+
 
-	// test the type of array
-	bool density     = ( channelName == "density"     );
-	bool pressure    = ( channelName == "pressure"    );
-	bool fuel        = ( channelName == "fuel"        );
-	bool temperature = ( channelName == "temperature" );
-	bool falloff     = ( channelName == "falloff"     );
-	bool color       = ( channelName == "color"       );
-	bool coord       = ( channelName == "coord"       );
-	bool velocity    = ( channelName == "velocity"    );
+template< typename Dest_T >
+bool Field3dCacheFormat::decodeChannel( const Field3DTools::InputFileHandle &file, const string &channelName, Field3DTools::ChannelLayout layout, const unsigned int resolution[3], Dest_T *data ) {
 
-	unsigned int size = 0;
+	const string partition = file->partition(m_fluidName);
 
-	if( density || pressure || fuel || temperature || falloff) {
-		size = resolution[0]     * resolution[1]     * resolution[2]     ;
+	// a static channel is stored in the file named by the reference, this
+	// file only holds an empty layer ( see Field3DTools::useChannelDedup )
+	const string reference = file->file.metadata().strMetadata(Field3DTools::referenceMetadataName(partition, channelName), "");
+	Field3DTools::InputFileHandle dataHandle = file;
+	string dataPartition = partition;
+	if( !reference.empty() ) {
+		dataHandle = Field3DTools::InputFilePool::instance().open(fileDirectory(m_filename) + reference);
+		if( !dataHandle ) {
+			ERROR("Failed to read " + channelName + " : the file holding it, " + reference + ", can't be opened");
+			return false;
+		}
+		dataPartition = dataHandle->partition(partition);
+		PROFILE_COUNT("referenced_layers_read", 1);
 	}
-	else if( color || coord ) {
-		size = resolution[0]     * resolution[1]     * resolution[2] * 3 ;
+
+	// referenced channels are decoded once for all the frames sharing them,
+	// the channels of a frame pair once for all the sub-frames between them
+	const size_t  values  = Field3DTools::channelValues(layout, resolution);
+	const size_t  bytes   = values * sizeof(Dest_T);
+	bool          cached  = false;
+	vector<char> *decoded = NULL;
+	stringstream  key;
+	key << dataPartition << "_" << channelName << "_" << sizeof(Dest_T);
+	if( m_nextHandle ) {
+		decoded = decodedChannel(m_frameChannels, 0, file, key.str(), bytes, cached);
 	}
-	else if( velocity ) {
-		size = (resolution[0]+1) * resolution[1]     * resolution[2]     ;
-		size += resolution[0]    * (resolution[1]+1) * resolution[2]     ;
-		size += resolution[0]    * resolution[1]     * (resolution[2]+1) ;
+	else if( !reference.empty() ) {
+		decoded = decodedChannel(m_decodedChannels, DECODED_CHANNELS, dataHandle, key.str(), bytes, cached);
 	}
-	else {
-		ERROR("Failed to get channel resolution " + channelName + " : Type not recognized ");
-		return 0;
+
+	if( cached ) {
+		memcpy(data, &(*decoded)[0], bytes);
+		PROFILE_COUNT("decoded_channel_hits", 1);
+		return true;
 	}
 
-	return size;
+	Field3DTools::SupportedFieldTypeEnum fieldType = Field3DTools::TypeUnsupported ;
+	if( !Field3DTools::readField(&dataHandle->file, dataPartition, channelName, layout, data, values, fieldType) ) return false;
+	DEBUG( channelName + " stored as " + Field3DTools::fieldTypeName(fieldType) );
 
+	if( decoded ) {
+		const char *raw = reinterpret_cast<const char *>(data);
+		decoded->assign(raw, raw + bytes);
+	}
+	return true;
 }
 
 
+template< typename Dest_T >
+bool Field3dCacheFormat::blendNextFrame( const string &channelName, Field3DTools::ChannelLayout layout, const unsigned int resolution[3], Dest_T *data ) {
+
+	// frames of another resolution or offset ( auto-resize ) don't line up,
+	// the previous one is held
+	const string partition     = m_inHandle->partition(m_fluidName);
+	const string nextPartition = m_nextHandle->partition(m_fluidName);
+	unsigned int nextRes[3]    = {0,0,0};
+	m_nextHandle->fieldsResolution(nextRes, nextPartition);
+
+	const Field3D::V3f er(-999.999,-999.999,-999.999);
+	const Field3D::V3f glob     = m_inFile->metadata().vecFloatMetadata("Offset", er);
+	const Field3D::V3f nextGlob = m_nextHandle->file.metadata().vecFloatMetadata("Offset", er);
+	const Field3D::V3f offset     = m_inFile->metadata().vecFloatMetadata(Field3DTools::offsetMetadataName(partition), glob);
+	const Field3D::V3f nextOffset = m_nextHandle->file.metadata().vecFloatMetadata(Field3DTools::offsetMetadataName(nextPartition), nextGlob);
+
+	if( !equal(resolution, resolution+3, nextRes) || offset != nextOffset ) {
+		DEBUG( channelName + " held : the next frame has another resolution or offset" );
+		PROFILE_COUNT("subframes_held", 1);
+		return true;
+	}
+
+	const size_t values = Field3DTools::channelValues(layout, resolution);
+	Dest_T      *next   = m_fieldPool.buffer<Dest_T>(values, "next");
+	if( !next || !decodeChannel(m_nextHandle, channelName, layout, resolution, next) ) {
+		WARNING( channelName + " held : it can't be read from the next frame" );
+		PROFILE_COUNT("subframes_held", 1);
+		return true;
+	}
+
+	PROFILE_SCOPE("subframe", channelName);
+
+	// scalars follow the velocity of the previous frame, in voxels across the gap
+	if( layout == Field3DTools::SCALAR_CHANNEL && Field3DTools::subframeMode() == Field3DTools::SUBFRAME_ADVECT ) {
+		const vector<string> &channels = m_inHandle->fieldNames(partition);
+		const size_t          faces    = Field3DTools::channelValues(Field3DTools::MAC_CHANNEL, resolution);
+		Dest_T               *velocity = m_fieldPool.buffer<Dest_T>(faces, "velocity");
+		Dest_T               *previous = m_fieldPool.buffer<Dest_T>(values, "previous");
+
+		MFnFluid fluid;
+		double   dimension[3] = { 0.0, 0.0, 0.0 };
+		if( MayaTools::getFluidNode(m_fluidName, fluid) == MS::kSuccess ) fluid.getDimensions(dimension[0], dimension[1], dimension[2]);
+
+		if( velocity && previous && dimension[0] > 0.0 && dimension[1] > 0.0 && dimension[2] > 0.0 &&
+		    find(channels.begin(), channels.end(), "velocity") != channels.end() &&
+		    decodeChannel(m_inHandle, "velocity", Field3DTools::MAC_CHANNEL, resolution, velocity) ) {
+
+			const double seconds  = MTime( (double) m_pairFrames, MTime::uiUnit() ).as(MTime::kSeconds);
+			const float  scale[3] = {
+				(float) ( resolution[0] / dimension[0] * seconds ),
+				(float) ( resolution[1] / dimension[1] * seconds ),
+				(float) ( resolution[2] / dimension[2] * seconds )
+			};
+			memcpy(previous, data, values * sizeof(Dest_T));
+			Field3DTools::advectChannel(previous, next, data, resolution, velocity, scale, m_nextWeight);
+			PROFILE_COUNT("subframes_advected", 1);
+			return true;
+		}
+		DEBUG( channelName + " blended : no velocity to advect it along" );
+	}
+
+	Field3DTools::blendChannel(data, next, data, values, m_nextWeight);
+	PROFILE_COUNT("subframes_blended", 1);
+	return true;
+}
+
 
 template< class T> // T is MFloatArray or MDoubleArray
 MStatus Field3dCacheFormat::readArray(T &array, unsigned int arraySize) {
 
-	string channelName = extractChannelName(m_currentName) ;
-	string fluidName   = extractFluidName(m_currentName)   ;
+	PROFILE_SESSION(m_profile);
+
+	// resolved by findChannelName() or readChannelName()
+	const string                       &channelName = m_channelName ;
+	const string                       &fluidName   = m_fluidName   ;
+	const MayaTools::ChannelDescriptor &channel     = *m_channel    ;
 
-	// assuming the resolution of all fields are at the same
-	// which could be obviously not true for any generic Field3d file
+	if(!m_inHandle) return MS::kFailure;
+	string partition = m_inHandle->partition(fluidName);
+
+	// assuming the resolution of all fields of a fluid are at the same
+	// which could be obviously not true for any generic Field3d file.
+	// It doesn't have to match the fluid's one ( see the resampling below )
 	unsigned int resolution[3] = {1,1,1};
-	Field3DTools::getFieldsResolution( m_inFile , resolution);
+	{
+		PROFILE_SCOPE("resolution", channelName);
+		m_inHandle->fieldsResolution(resolution, partition);
+	}
+	unsigned int target[3] = { resolution[0], resolution[1], resolution[2] };
+	targetResolution(fluidName, target);
 
 	stringstream size ;
 	size<<arraySize   ;
 	DEBUG("Reading Array " + channelName + " of size " + size.str() + " and resolution " + display3(resolution) );
 
-	// allocate memory
-	array.setLength(arraySize);
-
-	if( channelName == "resolution" ) {
-		array[0] = resolution[0];
-		array[1] = resolution[1];
-		array[2] = resolution[2];
+	if( channel.storage == MayaTools::RESOLUTION_STORAGE ) {
+		array.setLength(arraySize);
+		array[0] = target[0];
+		array[1] = target[1];
+		array[2] = target[2];
 		return MS::kSuccess;
 	}
-	else if( channelName == "offset" ) {
-		array[0] = m_offset[0];
-		array[1] = m_offset[1];
-		array[2] = m_offset[2];
+	else if( channel.storage == MayaTools::OFFSET_STORAGE ) {
+		// offset of this fluid, or the global one for older files
+		const Field3D::V3f glob(m_offset[0], m_offset[1], m_offset[2]);
+		Field3D::V3f off = m_inFile->metadata().vecFloatMetadata(Field3DTools::offsetMetadataName(partition), glob);
+		array.setLength(arraySize);
+		array[0] = off[0];
+		array[1] = off[1];
+		array[2] = off[2];
 		return MS::kSuccess;
 	}
 
-	// test the type of array
-	bool density     = ( channelName == "density"     );
-	bool pressure    = ( channelName == "pressure"    );
-	bool fuel        = ( channelName == "fuel"        );
-	bool temperature = ( channelName == "temperature" );
-	bool falloff     = ( channelName == "falloff"     );
-	bool color       = ( channelName == "color"       );
-	bool coord       = ( channelName == "coord"       );
-	bool velocity    = ( channelName == "velocity"    );
+	typedef typename MayaArrayTraits<T>::value_type Dest_T;
 
-	// check dynamically the type of the field
-	Field3DTools::SupportedFieldTypeEnum fieldType = Field3DTools::TypeUnsupported ;
-	bool res = Field3DTools::getFieldValueType(m_inFile,channelName,fieldType);
-	if(!res) {
-		ERROR("Failed to read " + channelName + " : Data type unsupported");
+	// channels missing from the table hold one or three values per voxel
+	Field3DTools::ChannelLayout layout = channel.layout;
+	if( MayaTools::isCustomChannel(channel) && arraySize == Field3DTools::channelValues(Field3DTools::VECTOR_CHANNEL, target) ) {
+		layout = Field3DTools::VECTOR_CHANNEL;
+	}
+
+	// a cache written at another resolution than the fluid's one
+	// is decoded at its own resolution, then resampled
+	if( arraySize != 0 && arraySize != Field3DTools::channelValues(layout, target) ) {
+		ERROR( "Failed to read " + channelName + " : " + size.str() + " values requested for a resolution of " + display3(target) );
 		return MS::kFailure;
 	}
+	const bool resample = arraySize != 0 && !equal(target, target+3, resolution);
+	if( resample ) {
+		DEBUG( "Resampling " + channelName + " from " + display3(resolution) + " to " + display3(target) );
+	}
 
-	// pointer to the read function we'll call based on the dynamic type
-	bool (*readFuncPtr) (Field3D::Field3DInputFile *, const char * , const char *,T &) = NULL;
-	string typeName = "";
+	// the layer is read once, its type being found on the way : it's decoded
+	// into a contiguous buffer handed to Maya in one go ( see field3D_Dispatch.h )
+	Dest_T *buffer = m_fieldPool.buffer<Dest_T>(arraySize);
+	Dest_T *source = resample ? m_fieldPool.buffer<Dest_T>(Field3DTools::channelValues(layout, resolution), "source") : buffer;
 
-	// test the field type
-	if( density || pressure || fuel || temperature  || falloff) {
+	bool read_ok = arraySize==0 || ( buffer && source && decodeChannel(m_inHandle, channelName, layout, resolution, source) );
 
-		// select the proper function to call
-		if ( fieldType == Field3DTools::DenseScalarField_Half ) {
-			typeName = "Dense Scalar Field Half";
-			readFuncPtr =  & (Field3DTools::readScalarField<Field3D::DenseField<Field3D::half> >) ;
-		}
-		else if ( fieldType == Field3DTools::DenseScalarField_Float ) {
-			typeName = "Dense Scalar Field Float";
-			readFuncPtr =  & (Field3DTools::readScalarField<Field3D::DenseField<float> >) ;
-		}
-		else if ( fieldType == Field3DTools::SparseScalarField_Half) {
-			typeName = "Sparse Scalar Field Half";
-			readFuncPtr =  & (Field3DTools::readScalarField<Field3D::SparseField<Field3D::half> >) ;
-		}
-		else if ( fieldType == Field3DTools::SparseScalarField_Float) {
-			typeName = "Sparse Scalar Field Float";
-			readFuncPtr =  & (Field3DTools::readScalarField<Field3D::SparseField<float> >) ;
-		}
-		else {
-			ERROR("Type unknown or unsupported");
-			return MS::kFailure;
-		}
+	// sub-frame : blended with the next frame, before resampling
+	if( read_ok && arraySize != 0 && m_nextHandle ) {
+		read_ok = blendNextFrame(channelName, layout, resolution, source);
 	}
-	else if ( color || coord ) {
 
-		if ( fieldType == Field3DTools::DenseVectorField_Half ) {
-			typeName = "Dense Vector Field Half";
-			readFuncPtr =  & (Field3DTools::readVectorField< Field3D::DenseField<Field3D::V3h> >) ;
-		}
-		else if ( fieldType == Field3DTools::DenseVectorField_Float ) {
-			typeName = "Dense Vector Field Float";
-			readFuncPtr =  & (Field3DTools::readVectorField< Field3D::DenseField<Field3D::V3f> >) ;
-		}
-		else if ( fieldType == Field3DTools::SparseVectorField_Half) {
-			typeName = "Sparse Vector Field Half";
-			readFuncPtr =  & (Field3DTools::readVectorField< Field3D::SparseField<Field3D::V3h> >) ;
-		}
-		else if ( fieldType == Field3DTools::SparseVectorField_Float) {
-			typeName = "Sparse Vector Field Float";
-			readFuncPtr =  & (Field3DTools::readVectorField< Field3D::SparseField<Field3D::V3f> >) ;
-		}
-		else {
-			ERROR("Type unknown or unsupported");
-			return MS::kFailure;
-		}
-
-	}
-	else if (velocity) {
-		if( fieldType == Field3DTools::MACField_Half )  {
-			typeName = "MACField Half";
-			readFuncPtr =  & (Field3DTools::readMACField< Field3D::half >) ;
-		}
-		else if( fieldType == Field3DTools::MACField_Float ) {
-			typeName = "MACField Float";
-			readFuncPtr =  & (Field3DTools::readMACField< float >) ;
-		}
+	if( read_ok && resample ) {
+		PROFILE_SCOPE("resample", channelName);
+		Field3DTools::resampleChannel(layout, source, resolution, buffer, target);
 	}
 
-	// call the function
-	DEBUG("Reading " + channelName + " of type " +  typeName );
-	bool read_ok = (*readFuncPtr)(m_inFile ,	fluidName.c_str() ,	channelName.c_str() , array );
-
 	// check if the field was successfully read
 	if(!read_ok) {
 		ERROR( "Failed to read " + channelName );
 		return MS::kFailure;
 	}
 
+	array = arraySize==0 ? T() : T(buffer, arraySize);
+
 	DEBUG(channelName + " was successfully read");
 	return  MS::kSuccess;
 
@@ -681,18 +997,65 @@ MStatus Field3dCacheFormat::readDoubleArray(MDoubleArray& array, unsigned arrayS
 
 
 // -------------------------------------------------- TIME ---------------------------
-MStatus Field3dCacheFormat::readTime(MTime& /*time*/) {
-	//cout<<red<<"readTime "<<normal<<endl;
+
+// Maya's ticks ( 6000 per second ) in a frame of the scene
+static double ticksPerFrame() {
+	return MTime(1.0, MTime::uiUnit()).as(MTime::k6000FPS);
+}
+
+MStatus Field3dCacheFormat::readTime(MTime& time) {
 
 	// exract the time from the name of the
 	// cache file to keep things simple
-	size_t framePos       = m_filename.rfind("Frame");
-	size_t pointPos       = m_filename.rfind(".");
-	string frameNumberStr = m_filename.substr(framePos,pointPos);
+	Field3DTools::FrameName name;
+	if( !Field3DTools::parseFrameName(m_filename, name) ) return MS::kFailure;
 
-	int frameNumber=atoi(frameNumberStr.c_str());
+	const double ticks = ticksPerFrame();
+	time = MTime( name.frame + ( ticks > 0.0 ? name.tick / ticks : 0.0 ), MTime::uiUnit() );
+	return MS::kSuccess;
+}
+
+
+bool Field3dCacheFormat::openSubframe( const string &fileName ) {
+
+	Field3DTools::FrameName name;
+	if( !Field3DTools::parseFrameName(fileName, name) ) return false;
+
+	// the closest whole frames around it, at most FIELD3D_SUBFRAME_GAP frames apart
+	const int gap = Field3DTools::subframeGap();
+	int previous = name.tick > 0 ? name.frame : name.frame - 1;
+	while( previous >= name.frame - gap && !Field3DTools::fileExists(Field3DTools::frameFileName(name, previous)) ) previous--;
+	int next = name.frame + 1;
+	while( next <= previous + gap && !Field3DTools::fileExists(Field3DTools::frameFileName(name, next)) ) next++;
+	if( previous < name.frame - gap || next > previous + gap ) {
+		DEBUG( fileName + " can't be synthesized : no cached frames around it" );
+		return false;
+	}
+
+	m_inHandle   = Field3DTools::InputFilePool::instance().open(Field3DTools::frameFileName(name, previous));
+	m_nextHandle = Field3DTools::InputFilePool::instance().open(Field3DTools::frameFileName(name, next));
+	if( !m_inHandle || !m_nextHandle ) {
+		m_inHandle.reset();
+		m_nextHandle.reset();
+		return false;
+	}
+
+	const double ticks = ticksPerFrame();
+	const double time  = name.frame + ( ticks > 0.0 ? name.tick / ticks : 0.0 );
+	m_pairFrames = next - previous;
+	m_nextWeight = (float) ( ( time - previous ) / m_pairFrames );
+
+	// only the channels of this pair are kept decoded
+	for( list<DecodedChannel>::iterator it = m_frameChannels.begin(); it != m_frameChannels.end(); ) {
+		if( it->file.get() == m_inHandle.get() || it->file.get() == m_nextHandle.get() ) ++it;
+		else it = m_frameChannels.erase(it);
+	}
 
-	return (frameNumber>0)?MS::kSuccess : MS::kFailure;
+	stringstream frames;
+	frames << previous << " and " << next;
+	DEBUG( "Synthesizing " + fileName + " from frames " + frames.str() );
+	PROFILE_COUNT("subframes", 1);
+	return true;
 }
 
 
@@ -716,64 +1079,18 @@ MStatus Field3dCacheFormat::readNextTime(MTime& foundTime)
 
 MStatus Field3dCacheFormat::findTime(MTime& time, MTime& foundTime)
 //
-// Find the biggest cached time, which is smaller or equal to
-// seekTime and return foundTime
+// Each file holds a single time, the one of its name. Missing frames and
+// sub-frames are synthesized when they're opened ( see openSubframe ).
 //
 {
 
-	MTime timeTolerance(0.0, MTime::k6000FPS);
-	MTime seekTime(time);
-	MTime preTime( seekTime - timeTolerance );
-	MTime postTime( seekTime + timeTolerance );
-
-	bool fileRewound = false;
-	while (1) {
-		bool timeTagFound = beginReadChunk();
-		if ( ! timeTagFound && !fileRewound ) {
-			if(!rewind())
-			{
-				return MS::kFailure;
-			}
-			fileRewound = true;
-			timeTagFound = beginReadChunk();
-		}
-		if ( timeTagFound )
-		{
-			MTime rTime(0.0, MTime::k6000FPS);
-			readTime(rTime);
+	MTime timeTolerance(0.5, MTime::k6000FPS);
+	MTime fileTime;
+	if( readTime(fileTime) != MS::kSuccess ) return MS::kFailure;
 
-			if(rTime >= preTime && rTime <= postTime) {
-				foundTime = rTime;
-				return MS::kSuccess;
-			}
-			if(rTime > postTime )
-			{
-				if (!fileRewound)
-				{
-					if(!rewind())
-					{
-						return MS::kFailure;
-					}
-					fileRewound = true;
-				}
-				else
-				{
-					// Time could not be found
-					//
-					return MS::kFailure;
-				}
-			}
-			else
-			{
-				fileRewound = true;
-			}
-			endReadChunk();
-		}
-		else
-		{
-			// Not a valid disk cache file.
-			break;
-		}
+	if( fileTime >= time - timeTolerance && fileTime <= time + timeTolerance ) {
+		foundTime = fileTime;
+		return MS::kSuccess;
 	}
 
 	return MS::kFailure;
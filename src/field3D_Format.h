@@ -66,6 +66,13 @@ using namespace Field3D;
 
 
 #include "field3D_Tools.h"
+#include "field3D_FilePool.h"
+#include "field3D_Resample.h"
+#include "maya_Channels.h"
+
+#include <list>
+#include <map>
+#include <stack>
 
 class Field3dCacheFormat : public MPxCacheFormat
 {
@@ -80,11 +87,13 @@ public:
 
 	MString	extension() { return "f3d"; } ;
 
-	// specific creator : D = Dense , S = Sparse, F = float , H = half
+	// specific creator : D = Dense , S = Sparse, A = Auto, F = float , H = half
 	static void    *DHCreator()  { return new Field3dCacheFormat(Field3DTools::DENSE  , Field3DTools::HALF)  ; };
 	static void    *DFCreator()  { return new Field3dCacheFormat(Field3DTools::DENSE  , Field3DTools::FLOAT) ; };
 	static void    *SHCreator()  { return new Field3dCacheFormat(Field3DTools::SPARSE , Field3DTools::HALF)  ; };
 	static void    *SFCreator()  { return new Field3dCacheFormat(Field3DTools::SPARSE , Field3DTools::FLOAT) ; };
+	static void    *AHCreator()  { return new Field3dCacheFormat(Field3DTools::AUTO   , Field3DTools::HALF)  ; };
+	static void    *AFCreator()  { return new Field3dCacheFormat(Field3DTools::AUTO   , Field3DTools::FLOAT) ; };
 
 	// general functions inherited from MPxCacheFormat
 	MStatus open    ( const MString& fileName, FileAccessMode mode);
@@ -116,6 +125,9 @@ public:
 	MStatus  readNextTime    ( MTime& foundTime);
 	MStatus  rewind();
 
+	// timers and counters of this cache session ( see field3D_Profiler.h )
+	const Field3DProfiler::Session &profile() const { return m_profile; }
+
 
 private:
 
@@ -126,14 +138,84 @@ private:
 	template< class T >  // T is MFloatArray or MDoubleArray
 	MStatus readArray(T &array, unsigned arraySize);
 
-	Field3DInputFile   *m_inFile  ;
-	Field3DOutputFile  *m_outFile ;
-
-	std::string  m_filename      ;
-	bool         m_isFileOpened  ;
-	MString      m_currentName   ;
-	bool         m_ReadNameStack ;
-	float        m_offset[3]     ;
+	// "fluidName_channelName" of the current channel, split and resolved
+	// once when Maya names it ( see maya_Channels.h )
+	void    setCurrentName( const MString &name );
+
+	// block order of a sparse channel ( see FIELD3D_BLOCK_ORDER ),
+	// data is NULL for MAC channels
+	int     sparseBlockOrder( const std::string &fluidName, const std::string &channelName, const unsigned int resolution[3], const float *data );
+
+	// static channels ( see Field3DTools::useChannelDedup ) : true when a
+	// reference to the file holding the same data was written instead
+	bool    writeReference( const std::string &fluidName, const std::string &channelName, unsigned int resolution[3], double transform[4][4], Field3DTools::ChannelLayout layout, const float *a, const float *b, const float *c );
+
+	// a missing frame synthesized from the cached frames around it
+	// ( see field3D_Subframe.h ) : m_inHandle and m_nextHandle are set
+	bool    openSubframe( const std::string &fileName );
+
+	// a channel of the current fluid decoded from one of the opened files,
+	// at the resolution of its layers
+	template< typename Dest_T >
+	bool    decodeChannel( const Field3DTools::InputFileHandle &file, const std::string &channelName, Field3DTools::ChannelLayout layout, const unsigned int resolution[3], Dest_T *data );
+
+	// the same channel of the next frame blended into data
+	template< typename Dest_T >
+	bool    blendNextFrame( const std::string &channelName, Field3DTools::ChannelLayout layout, const unsigned int resolution[3], Dest_T *data );
+
+	// input files are shared through the pool ( see field3D_FilePool.h ),
+	// m_inFile points into m_inHandle as long as the file is opened
+	Field3DTools::InputFileHandle  m_inHandle ;
+	Field3DInputFile              *m_inFile   ;
+	Field3DOutputFile             *m_outFile  ;
+
+	std::string     m_filename      ;
+	std::string     m_writePath     ;   // m_filename, or its staged copy ( see field3D_Staging.h )
+	FileAccessMode  m_mode          ;
+	bool            m_isFileOpened  ;
+	MString         m_currentName   ;
+	std::string     m_fluidName     ;
+	std::string     m_channelName   ;
+	const MayaTools::ChannelDescriptor *m_channel ;
+	bool            m_ReadNameStack ;
+	std::stack<std::string>  m_channelNameStack ;
+	float           m_offset[3]     ;
+
+	Field3DProfiler::Session  m_profile ;
+
+	// fields and buffers reused from a frame to the next
+	Field3DTools::FieldPool   m_fieldPool ;
+
+	// block order of each "fluidName_channelName", kept for the whole cache
+	std::map<std::string,int> m_blockOrders ;
+
+	// hash of each "fluidName_channelName" and the file it was last written to
+	struct ChannelRecord {
+		unsigned long long hash ;
+		std::string        file ;
+	};
+	std::map<std::string,ChannelRecord> m_channelRecords ;
+
+	// referenced channels, most recent first
+	struct DecodedChannel {
+		Field3DTools::InputFileHandle file ;
+		std::string                   key  ;
+		std::vector<char>             data ;
+	};
+	std::list<DecodedChannel> m_decodedChannels ;
+
+	// sub-frames : the frame after m_inHandle, its weight and the frames between them
+	Field3DTools::InputFileHandle  m_nextHandle ;
+	float                          m_nextWeight ;
+	int                            m_pairFrames ;
+
+	// channels of both frames, decoded once for all the sub-frames between them
+	std::list<DecodedChannel> m_frameChannels ;
+
+	// decoded data of a channel, found is false when the returned slot has to
+	// be filled. The least recently used channel is dropped above capacity,
+	// 0 keeps them all.
+	std::vector<char> *decodedChannel( std::list<DecodedChannel> &channels, size_t capacity, const Field3DTools::InputFileHandle &file, const std::string &key, size_t bytes, bool &found );
 
 	// export Type
 	Field3DTools::FieldTypeEnum     FIELD_TYPE       ;
@@ -0,0 +1,158 @@
+// Copyright (c) 2011 Prime Focus Film.
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions
+// are met:
+//
+// Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+// Redistributions in binary form must reproduce the above copyright
+// notice, this list of conditions and the following disclaimer in the
+// documentation and/or other materials provided with the
+// distribution. Neither the name of Prime Focus Film nor the
+// names of its contributors may be used to endorse or promote
+// products derived from this software without specific prior written
+// permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+// FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+// COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+// INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+// HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+// OF THE POSSIBILITY OF SUCH DAMAGE.
+
+
+#include "field3D_Profiler.h"
+
+#include <time.h>
+#include <sys/stat.h>
+#include <cstdlib>
+#include <fstream>
+
+using namespace std;
+
+namespace Field3DProfiler {
+
+// one current session per thread, so concurrent caches don't mix up
+static __thread Session *currentSession = NULL;
+
+
+long long nowNs() {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (long long) ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+long long fileSize( const string &path ) {
+	struct stat st;
+	if( stat(path.c_str(), &st) != 0 ) return 0;
+	return (long long) st.st_size;
+}
+
+Session *current() {
+	return currentSession;
+}
+
+ScopedSession::ScopedSession( Session &session ) : m_previous(currentSession) {
+	currentSession = &session;
+}
+
+ScopedSession::~ScopedSession() {
+	currentSession = m_previous;
+}
+
+
+// ------------------------------------------- SESSION
+
+Session::Session() : m_bufferBytes(0), m_peakBuffer(0) {
+}
+
+void Session::addTime( const char *category, const string &channel, long long ns ) {
+	Timer &t = m_timers[ make_pair(string(category), channel) ];
+	t.count   += 1;
+	t.totalNs += ns;
+	if( ns > t.maxNs ) t.maxNs = ns;
+}
+
+void Session::addCount( const char *counter, long long value ) {
+	m_counters[counter] += value;
+}
+
+void Session::addBuffer( long long bytes ) {
+	m_bufferBytes += bytes;
+	if( m_bufferBytes > m_peakBuffer ) m_peakBuffer = m_bufferBytes;
+}
+
+void Session::reset() {
+	m_timers.clear();
+	m_counters.clear();
+	m_bufferBytes = 0;
+	m_peakBuffer  = 0;
+}
+
+
+void Session::write( ostream &out, DumpFormat format ) const {
+
+	typedef map< pair<string,string>, Timer >::const_iterator TimerIt;
+	typedef map< string, long long >::const_iterator          CounterIt;
+
+	if( format == CSV ) {
+		out << "type,name,channel,count,total_ns,max_ns\n";
+		for(TimerIt it=m_timers.begin(); it!=m_timers.end(); ++it) {
+			out << "timer," << it->first.first << "," << it->first.second << ","
+			    << it->second.count << "," << it->second.totalNs << "," << it->second.maxNs << "\n";
+		}
+		for(CounterIt it=m_counters.begin(); it!=m_counters.end(); ++it) {
+			out << "counter," << it->first << ",," << it->second << ",,\n";
+		}
+		out << "counter,peak_buffer_bytes,," << m_peakBuffer << ",,\n";
+		return;
+	}
+
+	out << "{\n  \"session\": \"" << name << "\",\n  \"timers\": [";
+	for(TimerIt it=m_timers.begin(); it!=m_timers.end(); ++it) {
+		out << ( it == m_timers.begin() ? "\n" : ",\n" )
+		    << "    { \"name\": \""    << it->first.first  << "\""
+		    << ", \"channel\": \""     << it->first.second << "\""
+		    << ", \"count\": "         << it->second.count
+		    << ", \"total_ns\": "      << it->second.totalNs
+		    << ", \"mean_ns\": "       << ( it->second.count ? it->second.totalNs / it->second.count : 0 )
+		    << ", \"max_ns\": "        << it->second.maxNs << " }";
+	}
+	out << "\n  ],\n  \"counters\": {";
+	for(CounterIt it=m_counters.begin(); it!=m_counters.end(); ++it) {
+		out << "\n    \"" << it->first << "\": " << it->second << ",";
+	}
+	out << "\n    \"peak_buffer_bytes\": " << m_peakBuffer << "\n  }\n}\n";
+}
+
+bool Session::write( const string &path, DumpFormat format ) const {
+	ofstream out(path.c_str());
+	if( !out ) return false;
+	write(out, format);
+	return true;
+}
+
+
+void dumpIfRequested( const Session &session ) {
+
+	const char *directory = getenv("FIELD3D_PROFILE");
+	if( !directory || !*directory ) return;
+
+	const char *formatStr = getenv("FIELD3D_PROFILE_FORMAT");
+	DumpFormat  format    = ( formatStr && string(formatStr) == "csv" ) ? CSV : JSON;
+
+	// the session keeps cumulating, so the file is just overwritten
+	string base = session.name.substr( session.name.rfind('/') + 1 );
+	session.write( string(directory) + "/" + base + ( format == CSV ? ".profile.csv" : ".profile.json" ), format );
+}
+
+}
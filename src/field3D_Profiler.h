@@ -0,0 +1,146 @@
+// Copyright (c) 2011 Prime Focus Film.
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions
+// are met:
+//
+// Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+// Redistributions in binary form must reproduce the above copyright
+// notice, this list of conditions and the following disclaimer in the
+// documentation and/or other materials provided with the
+// distribution. Neither the name of Prime Focus Film nor the
+// names of its contributors may be used to endorse or promote
+// products derived from this software without specific prior written
+// permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+// FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+// COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+// INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+// HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+// OF THE POSSIBILITY OF SUCH DAMAGE.
+
+
+#ifndef FIELD3D_PROFILER_H
+#define FIELD3D_PROFILER_H
+
+#include <map>
+#include <string>
+#include <ostream>
+
+// Hot-path timers and counters of a cache session.
+//
+// A Session aggregates everything measured while it is the current session
+// of the calling thread ( see ScopedSession ). Field3dCacheFormat owns one
+// session and makes it current in each of its entry points, so that the
+// Field3DTools templates can feed it without knowing about it.
+//
+// The PROFILE_* macros compile to nothing unless FIELD3D_PROFILING is
+// defined ( cmake -DENABLE_PROFILING=ON ).
+
+namespace Field3DProfiler {
+
+enum DumpFormat { JSON , CSV };
+
+class Session {
+public:
+	Session();
+
+	void addTime   ( const char *category, const std::string &channel, long long ns );
+	void addCount  ( const char *counter , long long value );
+	void addBuffer ( long long bytes );   // negative when a buffer is released
+
+	void reset ();
+	void write ( std::ostream &out, DumpFormat format ) const;
+	bool write ( const std::string &path, DumpFormat format ) const;
+
+	std::string name;
+
+private:
+	struct Timer {
+		Timer() : count(0), totalNs(0), maxNs(0) {}
+		long long count, totalNs, maxNs;
+	};
+
+	std::map< std::pair<std::string,std::string>, Timer > m_timers       ;
+	std::map< std::string, long long >                    m_counters     ;
+	long long                                             m_bufferBytes  ;
+	long long                                             m_peakBuffer   ;
+};
+
+
+// current session of the calling thread, NULL if none
+Session *current();
+
+// makes a session current for the lifetime of this object
+class ScopedSession {
+public:
+	ScopedSession( Session &session );
+	~ScopedSession();
+private:
+	Session *m_previous;
+};
+
+long long nowNs();
+long long fileSize( const std::string &path );   // 0 if the file doesn't exist
+
+// times a scope into the current session
+class ScopedTimer {
+public:
+	ScopedTimer( const char *category, const std::string &channel ) : m_category(category), m_channel(channel), m_start(nowNs()) {}
+	~ScopedTimer() { Session *s = current(); if( s ) s->addTime(m_category, m_channel, nowNs() - m_start); }
+private:
+	const char  *m_category;
+	std::string  m_channel ;
+	long long    m_start   ;
+};
+
+// dump the session if FIELD3D_PROFILE is set to an output directory
+// ( FIELD3D_PROFILE_FORMAT=csv selects CSV instead of JSON )
+void dumpIfRequested( const Session &session );
+
+}
+
+
+#define PROFILE_CONCAT_(a,b) a##b
+#define PROFILE_CONCAT(a,b)  PROFILE_CONCAT_(a,b)
+
+#if defined(FIELD3D_PROFILING)
+	#define PROFILE_SESSION(session) \
+		Field3DProfiler::ScopedSession PROFILE_CONCAT(_profileSession,__LINE__)(session);
+
+	#define PROFILE_SCOPE(category, channel) \
+		Field3DProfiler::ScopedTimer PROFILE_CONCAT(_profileTimer,__LINE__)(category, channel);
+
+	#define PROFILE_START(timer) \
+		long long PROFILE_CONCAT(_profileStart_,timer) = Field3DProfiler::nowNs();
+
+	#define PROFILE_STOP(timer, category, channel) \
+		{ Field3DProfiler::Session *_s = Field3DProfiler::current(); \
+		  if(_s) _s->addTime(category, channel, Field3DProfiler::nowNs() - PROFILE_CONCAT(_profileStart_,timer)); }
+
+	#define PROFILE_COUNT(counter, value) \
+		{ Field3DProfiler::Session *_s = Field3DProfiler::current(); if(_s) _s->addCount(counter, value); }
+
+	#define PROFILE_BUFFER(bytes) \
+		{ Field3DProfiler::Session *_s = Field3DProfiler::current(); if(_s) _s->addBuffer(bytes); }
+#else
+	#define PROFILE_SESSION(session)
+	#define PROFILE_SCOPE(category, channel)
+	#define PROFILE_START(timer)
+	#define PROFILE_STOP(timer, category, channel)
+	#define PROFILE_COUNT(counter, value)
+	#define PROFILE_BUFFER(bytes)
+#endif
+
+
+#endif
@@ -0,0 +1,86 @@
+// Copyright (c) 2011 Prime Focus Film.
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions
+// are met:
+//
+// Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+// Redistributions in binary form must reproduce the above copyright
+// notice, this list of conditions and the following disclaimer in the
+// documentation and/or other materials provided with the
+// distribution. Neither the name of Prime Focus Film nor the
+// names of its contributors may be used to endorse or promote
+// products derived from this software without specific prior written
+// permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+// FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+// COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+// INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+// HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+// OF THE POSSIBILITY OF SUCH DAMAGE.
+
+
+#include "field3D_Resample.h"
+
+#include <pthread.h>
+#include <unistd.h>
+#include <cmath>
+
+using namespace std;
+
+namespace Field3DTools {
+
+size_t channelValues( ChannelLayout layout, const unsigned int res[3] ) {
+	const size_t x = res[0], y = res[1], z = res[2];
+	switch( layout ) {
+		case SCALAR_CHANNEL : return x*y*z;
+		case VECTOR_CHANNEL : return x*y*z*3;
+		default             : return (x+1)*y*z + x*(y+1)*z + x*y*(z+1);
+	}
+}
+
+
+// never destroyed, like the HDF5 mutex
+static IlmThread::ThreadPool *pool     = NULL;
+static pthread_once_t         poolOnce = PTHREAD_ONCE_INIT;
+
+static void createPool() {
+	pool = new IlmThread::ThreadPool( (unsigned) max( 1L, sysconf(_SC_NPROCESSORS_ONLN) ) );
+}
+
+IlmThread::ThreadPool &resamplePool() {
+	pthread_once(&poolOnce, createPool);
+	return *pool;
+}
+
+
+void axisTaps( int srcCells, int dstCells, bool face, AxisTaps &taps ) {
+	const int srcSamples = srcCells + ( face ? 1 : 0 );
+	const int dstSamples = dstCells + ( face ? 1 : 0 );
+	const double scale   = dstCells > 0 ? (double) srcCells / dstCells : 0.0;
+
+	taps.i0.resize(dstSamples);
+	taps.i1.resize(dstSamples);
+	taps.w .resize(dstSamples);
+	for(int t=0; t<dstSamples; t++) {
+		// faces sit on integer positions, voxel centers half way between them
+		double s = face ? t * scale : ( t + 0.5 ) * scale - 0.5;
+		s = max( 0.0, min( s, (double) max(srcSamples - 1, 0) ) );
+
+		taps.i0[t] = (int) floor(s);
+		taps.i1[t] = min( taps.i0[t] + 1, max(srcSamples - 1, 0) );
+		taps.w [t] = (float) ( s - taps.i0[t] );
+	}
+}
+
+}
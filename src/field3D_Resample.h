@@ -0,0 +1,192 @@
+// Copyright (c) 2011 Prime Focus Film.
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions
+// are met:
+//
+// Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+// Redistributions in binary form must reproduce the above copyright
+// notice, this list of conditions and the following disclaimer in the
+// documentation and/or other materials provided with the
+// distribution. Neither the name of Prime Focus Film nor the
+// names of its contributors may be used to endorse or promote
+// products derived from this software without specific prior written
+// permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+// FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+// COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+// INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+// HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+// OF THE POSSIBILITY OF SUCH DAMAGE.
+
+
+#ifndef FIELD3D_RESAMPLE_H
+#define FIELD3D_RESAMPLE_H
+
+#include <vector>
+#include <algorithm>
+
+#include <OpenEXR/IlmThreadPool.h>
+
+// Trilinear resampling of channels cached at another resolution than the one
+// of the fluid reading them ( half-resolution layout caches loaded onto the
+// production fluid, ... ).
+//
+// Scalar and vector values are taken at voxel centers, MAC components at face
+// centers along their own axis, so the container's boundaries match whatever
+// the resolutions. The Z slabs of the destination are resampled in parallel.
+
+namespace Field3DTools {
+
+enum ChannelLayout { SCALAR_CHANNEL , VECTOR_CHANNEL , MAC_CHANNEL };
+
+// number of values of a channel in Maya's layout
+size_t channelValues( ChannelLayout layout, const unsigned int res[3] );
+
+// pool running the slabs, sized on the number of cores
+IlmThread::ThreadPool &resamplePool();
+
+
+// source taps and weight of each destination sample along an axis
+struct AxisTaps {
+	std::vector<int>    i0 ;
+	std::vector<int>    i1 ;
+	std::vector<float>  w  ;
+};
+
+// cells are the voxels of the fluid, faces add one sample along the axis
+void axisTaps( int srcCells, int dstCells, bool face, AxisTaps &taps );
+
+
+template< typename Src_T, typename Dest_T >
+class ResampleSlabTask : public IlmThread::Task {
+public:
+	ResampleSlabTask(
+			IlmThread::TaskGroup *group      ,
+			const Src_T          *src        ,
+			const int             srcRes[3]  ,
+			Dest_T               *dst        ,
+			const int             dstRes[3]  ,
+			int                   components ,
+			const AxisTaps       *taps       ,
+			int                   z0         ,
+			int                   z1         )
+		: IlmThread::Task(group), m_src(src), m_dst(dst), m_components(components), m_taps(taps), m_z0(z0), m_z1(z1)
+	{
+		std::copy(srcRes, srcRes+3, m_srcRes);
+		std::copy(dstRes, dstRes+3, m_dstRes);
+	}
+
+	virtual void execute() {
+		const AxisTaps &tx = m_taps[0], &ty = m_taps[1], &tz = m_taps[2];
+		const size_t    N  = m_components;
+		const size_t    sx = m_srcRes[0], sxy = (size_t) m_srcRes[0] * m_srcRes[1];
+
+		for(int z=m_z0; z<m_z1; z++)
+		for(int y=0; y<m_dstRes[1]; y++) {
+			const float wz = tz.w[z], wy = ty.w[y];
+			const Src_T *r00 = m_src + N * ( ty.i0[y] * sx + tz.i0[z] * sxy );
+			const Src_T *r10 = m_src + N * ( ty.i1[y] * sx + tz.i0[z] * sxy );
+			const Src_T *r01 = m_src + N * ( ty.i0[y] * sx + tz.i1[z] * sxy );
+			const Src_T *r11 = m_src + N * ( ty.i1[y] * sx + tz.i1[z] * sxy );
+			Dest_T *dst = m_dst + N * ( (size_t) y * m_dstRes[0] + (size_t) z * m_dstRes[0] * m_dstRes[1] );
+
+			for(int x=0; x<m_dstRes[0]; x++) {
+				const size_t a = N * tx.i0[x], b = N * tx.i1[x];
+				const float  wx = tx.w[x];
+				for(size_t c=0; c<N; c++) {
+					const float v00 = (float) r00[a+c] + wx * ( (float) r00[b+c] - (float) r00[a+c] );
+					const float v10 = (float) r10[a+c] + wx * ( (float) r10[b+c] - (float) r10[a+c] );
+					const float v01 = (float) r01[a+c] + wx * ( (float) r01[b+c] - (float) r01[a+c] );
+					const float v11 = (float) r11[a+c] + wx * ( (float) r11[b+c] - (float) r11[a+c] );
+					const float v0  = v00 + wy * ( v10 - v00 );
+					const float v1  = v01 + wy * ( v11 - v01 );
+					dst[N*x + c] = (Dest_T) ( v0 + wz * ( v1 - v0 ) );
+				}
+			}
+		}
+	}
+
+private:
+	const Src_T     *m_src        ;
+	int              m_srcRes[3]  ;
+	Dest_T          *m_dst        ;
+	int              m_dstRes[3]  ;
+	int              m_components ;
+	const AxisTaps  *m_taps       ;
+	int              m_z0, m_z1   ;
+};
+
+
+// one grid : a scalar or vector channel, or one MAC component
+template< typename Src_T, typename Dest_T >
+void resampleGrid(
+		const Src_T  *src        ,
+		const int     srcCells[3],
+		Dest_T       *dst        ,
+		const int     dstCells[3],
+		const bool    face[3]    ,
+		int           components )
+{
+	int      srcRes[3], dstRes[3];
+	AxisTaps taps[3];
+	for(int a=0; a<3; a++) {
+		srcRes[a] = srcCells[a] + ( face[a] ? 1 : 0 );
+		dstRes[a] = dstCells[a] + ( face[a] ? 1 : 0 );
+		axisTaps(srcCells[a], dstCells[a], face[a], taps[a]);
+	}
+	if( (size_t) srcRes[0] * srcRes[1] * srcRes[2] == 0 || (size_t) dstRes[0] * dstRes[1] * dstRes[2] == 0 ) return;
+
+	// a few slabs per thread to balance the load, the group waits for them
+	IlmThread::ThreadPool &pool   = resamplePool();
+	const int              slabs  = std::max( 1, std::min( dstRes[2], 4 * std::max(pool.numThreads(), 1) ) );
+	IlmThread::TaskGroup   group;
+	for(int s=0; s<slabs; s++) {
+		const int z0 = (int) ( (long long) dstRes[2] *  s    / slabs );
+		const int z1 = (int) ( (long long) dstRes[2] * (s+1) / slabs );
+		if( z0 < z1 ) pool.addTask( new ResampleSlabTask<Src_T,Dest_T>(&group, src, srcRes, dst, dstRes, components, taps, z0, z1) );
+	}
+}
+
+
+// a whole channel in Maya's layout ( MAC : u, v then w )
+template< typename Src_T, typename Dest_T >
+void resampleChannel(
+		ChannelLayout       layout    ,
+		const Src_T        *src       ,
+		const unsigned int  srcRes[3] ,
+		Dest_T             *dst       ,
+		const unsigned int  dstRes[3] )
+{
+	const int srcCells[3] = { (int) srcRes[0], (int) srcRes[1], (int) srcRes[2] };
+	const int dstCells[3] = { (int) dstRes[0], (int) dstRes[1], (int) dstRes[2] };
+
+	if( layout != MAC_CHANNEL ) {
+		const bool cells[3] = { false, false, false };
+		resampleGrid(src, srcCells, dst, dstCells, cells, layout == VECTOR_CHANNEL ? 3 : 1);
+		return;
+	}
+
+	for(int a=0; a<3; a++) {
+		const bool face[3] = { a == 0, a == 1, a == 2 };
+		resampleGrid(src, srcCells, dst, dstCells, face, 1);
+
+		// next component
+		src += ( srcRes[0] + face[0] ) * (size_t) ( srcRes[1] + face[1] ) * ( srcRes[2] + face[2] );
+		dst += ( dstRes[0] + face[0] ) * (size_t) ( dstRes[1] + face[1] ) * ( dstRes[2] + face[2] );
+	}
+}
+
+}
+
+#endif
@@ -0,0 +1,223 @@
+// Copyright (c) 2011 Prime Focus Film.
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions
+// are met:
+//
+// Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+// Redistributions in binary form must reproduce the above copyright
+// notice, this list of conditions and the following disclaimer in the
+// documentation and/or other materials provided with the
+// distribution. Neither the name of Prime Focus Film nor the
+// names of its contributors may be used to endorse or promote
+// products derived from this software without specific prior written
+// permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+// FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+// COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+// INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+// HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+// OF THE POSSIBILITY OF SUCH DAMAGE.
+
+
+#include "field3D_Staging.h"
+#include "tinyLogger.h"
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/vfs.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <sstream>
+
+using namespace std;
+
+namespace Field3DTools {
+
+bool useStagedWrite() {
+	static int staged = -1;
+	if( staged < 0 ) {
+		const char *env = getenv("FIELD3D_STAGE_WRITES");
+		staged = ( env && atoi(env) > 0 ) ? 1 : 0;
+	}
+	return staged == 1;
+}
+
+static bool isDirectory( const char *path ) {
+	struct stat st;
+	return path && stat(path, &st) == 0 && S_ISDIR(st.st_mode);
+}
+
+string stagingDirectory() {
+	const char *dir = getenv("FIELD3D_STAGE_DIR");
+	if( isDirectory(dir) ) return dir;
+	if( isDirectory("/dev/shm") ) return "/dev/shm";
+	dir = getenv("TMPDIR");
+	if( isDirectory(dir) ) return dir;
+	return "/tmp";
+}
+
+static pthread_mutex_t stagedMutex = PTHREAD_MUTEX_INITIALIZER;
+static unsigned long   stagedCount = 0;
+
+string stagedPath( const string &path ) {
+	pthread_mutex_lock(&stagedMutex);
+	const unsigned long count = ++stagedCount;
+	pthread_mutex_unlock(&stagedMutex);
+
+	stringstream staged;
+	staged << stagingDirectory() << "/" << path.substr( path.rfind('/') + 1 ) << "." << getpid() << "." << count << ".staged";
+	return staged.str();
+}
+
+
+// ------------------------------------------- PUBLISH
+
+static bool readAll( int fd, char *data, size_t size ) {
+	while( size > 0 ) {
+		const ssize_t count = read(fd, data, size);
+		if( count < 0 && errno == EINTR ) continue;
+		if( count <= 0 ) return false;
+		data += count;
+		size -= (size_t) count;
+	}
+	return true;
+}
+
+static bool writeAll( int fd, const char *data, size_t size ) {
+	while( size > 0 ) {
+		const ssize_t written = write(fd, data, size);
+		if( written < 0 && errno == EINTR ) continue;
+		if( written <= 0 ) return false;
+		data += written;
+		size -= (size_t) written;
+	}
+	return true;
+}
+
+bool publishStagedFile( const string &staged, const string &path ) {
+
+	const int in = open(staged.c_str(), O_RDONLY);
+	if( in < 0 ) {
+		ERROR( "Publishing of " + path + " failed : staged file " + staged + " not found" );
+		return false;
+	}
+	struct stat st;
+	const size_t size = fstat(in, &st) == 0 ? (size_t) st.st_size : 0;
+
+	// written next to the destination, so the rename stays on the same filer
+	stringstream tmp;
+	tmp << path << "." << getpid() << ".tmp";
+	const string tmpPath = tmp.str();
+
+	const int out = open(tmpPath.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0666);
+	bool ok = out >= 0;
+
+	// the staged file is mapped, not copied : one write of the whole file
+	if( ok && size > 0 ) {
+		void *data = mmap(NULL, size, PROT_READ, MAP_PRIVATE, in, 0);
+		ok = data != MAP_FAILED && writeAll(out, static_cast<const char *>(data), size);
+		if( data != MAP_FAILED ) munmap(data, size);
+	}
+	close(in);
+
+	if( out >= 0 ) {
+		ok = fsync(out) == 0 && ok;
+		ok = close(out) == 0 && ok;
+	}
+	ok = ok && rename(tmpPath.c_str(), path.c_str()) == 0;
+
+	if( !ok ) {
+		const string reason = strerror(errno);
+		remove(tmpPath.c_str());
+		ERROR( "Publishing of " + path + " failed : " + reason + ", the frame is kept in " + staged );
+		return false;
+	}
+
+	remove(staged.c_str());
+	return true;
+}
+
+
+
+// ------------------------------------------- STAGED READS
+
+static long long stageReadThreshold() {
+	static long long threshold = -1;
+	if( threshold < 0 ) {
+		const char *mb = getenv("FIELD3D_STAGE_READ_MB");
+		threshold = mb ? atoll(mb) << 20 : STAGE_READ_THRESHOLD;
+	}
+	return threshold;
+}
+
+// local files are already read from the page cache
+static bool onNetworkStorage( const string &path ) {
+	struct statfs fs;
+	if( statfs(path.c_str(), &fs) != 0 ) return false;
+	switch( (unsigned long) fs.f_type ) {
+		case 0x6969UL     :   // nfs
+		case 0x517BUL     :   // smb
+		case 0xFF534D42UL :   // cifs
+		case 0xFE534D42UL :   // smb2
+		case 0x65735546UL :   // fuse ( sshfs, ... )
+		case 0x00C36400UL :   // ceph
+		case 0x0BD00BD0UL :   // lustre
+		case 0x47504653UL :   // gpfs
+		case 0x5346414FUL :   // afs
+			return true;
+		default :
+			return false;
+	}
+}
+
+bool useStagedRead( const string &path, long long size ) {
+	return size > 0 && size <= stageReadThreshold() && onNetworkStorage(path);
+}
+
+bool stageFile( const string &path, string &staged ) {
+
+	const int in = open(path.c_str(), O_RDONLY);
+	if( in < 0 ) return false;
+	struct stat st;
+	const size_t size = fstat(in, &st) == 0 ? (size_t) st.st_size : 0;
+	posix_fadvise(in, 0, 0, POSIX_FADV_SEQUENTIAL);
+
+	const string copy = stagedPath(path);
+	const int    out  = open(copy.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0600);
+	bool ok = out >= 0 && size > 0 && ftruncate(out, (off_t) size) == 0;
+
+	// the file is read straight into the staged copy, in as few reads as
+	// the filer allows
+	if( ok ) {
+		void *data = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, out, 0);
+		ok = data != MAP_FAILED && readAll(in, static_cast<char *>(data), size);
+		if( data != MAP_FAILED ) munmap(data, size);
+	}
+	close(in);
+	if( out >= 0 ) close(out);
+
+	if( !ok ) {
+		remove(copy.c_str());
+		return false;
+	}
+	staged = copy;
+	return true;
+}
+
+}
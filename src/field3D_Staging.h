@@ -0,0 +1,81 @@
+// Copyright (c) 2011 Prime Focus Film.
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions
+// are met:
+//
+// Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+// Redistributions in binary form must reproduce the above copyright
+// notice, this list of conditions and the following disclaimer in the
+// documentation and/or other materials provided with the
+// distribution. Neither the name of Prime Focus Film nor the
+// names of its contributors may be used to endorse or promote
+// products derived from this software without specific prior written
+// permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+// FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+// COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+// INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+// HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+// OF THE POSSIBILITY OF SUCH DAMAGE.
+
+
+#ifndef FIELD3D_STAGING_H
+#define FIELD3D_STAGING_H
+
+#include <string>
+
+// Field3D writes its HDF5 files with many small writes ( object headers,
+// chunk indexes, chunks ), each one a round trip on network storage. Staged
+// files are written to a local in-memory directory instead ( tmpfs ), then
+// copied to their destination in one sequential write and renamed into
+// place : readers never see a half-written file.
+// Field3D creates the HDF5 files itself, with the default file access
+// properties, so HDF5's in-memory core driver can't be selected : tmpfs
+// plays its part.
+
+namespace Field3DTools {
+
+// FIELD3D_STAGE_WRITES=1 enables it
+bool        useStagedWrite   ();
+
+// FIELD3D_STAGE_DIR, /dev/shm when available, $TMPDIR or /tmp otherwise
+std::string stagingDirectory ();
+
+// a path of the staging directory no other writer uses
+std::string stagedPath       ( const std::string &path );
+
+// one sequential write of the staged file next to path, renamed to path,
+// the staged file is then removed
+bool        publishStagedFile( const std::string &staged, const std::string &path );
+
+// Reads are staged the other way round : small files on network storage are
+// copied to the staging directory with large sequential reads, instead of
+// HDF5 reading the superblock, object headers, chunk indexes and chunks one
+// by one. Files bigger than this ( FIELD3D_STAGE_READ_MB, 0 disables it )
+// are read in place.
+// An HDF5 file image ( H5LTopen_file_image ) would spare the copy, but
+// Field3DInputFile::open() takes a path and opens it with the default file
+// access properties, the same way it creates files : the image can't be
+// handed to it, so the staged copy goes through tmpfs as well.
+const long long STAGE_READ_THRESHOLD = 256 << 20 ;
+
+bool        useStagedRead    ( const std::string &path, long long size );
+
+// the caller removes the staged copy, which may be done as soon as HDF5
+// opened it
+bool        stageFile        ( const std::string &path, std::string &staged );
+
+}
+
+#endif
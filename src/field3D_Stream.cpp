@@ -0,0 +1,237 @@
+// Copyright (c) 2011 Prime Focus Film.
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions
+// are met:
+//
+// Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+// Redistributions in binary form must reproduce the above copyright
+// notice, this list of conditions and the following disclaimer in the
+// documentation and/or other materials provided with the
+// distribution. Neither the name of Prime Focus Film nor the
+// names of its contributors may be used to endorse or promote
+// products derived from this software without specific prior written
+// permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+// FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+// COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+// INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+// HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+// OF THE POSSIBILITY OF SUCH DAMAGE.
+
+
+#include "field3D_Stream.h"
+
+#include <cstdlib>
+#include <cstring>
+
+using namespace std;
+
+namespace Field3DTools {
+
+static long long streamThreshold() {
+	static long long threshold = -1;
+	if( threshold < 0 ) {
+		const char *mb = getenv("FIELD3D_STREAM_WRITE_MB");
+		threshold = mb ? (long long) ( atof(mb) * (1 << 20) ) : (long long) STREAM_WRITE_THRESHOLD;
+	}
+	return threshold;
+}
+
+bool useStreamedWrite( size_t bytes ) {
+	return streamThreshold() > 0 && (long long) bytes > streamThreshold();
+}
+
+bool useZeroCopyWrite() {
+	return streamThreshold() > 0;
+}
+
+
+// ------------------------------------------- HDF5 HELPERS
+
+static herr_t collectLinkName( hid_t, const char *name, const H5L_info_t *, void *names ) {
+	static_cast< vector<string>* >(names)->push_back(name);
+	return 0;
+}
+
+// Field3D names the partition groups "partition" or "partition.N"
+static int partitionIndex( const string &group, const string &partition ) {
+	if( group == partition ) return 0;
+	if( group.compare(0, partition.size()+1, partition + ".") != 0 ) return -1;
+	const string suffix = group.substr(partition.size()+1);
+	if( suffix.empty() || suffix.find_first_not_of("0123456789") != string::npos ) return -1;
+	return atoi(suffix.c_str());
+}
+
+static bool readBox( hid_t layer, const char *name, int box[6] ) {
+	if( H5Aexists(layer, name) <= 0 ) return false;
+	hid_t attr = H5Aopen(layer, name, H5P_DEFAULT);
+	if( attr < 0 ) return false;
+	bool ok = H5Aread(attr, H5T_NATIVE_INT, box) >= 0;
+	H5Aclose(attr);
+	return ok;
+}
+
+static bool writeBox( hid_t layer, const char *name, const int box[6] ) {
+	hid_t attr = H5Aopen(layer, name, H5P_DEFAULT);
+	if( attr < 0 ) return false;
+	bool ok = H5Awrite(attr, H5T_NATIVE_INT, box) >= 0;
+	H5Aclose(attr);
+	return ok;
+}
+
+// the placeholder is a 2x2x2 layer starting at the origin
+static bool isPlaceholder( hid_t layer, int components ) {
+	int window[6];
+	if( !readBox(layer, "data_window", window) ) return false;
+	const int expected[6] = {0,0,0,1,1,1};
+	if( memcmp(window, expected, sizeof(expected)) != 0 ) return false;
+
+	if( H5Lexists(layer, "data", H5P_DEFAULT) <= 0 ) return false;
+	hid_t data  = H5Dopen2(layer, "data", H5P_DEFAULT);
+	if( data < 0 ) return false;
+	hid_t space = H5Dget_space(data);
+	hssize_t size = H5Sget_simple_extent_npoints(space);
+	H5Sclose(space);
+	H5Dclose(data);
+	return size == 8 * components;
+}
+
+
+// ------------------------------------------- STREAM
+
+DenseLayerStream::DenseLayerStream() : m_file(-1), m_dataset(-1), m_type(-1), m_size(0) {
+}
+
+DenseLayerStream::~DenseLayerStream() {
+	close();
+}
+
+
+bool DenseLayerStream::open(
+		const string       &fileName   ,
+		const string       &partition  ,
+		const string       &layer      ,
+		const unsigned int  res[3]     ,
+		int                 components )
+{
+	close();
+	bool ok;
+	{
+		HDF5Lock lock;
+		ok = openLayer(fileName, partition, layer, res, components);
+	}
+	if( !ok ) close();
+	return ok;
+}
+
+
+bool DenseLayerStream::openLayer(
+		const string       &fileName   ,
+		const string       &partition  ,
+		const string       &layer      ,
+		const unsigned int  res[3]     ,
+		int                 components )
+{
+	// the file is still opened by Field3D : HDF5 shares it
+	m_file = H5Fopen(fileName.c_str(), H5F_ACC_RDWR, H5P_DEFAULT);
+	if( m_file < 0 ) return false;
+
+	// latest placeholder of the layer in the partition
+	vector<string> groups;
+	hsize_t index = 0;
+	H5Literate(m_file, H5_INDEX_NAME, H5_ITER_NATIVE, &index, collectLinkName, &groups);
+
+	hid_t group = -1;
+	int   best  = -1;
+	for(vector<string>::iterator it=groups.begin(); it!=groups.end(); ++it) {
+		int i = partitionIndex(*it, partition);
+		if( i <= best ) continue;
+
+		const string path = *it + "/" + layer;
+		if( H5Lexists(m_file, it->c_str(), H5P_DEFAULT) <= 0 || H5Lexists(m_file, path.c_str(), H5P_DEFAULT) <= 0 ) continue;
+
+		hid_t candidate = H5Gopen2(m_file, path.c_str(), H5P_DEFAULT);
+		if( candidate < 0 ) continue;
+		if( isPlaceholder(candidate, components) ) {
+			if( group >= 0 ) H5Gclose(group);
+			group = candidate;
+			best  = i;
+		}
+		else {
+			H5Gclose(candidate);
+		}
+	}
+	if( group < 0 ) return false;
+
+	// same storage as Field3D : type and filters of the placeholder,
+	// chunks of min(64k, size/2) values
+	hid_t placeholder = H5Dopen2(group, "data", H5P_DEFAULT);
+	hid_t dcpl        = H5Dget_create_plist(placeholder);
+	m_type            = H5Dget_type(placeholder);
+	H5Dclose(placeholder);
+	H5Ldelete(group, "data", H5P_DEFAULT);
+
+	m_size = (size_t) res[0] * res[1] * res[2] * components;
+	hsize_t dims [1] = { m_size };
+	hsize_t chunk[1] = { std::max( (hsize_t) 1, std::min( (hsize_t) 65536, dims[0] / 2 ) ) };
+	H5Pset_chunk(dcpl, 1, chunk);
+
+	hid_t space = H5Screate_simple(1, dims, NULL);
+	m_dataset   = H5Dcreate2(group, "data", m_type, space, H5P_DEFAULT, dcpl, H5P_DEFAULT);
+	H5Sclose(space);
+	H5Pclose(dcpl);
+
+	// extents and data window of the whole field
+	const int box[6] = { 0, 0, 0, (int) res[0]-1, (int) res[1]-1, (int) res[2]-1 };
+	bool ok = m_dataset >= 0 && writeBox(group, "extents", box) && writeBox(group, "data_window", box);
+	H5Gclose(group);
+	return ok;
+}
+
+
+bool DenseLayerStream::write( size_t offset, size_t count, const void *buffer ) {
+	if( m_dataset < 0 || offset + count > m_size ) return false;
+	if( count == 0 ) return true;
+
+	HDF5Lock lock;
+
+	hsize_t start[1] = { offset };
+	hsize_t size [1] = { count  };
+
+	hid_t fileSpace = H5Dget_space(m_dataset);
+	H5Sselect_hyperslab(fileSpace, H5S_SELECT_SET, start, NULL, size, NULL);
+	hid_t memSpace  = H5Screate_simple(1, size, NULL);
+
+	// the buffer holds values of the type of the field, which is
+	// the type Field3D gave to the dataset ( half as raw shorts )
+	bool ok = H5Dwrite(m_dataset, m_type, memSpace, fileSpace, H5P_DEFAULT, buffer) >= 0;
+
+	H5Sclose(memSpace);
+	H5Sclose(fileSpace);
+	return ok;
+}
+
+
+void DenseLayerStream::close() {
+	if( m_file < 0 && m_dataset < 0 && m_type < 0 ) return;
+
+	HDF5Lock lock;
+	if( m_dataset >= 0 ) H5Dclose(m_dataset);
+	if( m_type    >= 0 ) H5Tclose(m_type);
+	if( m_file    >= 0 ) H5Fclose(m_file);
+	m_dataset = m_type = m_file = -1;
+	m_size    = 0;
+}
+
+}
@@ -0,0 +1,231 @@
+// Copyright (c) 2011 Prime Focus Film.
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions
+// are met:
+//
+// Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+// Redistributions in binary form must reproduce the above copyright
+// notice, this list of conditions and the following disclaimer in the
+// documentation and/or other materials provided with the
+// distribution. Neither the name of Prime Focus Film nor the
+// names of its contributors may be used to endorse or promote
+// products derived from this software without specific prior written
+// permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+// FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+// COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+// INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+// HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+// OF THE POSSIBILITY OF SUCH DAMAGE.
+
+
+#ifndef FIELD3D_STREAM_H
+#define FIELD3D_STREAM_H
+
+#include <string>
+#include <vector>
+#include <algorithm>
+
+#include <hdf5.h>
+
+#include "field3D_Tools.h"
+
+
+// Dense layers are written by Field3D from a complete DenseField, i.e. a
+// full converted copy of Maya's channel. For big grids this copy costs as
+// much memory as the simulation itself, so they are streamed instead :
+//  _ Field3D writes a 2x2x2 placeholder of the layer, which creates the
+//    partition, the mapping, the metadata and the layer's attributes
+//  _ the placeholder's "data" dataset and its extents / data window are
+//    then replaced straight through HDF5, batch of Z slices by batch.
+// Files stay identical to the ones written by Field3D, with two limits :
+//  _ the layer is written through a second HDF5 handle on the file Field3D
+//    still has opened, which HDF5 shares with Field3D's own handle
+//  _ Field3D creates the placeholder with a fixed size, so it can't be
+//    extended : it's unlinked and a new dataset is created, and the few
+//    hundred bytes of the placeholder stay unused in the file ( h5repack
+//    gets them back ). The ctest writes streamed channels of every format
+//    and reads them back through Field3D.
+// Dense float scalar channels have the exact layout of Maya's arrays, so
+// they're always written this way, straight from Maya's buffer ( zero copy ),
+// whatever their size.
+
+namespace Field3DTools {
+
+// dense channels bigger than this ( in bytes, once converted ) are streamed,
+// FIELD3D_STREAM_WRITE_MB overrides it ( fractions of MB allowed ), 0 disables streaming
+const size_t STREAM_WRITE_THRESHOLD = 64 << 20 ;
+
+// scratch memory used to convert a batch of Z slices
+const size_t STREAM_SLAB_BYTES      = 16 << 20 ;
+
+bool useStreamedWrite( size_t bytes );
+
+// dense float scalar channels are written from Maya's buffer unless
+// streaming is disabled
+bool useZeroCopyWrite();
+
+template<typename T> struct IsFloat        { enum { value = 0 }; };
+template<>           struct IsFloat<float> { enum { value = 1 }; };
+
+
+class DenseLayerStream {
+public:
+	DenseLayerStream();
+	~DenseLayerStream();
+
+	// finds the placeholder layer of the partition and resizes it to res
+	bool open  (
+			const std::string  &fileName   ,
+			const std::string  &partition  ,
+			const std::string  &layer      ,
+			const unsigned int  res[3]     ,
+			int                 components );
+
+	// writes count values at offset ( both in values, not voxels ),
+	// the buffer must hold values of the type of the field
+	bool write ( size_t offset, size_t count, const void *buffer );
+
+	void close ();
+
+private:
+	bool openLayer ( const std::string &, const std::string &, const std::string &, const unsigned int [3], int );
+
+	DenseLayerStream            ( const DenseLayerStream & );
+	DenseLayerStream &operator= ( const DenseLayerStream & );
+
+	hid_t  m_file    ;
+	hid_t  m_dataset ;
+	hid_t  m_type    ;
+	size_t m_size    ;
+};
+
+
+// converts batches of Z slices into ExportType, interleaving the components
+// of vector channels ( b and c are NULL for scalar channels )
+template< typename ExportType >
+bool streamDenseSlabs(
+		DenseLayerStream  &stream ,
+		const unsigned int res[3] ,
+		const float       *a      ,
+		const float       *b      ,
+		const float       *c      ,
+		const char        *fieldName
+)
+{
+	(void) fieldName;   // only used by the profiler
+
+	const size_t components = b ? 3 : 1;
+	const size_t slice      = (size_t) res[0] * res[1];
+	const size_t sliceBytes = slice * components * sizeof(ExportType);
+
+	size_t depth = std::max( (size_t) 1, STREAM_SLAB_BYTES / std::max(sliceBytes, (size_t) 1) );
+	depth        = std::min( depth, (size_t) res[2] );
+
+	// reused from a channel to the next when a field pool is current
+	std::vector<ExportType> fallback;
+	const size_t            scratchSize = depth * slice * components;
+	ExportType             *scratch     = stagingBuffer(fallback, scratchSize);
+	if( scratch == NULL ) return false;
+	PROFILE_BUFFER( (long long) scratchSize * sizeof(ExportType) );
+
+	for(size_t z=0; z<res[2]; z+=depth) {
+
+		const size_t first = z * slice;
+		const size_t count = std::min(depth, res[2]-z) * slice;
+		{
+			PROFILE_SCOPE("convert", fieldName);
+			if( components == 1 ) {
+				for(size_t i=0; i<count; i++) scratch[i] = (ExportType) a[first+i];
+			}
+			else {
+				for(size_t i=0; i<count; i++) {
+					scratch[3*i+0] = (ExportType) a[first+i];
+					scratch[3*i+1] = (ExportType) b[first+i];
+					scratch[3*i+2] = (ExportType) c[first+i];
+				}
+			}
+		}
+
+		PROFILE_SCOPE("hdf5_write", fieldName);
+		if( !stream.write(first*components, count*components, scratch) ) {
+			PROFILE_BUFFER(-(long long) scratchSize * sizeof(ExportType) );
+			return false;
+		}
+	}
+
+	PROFILE_BUFFER(-(long long) scratchSize * sizeof(ExportType) );
+	return true;
+}
+
+
+// same as writeDenseScalarField / writeDenseVectorField with bounded memory,
+// b and c are NULL for scalar channels
+template< typename ExportType >
+bool writeDenseFieldStreamed(
+		Field3D::Field3DOutputFile *out     ,
+		const std::string  &fileName        ,
+		const char *        fluidName       ,
+		const char *        fieldName       ,
+		unsigned int        res[3]          ,
+		double              transform[4][4] ,
+		const float *       a               ,
+		const float *       b               ,
+		const float *       c
+)
+{
+	if( a == NULL || ( b == NULL ) != ( c == NULL ) ) {
+		ERROR("Array is NULL");
+		return false;
+	}
+
+	// placeholder written by Field3D
+	unsigned int placeholderRes[3] = {2,2,2};
+	float        placeholder[8]    = {0,0,0,0,0,0,0,0};
+	bool written = b ?
+			writeDenseVectorField<ExportType>(out, fluidName, fieldName, placeholderRes, transform, placeholder, placeholder, placeholder) :
+			writeDenseScalarField<ExportType>(out, fluidName, fieldName, placeholderRes, transform, placeholder) ;
+	if( !written ) return false;
+
+	// actual data
+	DenseLayerStream stream;
+	if( !stream.open(fileName, fluidName, fieldName, res, b ? 3 : 1) ) {
+		ERROR( std::string("Problem while streaming dense field ") + fieldName + " : the layer written by Field3D was not found");
+		return false;
+	}
+	PROFILE_COUNT("streamed_layers", 1);
+
+	bool streamed;
+	if( b == NULL && IsFloat<ExportType>::value ) {
+		// same layout, same type : Maya's buffer goes straight to HDF5
+		PROFILE_SCOPE("hdf5_write", fieldName);
+		PROFILE_COUNT("zero_copy_layers", 1);
+		streamed = stream.write(0, (size_t) res[0] * res[1] * res[2], a);
+	}
+	else {
+		streamed = streamDenseSlabs<ExportType>(stream, res, a, b, c, fieldName);
+	}
+
+	if( !streamed ) {
+		ERROR( std::string("Problem while streaming dense field ") + fieldName + " : Unknown Reason ");
+		return false;
+	}
+	stream.close();
+
+	return true;
+}
+
+}
+
+#endif
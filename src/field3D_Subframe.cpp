@@ -0,0 +1,109 @@
+// Copyright (c) 2011 Prime Focus Film.
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions
+// are met:
+//
+// Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+// Redistributions in binary form must reproduce the above copyright
+// notice, this list of conditions and the following disclaimer in the
+// documentation and/or other materials provided with the
+// distribution. Neither the name of Prime Focus Film nor the
+// names of its contributors may be used to endorse or promote
+// products derived from this software without specific prior written
+// permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+// FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+// COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+// INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+// HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+// OF THE POSSIBILITY OF SUCH DAMAGE.
+
+
+#include "field3D_Subframe.h"
+
+#include <sys/stat.h>
+#include <cstdlib>
+#include <cctype>
+#include <sstream>
+
+using namespace std;
+
+namespace Field3DTools {
+
+SubframeMode subframeMode() {
+	static int mode = -1;
+	if( mode < 0 ) {
+		const char *env = getenv("FIELD3D_SUBFRAME");
+		const string value = env ? env : "";
+		if( value == "linear" )      mode = SUBFRAME_LINEAR;
+		else if( value == "advect" ) mode = SUBFRAME_ADVECT;
+		else                         mode = SUBFRAME_OFF;
+	}
+	return (SubframeMode) mode;
+}
+
+int subframeGap() {
+	static int gap = -1;
+	if( gap < 0 ) {
+		const char *env = getenv("FIELD3D_SUBFRAME_GAP");
+		gap = env ? atoi(env) : 2;
+		if( gap < 1 ) gap = 1;
+	}
+	return gap;
+}
+
+
+// digits with an optional sign at pos, moved past them
+static bool parseInt( const string &text, size_t &pos, int &value ) {
+	size_t end = pos;
+	if( end < text.size() && text[end] == '-' ) end++;
+	const size_t digits = end;
+	while( end < text.size() && isdigit( (unsigned char) text[end] ) ) end++;
+	if( end == digits ) return false;
+	value = atoi( text.substr(pos, end - pos).c_str() );
+	pos   = end;
+	return true;
+}
+
+bool parseFrameName( const string &path, FrameName &name ) {
+	const size_t framePos = path.rfind("Frame");
+	if( framePos == string::npos ) return false;
+
+	size_t pos = framePos + 5;
+	name.tick = 0;
+	if( !parseInt(path, pos, name.frame) ) return false;
+	if( path.compare(pos, 4, "Tick") == 0 ) {
+		pos += 4;
+		if( !parseInt(path, pos, name.tick) ) return false;
+	}
+
+	// nothing but the extension after the time
+	name.extension = path.substr(pos);
+	if( !name.extension.empty() && name.extension[0] != '.' ) return false;
+	name.prefix = path.substr(0, framePos + 5);
+	return true;
+}
+
+string frameFileName( const FrameName &name, int frame ) {
+	stringstream path;
+	path << name.prefix << frame << name.extension;
+	return path.str();
+}
+
+bool fileExists( const string &path ) {
+	struct stat st;
+	return stat(path.c_str(), &st) == 0 && S_ISREG(st.st_mode);
+}
+
+}
@@ -0,0 +1,216 @@
+// Copyright (c) 2011 Prime Focus Film.
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions
+// are met:
+//
+// Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+// Redistributions in binary form must reproduce the above copyright
+// notice, this list of conditions and the following disclaimer in the
+// documentation and/or other materials provided with the
+// distribution. Neither the name of Prime Focus Film nor the
+// names of its contributors may be used to endorse or promote
+// products derived from this software without specific prior written
+// permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+// FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+// COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+// INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+// HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+// OF THE POSSIBILITY OF SUCH DAMAGE.
+
+
+#ifndef FIELD3D_SUBFRAME_H
+#define FIELD3D_SUBFRAME_H
+
+#include <string>
+#include <algorithm>
+
+#include <OpenEXR/IlmThreadPool.h>
+
+#include "field3D_Resample.h"
+
+// Frames missing from a cache, written every second frame or read at
+// sub-frame times, are synthesized from the closest cached frames around
+// them. Channels are blended linearly, or scalar channels are advected along
+// the velocity of the previous frame ( semi-Lagrangian ) before being blended,
+// so that moving features don't fade in and out. Both kernels are run on the
+// resampling pool, Z slabs in parallel.
+
+namespace Field3DTools {
+
+enum SubframeMode { SUBFRAME_OFF , SUBFRAME_LINEAR , SUBFRAME_ADVECT };
+
+// FIELD3D_SUBFRAME : "linear" or "advect", off otherwise
+SubframeMode subframeMode();
+
+// FIELD3D_SUBFRAME_GAP : the most frames between the two frames
+// a missing one is synthesized from ( default : 2 )
+int subframeGap();
+
+// Maya names the files of a cache "<prefix>Frame<frame>[Tick<tick>]<extension>",
+// ticks being 1/6000th of a second past the frame
+struct FrameName {
+	FrameName() : frame(0), tick(0) {}
+	std::string prefix    ;   // up to "Frame"
+	std::string extension ;
+	int         frame     ;
+	int         tick      ;
+};
+
+bool        parseFrameName( const std::string &path, FrameName &name );
+
+// the file of a whole frame of the same cache
+std::string frameFileName ( const FrameName &name, int frame );
+
+bool        fileExists    ( const std::string &path );
+
+
+// ---------------------  Kernels
+
+// a + weight ( b - a ), a plain loop on contiguous values the compiler vectorizes
+template< typename T >
+class BlendTask : public IlmThread::Task {
+public:
+	BlendTask( IlmThread::TaskGroup *group, const T *a, const T *b, T *dst, size_t begin, size_t end, float weight )
+		: IlmThread::Task(group), m_a(a), m_b(b), m_dst(dst), m_begin(begin), m_end(end), m_weight(weight) {}
+
+	virtual void execute() {
+		const T *a = m_a, *b = m_b;
+		T       *dst    = m_dst;
+		const T  weight = (T) m_weight;
+		for(size_t i=m_begin; i<m_end; i++) {
+			dst[i] = a[i] + weight * ( b[i] - a[i] );
+		}
+	}
+
+private:
+	const T *m_a, *m_b ;
+	T       *m_dst     ;
+	size_t   m_begin, m_end ;
+	float    m_weight  ;
+};
+
+// any layout, dst may be a
+template< typename T >
+void blendChannel( const T *a, const T *b, T *dst, size_t count, float weight )
+{
+	// chunks of at least 64k values, a few per thread
+	IlmThread::ThreadPool &pool   = resamplePool();
+	const size_t           chunks = std::max( (size_t) 1, std::min( count / 65536, (size_t) ( 4 * std::max(pool.numThreads(), 1) ) ) );
+	IlmThread::TaskGroup   group;
+	for(size_t c=0; c<chunks; c++) {
+		const size_t begin = count *  c    / chunks;
+		const size_t end   = count * (c+1) / chunks;
+		if( begin < end ) pool.addTask( new BlendTask<T>(&group, a, b, dst, begin, end, weight) );
+	}
+}
+
+
+// trilinear sample of a scalar grid at a position in voxels,
+// voxel centers on integers, clamped to the grid
+template< typename T >
+inline float sampleVoxels( const T *grid, const int res[3], float x, float y, float z )
+{
+	x = std::max( 0.0f, std::min( x, (float) ( res[0] - 1 ) ) );
+	y = std::max( 0.0f, std::min( y, (float) ( res[1] - 1 ) ) );
+	z = std::max( 0.0f, std::min( z, (float) ( res[2] - 1 ) ) );
+	const int   i0 = (int) x, j0 = (int) y, k0 = (int) z;
+	const int   i1 = std::min(i0+1, res[0]-1), j1 = std::min(j0+1, res[1]-1), k1 = std::min(k0+1, res[2]-1);
+	const float wx = x - i0, wy = y - j0, wz = z - k0;
+
+	const size_t sx = res[0], sxy = (size_t) res[0] * res[1];
+	const float v00 = (float) grid[i0 + j0*sx + k0*sxy] + wx * ( (float) grid[i1 + j0*sx + k0*sxy] - (float) grid[i0 + j0*sx + k0*sxy] );
+	const float v10 = (float) grid[i0 + j1*sx + k0*sxy] + wx * ( (float) grid[i1 + j1*sx + k0*sxy] - (float) grid[i0 + j1*sx + k0*sxy] );
+	const float v01 = (float) grid[i0 + j0*sx + k1*sxy] + wx * ( (float) grid[i1 + j0*sx + k1*sxy] - (float) grid[i0 + j0*sx + k1*sxy] );
+	const float v11 = (float) grid[i0 + j1*sx + k1*sxy] + wx * ( (float) grid[i1 + j1*sx + k1*sxy] - (float) grid[i0 + j1*sx + k1*sxy] );
+	const float v0  = v00 + wy * ( v10 - v00 );
+	const float v1  = v01 + wy * ( v11 - v01 );
+	return v0 + wz * ( v1 - v0 );
+}
+
+// each voxel follows the velocity at its center : back to the previous
+// frame, forward to the next one, the two samples being blended
+template< typename T >
+class AdvectSlabTask : public IlmThread::Task {
+public:
+	AdvectSlabTask(
+			IlmThread::TaskGroup *group     ,
+			const T              *a         ,
+			const T              *b         ,
+			T                    *dst       ,
+			const int             res[3]    ,
+			const T              *velocity  ,
+			const float           scale[3]  ,
+			float                 weight    ,
+			int                   z0        ,
+			int                   z1        )
+		: IlmThread::Task(group), m_a(a), m_b(b), m_dst(dst), m_velocity(velocity), m_weight(weight), m_z0(z0), m_z1(z1)
+	{
+		std::copy(res, res+3, m_res);
+		std::copy(scale, scale+3, m_scale);
+	}
+
+	virtual void execute() {
+		const size_t nx = m_res[0], ny = m_res[1], nz = m_res[2];
+		const T     *u  = m_velocity;
+		const T     *v  = u + (nx+1)*ny*nz;
+		const T     *w  = v + nx*(ny+1)*nz;
+
+		for(int k=m_z0; k<m_z1; k++)
+		for(int j=0; j<(int) ny; j++)
+		for(int i=0; i<(int) nx; i++) {
+			// in voxels, across the whole gap between the frames
+			const float dx = 0.5f * ( (float) u[i + (nx+1)*( j + ny*k )] + (float) u[i+1 + (nx+1)*( j + ny*k )] ) * m_scale[0];
+			const float dy = 0.5f * ( (float) v[i + nx*( j + (ny+1)*k )] + (float) v[i + nx*( j+1 + (ny+1)*k )] ) * m_scale[1];
+			const float dz = 0.5f * ( (float) w[i + nx*( j + ny*k )]     + (float) w[i + nx*( j + ny*(k+1) )]   ) * m_scale[2];
+
+			const float before = 1.0f - m_weight;
+			const float a = sampleVoxels(m_a, m_res, i - m_weight*dx, j - m_weight*dy, k - m_weight*dz);
+			const float b = sampleVoxels(m_b, m_res, i + before*dx  , j + before*dy  , k + before*dz  );
+			m_dst[i + nx*( j + ny*k )] = (T) ( a + m_weight * ( b - a ) );
+		}
+	}
+
+private:
+	const T *m_a, *m_b  ;
+	T       *m_dst      ;
+	int      m_res[3]   ;
+	const T *m_velocity ;
+	float    m_scale[3] ;
+	float    m_weight   ;
+	int      m_z0, m_z1 ;
+};
+
+// a scalar channel between two frames, velocity being the MAC channel of the
+// previous frame ( Maya's layout ) and scale turning it into voxels across
+// the gap. dst can't be a or b.
+template< typename T >
+void advectChannel( const T *a, const T *b, T *dst, const unsigned int res[3], const T *velocity, const float scale[3], float weight )
+{
+	const int cells[3] = { (int) res[0], (int) res[1], (int) res[2] };
+	if( (size_t) cells[0] * cells[1] * cells[2] == 0 ) return;
+
+	IlmThread::ThreadPool &pool  = resamplePool();
+	const int              slabs = std::max( 1, std::min( cells[2], 4 * std::max(pool.numThreads(), 1) ) );
+	IlmThread::TaskGroup   group;
+	for(int s=0; s<slabs; s++) {
+		const int z0 = (int) ( (long long) cells[2] *  s    / slabs );
+		const int z1 = (int) ( (long long) cells[2] * (s+1) / slabs );
+		if( z0 < z1 ) pool.addTask( new AdvectSlabTask<T>(&group, a, b, dst, cells, velocity, scale, weight, z0, z1) );
+	}
+}
+
+}
+
+#endif
@@ -32,20 +32,70 @@
 
 #include "field3D_Tools.h"
 
+#include <OpenEXR/IlmThreadMutex.h>
+
+#include <pthread.h>
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <iterator>
+#include <map>
+#include <sstream>
 
 using namespace Field3D ;
 using namespace std     ;
 
 namespace Field3DTools {
 
-void getFieldNames( Field3DInputFile *file, vector< string > &names) {
+// never destroyed : files may still be closed by static destructors
+static IlmThread::Mutex &hdf5Mutex() {
+	static IlmThread::Mutex *mutex = new IlmThread::Mutex;
+	return *mutex;
+}
+
+HDF5Lock::HDF5Lock() {
+#if !defined(H5_HAVE_THREADSAFE)
+	hdf5Mutex().lock();
+#endif
+}
+
+HDF5Lock::~HDF5Lock() {
+#if !defined(H5_HAVE_THREADSAFE)
+	hdf5Mutex().unlock();
+#endif
+}
 
-	// get all partition names ( should be only one present,
-	// since maya fluids are stored individualy) but we parse
-	// everyone here for the sake of genericity
+
+void getPartitionNames( Field3DInputFile *file, vector< string > &names) {
+	names.clear();
+	file->getPartitionNames(names);
+}
+
+
+// axis of a face layer of a staggered channel, whose other face layers
+// are in the list too, -1 for any other layer
+static int staggeredComponent( const string &layerName, const vector< string > &layerNames, string &channelName ) {
+	for(int axis=0; axis<3; axis++) {
+		const string suffix = staggeredLayerName("", axis);
+		if( layerName.size() <= suffix.size() || layerName.compare(layerName.size() - suffix.size(), suffix.size(), suffix) != 0 ) continue;
+		channelName = layerName.substr(0, layerName.size() - suffix.size());
+		for(int other=0; other<3; other++) {
+			if( find(layerNames.begin(), layerNames.end(), staggeredLayerName(channelName, other)) == layerNames.end() ) return -1;
+		}
+		return axis;
+	}
+	return -1;
+}
+
+
+void getFieldNames( Field3DInputFile *file, vector< string > &names, const string &partition) {
+
+	// get all partition names ( one per fluid ) unless
+	// a specific partition is requested
 	names.clear();
 	vector<string> partitionNames;
-	file->getPartitionNames(partitionNames);
+	if( partition.empty() ) file->getPartitionNames(partitionNames);
+	else                    partitionNames.push_back(partition);
 
 	// loop through partition and harvest attributes names
 	for(vector<string>::iterator it = partitionNames.begin() ; it!= partitionNames.end() ; ++it) {
@@ -56,8 +106,14 @@ void getFieldNames( Field3DInputFile *file, vector< string > &names) {
 		vector<string> vectorNames;
 		file->getVectorLayerNames(vectorNames,*it);
 
-		// add it to the main names
-		std::copy(scalarNames.begin(), scalarNames.end(), std::back_inserter(names));
+		// add it to the main names, the face layers of
+		// a staggered channel standing for the channel
+		for(vector<string>::iterator its = scalarNames.begin(); its != scalarNames.end(); ++its) {
+			string channelName;
+			const int axis = staggeredComponent(*its, scalarNames, channelName);
+			if( axis < 0 )       names.push_back(*its);
+			else if( axis == 0 ) names.push_back(channelName);
+		}
 		std::copy(vectorNames.begin(), vectorNames.end(), std::back_inserter(names));
 
 	}
@@ -65,157 +121,382 @@ void getFieldNames( Field3DInputFile *file, vector< string > &names) {
 }
 
 
+string findPartition( const vector< string > &partitions , const string &fluidName ) {
+	if( find(partitions.begin(), partitions.end(), fluidName) != partitions.end() ) return fluidName;
+	if( partitions.size() == 1 ) return partitions[0];
+	return string();
+}
+
+
+string offsetMetadataName( const string &fluidName ) {
+	return "Offset_" + fluidName;
+}
+
+
 
 template <typename T>
-bool getHighestResolution(Field3D::Field3DInputFile *inFile,unsigned int (&resMax)[3])
+bool getHighestResolution(Field3D::Field3DInputFile *inFile,unsigned int (&resMax)[3], const string &partition)
 {
 
 	// take the highest resolution of all layers
 	bool found=false;
 
 	// loop through scalars fields
-	typename Field3D::Field<T>::Vec scalarfields= inFile->readScalarLayers<T>();
+	typename Field3D::Field<T>::Vec scalarfields= readScalarLayers<T>(inFile, partition, string());
 	typename Field3D::Field<T>::Vec::const_iterator its = scalarfields.begin();
 	for (; its != scalarfields.end(); ++its) {
-		resMax[0] = ( (unsigned int) (**its).dataResolution().x>resMax[0])? (**its).dataResolution().x:resMax[0];
-		resMax[1] = ( (unsigned int) (**its).dataResolution().y>resMax[1])? (**its).dataResolution().y:resMax[1];
-		resMax[2] = ( (unsigned int) (**its).dataResolution().z>resMax[2])? (**its).dataResolution().z:resMax[2];
+		const Field3D::V3i res = channelResolution(**its);
+		resMax[0] = ( (unsigned int) res.x>resMax[0])? res.x:resMax[0];
+		resMax[1] = ( (unsigned int) res.y>resMax[1])? res.y:resMax[1];
+		resMax[2] = ( (unsigned int) res.z>resMax[2])? res.z:resMax[2];
 		found= true || found;
 	}
 
 	// loop through vector fields
-	typename Field3D::Field< FIELD3D_VEC3_T<T> >::Vec vectorfields = inFile->readVectorLayers<T>();
+	typename Field3D::Field< FIELD3D_VEC3_T<T> >::Vec vectorfields = readVectorLayers<T>(inFile, partition, string());
 	typename Field3D::Field< FIELD3D_VEC3_T<T> >::Vec::const_iterator itv = vectorfields.begin();
 	for (; itv != vectorfields.end(); ++itv) {
-		resMax[0] = ( (unsigned int) (**itv).dataResolution().x>resMax[0])? (**itv).dataResolution().x:resMax[0];
-		resMax[1] = ( (unsigned int) (**itv).dataResolution().y>resMax[1])? (**itv).dataResolution().y:resMax[1];
-		resMax[2] = ( (unsigned int) (**itv).dataResolution().z>resMax[2])? (**itv).dataResolution().z:resMax[2];
+		// the extents of staggered MAC layers, their data window holds the faces
+		const Field3D::V3i res = channelResolution(**itv);
+		resMax[0] = ( (unsigned int) res.x>resMax[0])? res.x:resMax[0];
+		resMax[1] = ( (unsigned int) res.y>resMax[1])? res.y:resMax[1];
+		resMax[2] = ( (unsigned int) res.z>resMax[2])? res.z:resMax[2];
 		found= true || found;
 	}
 
 	return found;
 }
 
-bool getFieldsResolution(Field3D::Field3DInputFile *inFile,unsigned int (&resolution)[3])
+bool getFieldsResolution(Field3D::Field3DInputFile *inFile,unsigned int (&resolution)[3], const string &partition)
 {
 	bool found = false;
 	resolution[0] = resolution[1] = resolution[2] = 0 ;
-	found = getHighestResolution<Field3D::half>(inFile,resolution) || found;
-	found = getHighestResolution<float>(inFile,resolution) || found;
-	found = getHighestResolution<double>(inFile,resolution) || found;
+	found = getHighestResolution<Field3D::half>(inFile,resolution,partition) || found;
+	found = getHighestResolution<float>(inFile,resolution,partition) || found;
+	found = getHighestResolution<double>(inFile,resolution,partition) || found;
 	return found;
 }
 
 
 
-template<typename Data_Type>
-bool testScalarDataType(Field3DInputFile *inFile, string name) {
-	typename Field<Data_Type>::Vec res = inFile->readScalarLayers<Data_Type>(name);
-	if(res.empty()) {
-		//WARNING( name + " was not found in the field3D file while determining its type");
-		return false;
-	}
-	return true;
+// ------------------------------------------- SPARSE MAC CHANNELS
+
+string staggeredLayerName( const string &channelName, int axis ) {
+	static const char *suffixes[3] = { "_u", "_v", "_w" };
+	return channelName + suffixes[axis];
 }
 
+bool hasStaggeredLayers( Field3DInputFile *file, const string &partition, const string &channelName ) {
+	vector<string> scalarNames;
+	file->getScalarLayerNames(scalarNames, partition);
+	string found;
+	return staggeredComponent(staggeredLayerName(channelName, 0), scalarNames, found) == 0;
+}
 
-template<typename Data_Type>
-bool testVectorDataType(Field3DInputFile *inFile, string name) {
-	typename Field<FIELD3D_VEC3_T<Data_Type> >::Vec res = inFile->readVectorLayers<Data_Type>(name);
-	if(res.empty()) {
-		//WARNING( name + " was not found in the field3D file while determining its type");
-		return false;
+SparseVelocityEnum sparseVelocity() {
+	static int mode = -1;
+	if( mode < 0 ) {
+		const char *env = getenv("FIELD3D_SPARSE_VELOCITY");
+		const string value = env ? env : "";
+		if( value == "density" )                     mode = VELOCITY_DENSITY_MASK;
+		else if( value == "dense" || value == "0" )  mode = VELOCITY_DENSE;
+		else                                         mode = VELOCITY_MAGNITUDE;
 	}
-	return true;
+	return (SparseVelocityEnum) mode;
+}
+
+bool faceMasked( const float *mask, const unsigned int res[3], int i, int j, int k, int axis ) {
+	const int    c[3]    = { i, j, k };
+	const size_t step[3] = { 1, res[0], (size_t) res[0] * res[1] };
+	const size_t index   = i + step[1] * j + step[2] * k;
+
+	// voxels after and before the face
+	if( c[axis] < (int) res[axis] && mask[index] > SPARSE_THRESHOLD ) return true;
+	if( c[axis] > 0 && mask[index - step[axis]] > SPARSE_THRESHOLD ) return true;
+	return false;
 }
 
 
-bool getFieldValueType( Field3DInputFile *inFile , string name , SupportedFieldTypeEnum &type ){
 
-	typedef Field3D::half half;
+// ------------------------------------------- STATIC CHANNELS
 
-	// TODO : template for below
-	if( Field3DTools::testScalarDataType<half>(inFile,name) ) {
-		Field<half>::Vec res = inFile->readScalarLayers<half>(name);
-		if( !res.empty() ) {
+bool useChannelDedup() {
+	static int dedup = -1;
+	if( dedup < 0 ) {
+		const char *env = getenv("FIELD3D_DEDUP_CHANNELS");
+		dedup = ( env && atoi(env) > 0 ) ? 1 : 0;
+	}
+	return dedup == 1;
+}
+
+string referenceMetadataName( const string &fluidName, const string &channelName ) {
+	return "Reference_" + fluidName + "_" + channelName;
+}
+
+static inline unsigned int rotl32( unsigned int x, int r ) {
+	return ( x << r ) | ( x >> (32 - r) );
+}
+
+static const unsigned int HASH_PRIME1 = 0x9E3779B1U;
+static const unsigned int HASH_PRIME2 = 0x85EBCA77U;
+static const unsigned int HASH_PRIME3 = 0xC2B2AE3DU;
+static const unsigned int HASH_PRIME4 = 0x27D4EB2FU;
+static const unsigned int HASH_PRIME5 = 0x165667B1U;
 
-			Field3D::DenseField<half>::Ptr fieldD=Field3D::field_dynamic_cast< Field3D::DenseField<half> >(res[0]);
-			if( fieldD ) { type = DenseScalarField_Half  ; return true  ;}
+// enough lanes for the compiler to keep the lanes loop a loop, and vectorize it
+static const int HASH_LANES = 32;
 
-			Field3D::SparseField<half>::Ptr fieldS=Field3D::field_dynamic_cast< Field3D::SparseField<half> >(res[0]);
-			if( fieldS ) { type = SparseScalarField_Half  ; return true  ;}
+static inline unsigned int avalanche32( unsigned int h ) {
+	h ^= h >> 15;  h *= HASH_PRIME2;
+	h ^= h >> 13;  h *= HASH_PRIME3;
+	h ^= h >> 16;
+	return h;
+}
 
-			// error
-			ERROR( "Type of half scalar field " + name + " unknown : not a dense field nor a sparse field");
-			type = TypeUnsupported;
-			return false;
+unsigned long long contentHash( const void *data, size_t bytes, unsigned long long seed ) {
+	const unsigned char *p = static_cast<const unsigned char *>(data);
+
+	// the low half of the seed in the first half of the lanes, the high half in the others
+	unsigned int lanes[HASH_LANES];
+	for(int l=0; l<HASH_LANES; l++)
+		lanes[l] = (unsigned int) ( l < HASH_LANES/2 ? seed : seed >> 32 ) + (unsigned int) l * HASH_PRIME1;
+
+	// xxh32 rounds, one 32 bits word per lane
+	const size_t stride = 4 * HASH_LANES;
+	const size_t blocks = bytes / stride;
+	for(size_t i=0; i<blocks; i++) {
+		for(int l=0; l<HASH_LANES; l++) {
+			unsigned int word;
+			memcpy(&word, p + stride*i + 4*l, 4);
+			lanes[l] = rotl32(lanes[l] + word * HASH_PRIME2, 13) * HASH_PRIME1;
 		}
 	}
-	else if( Field3DTools::testScalarDataType<float>(inFile,name) ) {
-		Field<float>::Vec res = inFile->readScalarLayers<float>(name);
-		if( !res.empty() ) {
+	p += stride * blocks;
+
+	// two 32 bits hashes of half the lanes each
+	unsigned int h[2] = { (unsigned int) bytes, (unsigned int) bytes };
+	for(int l=0; l<HASH_LANES; l++) h[l / (HASH_LANES/2)] += rotl32(lanes[l], l % (HASH_LANES/2) + 1);
+
+	const size_t tail = bytes % stride;
+	size_t i = 0;
+	for(; i+4<=tail; i+=4) {
+		unsigned int word;
+		memcpy(&word, p+i, 4);
+		unsigned int &x = h[(i/4) & 1];
+		x = rotl32(x + word * HASH_PRIME3, 17) * HASH_PRIME4;
+	}
+	for(; i<tail; i++) {
+		unsigned int &x = h[i & 1];
+		x = rotl32(x + p[i] * HASH_PRIME5, 11) * HASH_PRIME1;
+	}
 
-			Field3D::DenseField<float>::Ptr fieldD=Field3D::field_dynamic_cast< Field3D::DenseField<float> >(res[0]);
-			if( fieldD ) { type = DenseScalarField_Float  ; return true  ;}
+	// both halves depend on every lane
+	const unsigned int top = avalanche32(h[0] ^ h[1] * HASH_PRIME1);
+	return ( (unsigned long long) top << 32 ) | avalanche32(h[1] + top * HASH_PRIME2);
+}
+
+template< typename Data_T >
+static bool writeEmptySparseLayer( Field3D::Field3DOutputFile *out, const char *fluidName, const char *fieldName, unsigned int res[3], double transform[4][4] ) {
+	typename SparseField<Data_T>::Ptr field(new SparseField<Data_T>);
+	setFieldProperties(*field, fluidName, fieldName, transform);
+	field->setSize(V3i(res[0],res[1],res[2]));
+
+	HDF5Lock lock;
+	return out->writeScalarLayer<Data_T>(field);
+}
+
+bool writeReferenceLayer( Field3D::Field3DOutputFile *out, const char *fluidName, const char *fieldName, unsigned int res[3], double transform[4][4], bool vector ) {
+	return vector ? writeEmptySparseLayer<V3h> (out, fluidName, fieldName, res, transform) :
+	                writeEmptySparseLayer<half>(out, fluidName, fieldName, res, transform) ;
+}
+
+
+// ------------------------------------------- STORAGE COST
+
+void measureOccupancy( const unsigned int res[3], int blockOrder, const float *a, const float *b, const float *c, Occupancy &occupancy ) {
+
+	const int          size    = 1 << blockOrder;
+	const unsigned int blocksX = ( res[0] + size - 1 ) / size;
+	const unsigned int blocksY = ( res[1] + size - 1 ) / size;
+	const unsigned int blocksZ = ( res[2] + size - 1 ) / size;
+
+	vector<char> active( (size_t) blocksX * blocksY * blocksZ, 0 );
 
-			Field3D::SparseField<float>::Ptr fieldS=Field3D::field_dynamic_cast< Field3D::SparseField<float> >(res[0]);
-			if( fieldS ) { type = SparseScalarField_Float ; return true  ;}
+	occupancy.voxels       = (long long) res[0] * res[1] * res[2];
+	occupancy.blocks       = (long long) active.size();
+	occupancy.activeVoxels   = 0;
+	occupancy.negativeVoxels = 0;
+	occupancy.activeBlocks   = 0;
+	if( active.empty() ) return;
 
-			// error
-			ERROR( "Type of float scalar field " + name + " unknown : not a dense field nor a sparse field");
-			type = TypeUnsupported;
-			return false;
+	size_t index = 0;
+	for(unsigned int k=0; k<res[2]; k++)
+	for(unsigned int j=0; j<res[1]; j++) {
+		char *row = &active[0] + (size_t) blocksX * ( (j >> blockOrder) + (size_t) blocksY * (k >> blockOrder) );
+		for(unsigned int i=0; i<res[0]; i++, index++) {
+			// same tests as the sparse writers
+			const bool on = b ? a[index]*a[index] + b[index]*b[index] + c[index]*c[index] > SPARSE_THRESHOLD
+			                  : a[index] > SPARSE_THRESHOLD;
+			if( on ) {
+				occupancy.activeVoxels++;
+				row[i >> blockOrder] = 1;
+			}
+			else if( !b && a[index] < -SPARSE_THRESHOLD ) {
+				occupancy.negativeVoxels++;
+			}
 		}
 	}
-	else if( Field3DTools::testVectorDataType<half>(inFile,name) ) {
-		Field<FIELD3D_VEC3_T<half> >::Vec res = inFile->readVectorLayers<half>(name);
+	occupancy.activeBlocks = count(active.begin(), active.end(), 1);
+}
+
+
+DecodeCost::DecodeCost() : blockNs(40.0) {
+	valueNs[DENSE ][FLOAT] = 0.3;
+	valueNs[DENSE ][HALF ] = 0.6;
+	valueNs[SPARSE][FLOAT] = 1.2;
+	valueNs[SPARSE][HALF ] = 1.5;
+}
 
-		if( !res.empty() ) {
+void estimateStorage(
+		const Occupancy   &occupancy  ,
+		int                blockOrder ,
+		int                components ,
+		FieldTypeEnum      type       ,
+		FieldDataTypeEnum  dataType   ,
+		const DecodeCost  &cost       ,
+		long long         &bytes      ,
+		double            &decodeNs   )
+{
+	const int       valueBytes  = ( dataType == HALF ? 2 : 4 ) * components;
+	const long long blockVoxels = 1LL << ( 3 * blockOrder );
 
-			Field3D::DenseField<FIELD3D_VEC3_T<half> >::Ptr fieldD = Field3D::field_dynamic_cast< Field3D::DenseField<FIELD3D_VEC3_T<half> > >(res[0]);
-			if( fieldD ) { type = DenseVectorField_Half  ; return true  ; }
+	if( type == DENSE ) {
+		bytes    = occupancy.voxels * valueBytes;
+		decodeNs = occupancy.voxels * components * cost.valueNs[type][dataType];
+		return;
+	}
 
-			Field3D::SparseField<FIELD3D_VEC3_T<half> >::Ptr fieldS = Field3D::field_dynamic_cast< Field3D::SparseField<FIELD3D_VEC3_T<half> > >(res[0]);
-			if( fieldS ) { type = SparseVectorField_Half ; return true  ; }
+	// allocated blocks are stored whole, every block keeps its empty value
+	const long long stored = occupancy.activeBlocks * blockVoxels;
+	bytes    = stored * valueBytes + occupancy.blocks * ( valueBytes + sizeof(int) );
+	decodeNs = stored * components * cost.valueNs[type][dataType] + occupancy.blocks * cost.blockNs;
+}
 
-			Field3D::MACField<FIELD3D_VEC3_T<half> >::Ptr fieldM=Field3D::field_dynamic_cast< Field3D::MACField<FIELD3D_VEC3_T<half> > >(res[0]);
-			if( fieldM ) { type = MACField_Half  ; return true  ;}
+double relativeCost( long long bytes, double decodeNs, long long denseBytes, double denseNs, double decodeWeight ) {
+	const double size = (double) bytes / std::max( (double) denseBytes, 1.0 );
+	const double time = decodeNs       / std::max( denseNs            , 1.0 );
+	return ( 1.0 - decodeWeight ) * size + decodeWeight * time;
+}
 
-			// error
-			ERROR( "Type of half vector field " + name + " unknown : not a dense field nor a sparse field nor a MAC Field");
-			type = TypeUnsupported;
-			return false;
+// ------------------------------------------- BLOCK ORDER
+
+// FIELD3D_BLOCK_ORDER entries keyed by "format:channel", empty parts match anything
+static map<string,int> *blockOrderSettings = NULL;
+static pthread_once_t   blockOrderOnce     = PTHREAD_ONCE_INIT;
+
+static void parseBlockOrderSettings() {
+	blockOrderSettings = new map<string,int>;
+
+	const char *env = getenv("FIELD3D_BLOCK_ORDER");
+	if( !env ) return;
+
+	stringstream entries(env);
+	string       entry;
+	while( getline(entries, entry, ',') ) {
+		string format, channel, value = entry;
+
+		size_t colon = value.find(':');
+		if( colon != string::npos ) { format  = value.substr(0, colon); value = value.substr(colon+1); }
+		size_t equal = value.find('=');
+		if( equal != string::npos ) { channel = value.substr(0, equal); value = value.substr(equal+1); }
+
+		const int order = ( value == "auto" ) ? BLOCK_ORDER_AUTO : atoi(value.c_str());
+		if( order != BLOCK_ORDER_AUTO && ( order < MIN_BLOCK_ORDER || order > MAX_BLOCK_ORDER ) ) {
+			WARNING( "FIELD3D_BLOCK_ORDER : ignoring " + entry );
+			continue;
 		}
+		(*blockOrderSettings)[format + ":" + channel] = order;
 	}
-	else if( Field3DTools::testVectorDataType<float>(inFile,name) ) {
-			Field<FIELD3D_VEC3_T<float> >::Vec res = inFile->readVectorLayers<float>(name);
-			if( !res.empty() ) {
-
-				Field3D::DenseField<FIELD3D_VEC3_T<float> >::Ptr fieldD=Field3D::field_dynamic_cast< Field3D::DenseField<FIELD3D_VEC3_T<float> > >(res[0]);
-				if( fieldD ) { type = DenseVectorField_Float  ; return true  ;}
+}
 
-				Field3D::SparseField<FIELD3D_VEC3_T<float> >::Ptr fieldS=Field3D::field_dynamic_cast< Field3D::SparseField<FIELD3D_VEC3_T<float> > >(res[0]);
-				if( fieldS ) { type = SparseVectorField_Float  ; return true  ;}
+int blockOrderSetting( const string &format, const string &channel ) {
+	pthread_once(&blockOrderOnce, parseBlockOrderSettings);
 
-				Field3D::MACField<FIELD3D_VEC3_T<float> >::Ptr fieldM=Field3D::field_dynamic_cast< Field3D::MACField<FIELD3D_VEC3_T<float> > >(res[0]);
-				if( fieldM ) { type = MACField_Float  ; return true  ;}
+	const string keys[4] = { format + ":" + channel, ":" + channel, format + ":", ":" };
+	for(int i=0; i<4; i++) {
+		map<string,int>::const_iterator it = blockOrderSettings->find(keys[i]);
+		if( it != blockOrderSettings->end() ) return it->second;
+	}
+	return SPARSE_BLOCK_ORDER;
+}
 
-				// error
-				ERROR( "Type of float vector field " + name + " unknown : not a dense field nor a sparse field nor a MAC Field");
-				type = TypeUnsupported;
-				return false;
-			}
+int tuneBlockOrder(
+		const unsigned int res[3] ,
+		const float       *a      ,
+		const float       *b      ,
+		const float       *c      ,
+		FieldDataTypeEnum  dataType ,
+		double             decodeWeight ,
+		const DecodeCost  &cost   )
+{
+	const int components = b ? 3 : 1;
+
+	int    best     = SPARSE_BLOCK_ORDER;
+	double bestCost = 0.0;
+	for(int order=MIN_BLOCK_ORDER; order<=MAX_BLOCK_ORDER; order++) {
+		Occupancy occupancy;
+		measureOccupancy(res, order, a, b, c, occupancy);
+
+		long long denseBytes , sparseBytes ;
+		double    denseNs    , sparseNs    ;
+		estimateStorage(occupancy, order, components, DENSE , dataType, cost, denseBytes , denseNs );
+		estimateStorage(occupancy, order, components, SPARSE, dataType, cost, sparseBytes, sparseNs);
+
+		const double orderCost = relativeCost(sparseBytes, sparseNs, denseBytes, denseNs, decodeWeight);
+		if( order == MIN_BLOCK_ORDER || orderCost < bestCost ) {
+			best     = order;
+			bestCost = orderCost;
+		}
 	}
+	return best;
+}
 
-	// error
-	ERROR( std::string("Type of data in field ") + name + " unknown : not a float field nor a half float field");
-	type = TypeUnsupported;
-	return false;
+string blockOrderMetadataName( const string &fluidName, const string &channelName ) {
+	return "BlockOrder_" + fluidName + "_" + channelName;
+}
 
+const char *blockOrderCounter( int blockOrder ) {
+	static const char *COUNTERS[] = {
+			"block_order_0_layers", "block_order_1_layers", "block_order_2_layers", "block_order_3_layers",
+			"block_order_4_layers", "block_order_5_layers", "block_order_6_layers", "block_order_7_layers" };
+	return ( blockOrder >= 0 && blockOrder <= MAX_BLOCK_ORDER ) ? COUNTERS[blockOrder] : "block_order_other_layers";
 }
 
+string formatName( FieldTypeEnum type, FieldDataTypeEnum dataType ) {
+	const char *half = ( dataType == HALF ) ? "half" : "float";
+	switch( type ) {
+		case DENSE  : return string("f3d-dense-" ) + half;
+		case SPARSE : return string("f3d-sparse-") + half;
+		default     : return dataType == HALF ? "f3d-auto-half" : "f3d-auto-float";
+	}
+}
 
+FieldTypeEnum chooseFieldType(
+		const Occupancy   &occupancy  ,
+		int                blockOrder ,
+		int                components ,
+		FieldDataTypeEnum  dataType   ,
+		double             decodeWeight ,
+		const DecodeCost  &cost       )
+{
+	if( occupancy.negativeVoxels > 0 ) return DENSE;
 
+	long long denseBytes , sparseBytes ;
+	double    denseNs    , sparseNs    ;
+	estimateStorage(occupancy, blockOrder, components, DENSE , dataType, cost, denseBytes , denseNs );
+	estimateStorage(occupancy, blockOrder, components, SPARSE, dataType, cost, sparseBytes, sparseNs);
 
+	return relativeCost(sparseBytes, sparseNs, denseBytes, denseNs, decodeWeight) < 1.0 ? SPARSE : DENSE;
+}
 
 }
@@ -35,6 +35,8 @@
 
 #include <vector>
 #include <string>
+#include <algorithm>
+#include <cmath>
 
 #include <Field3D/Field3DFile.h>
 #include <Field3D/DenseField.h>
@@ -45,6 +47,8 @@
 #include <Field3D/InitIO.h>
 
 #include "tinyLogger.h"
+#include "field3D_Profiler.h"
+#include "field3D_FieldPool.h"
 
 
 
@@ -54,8 +58,21 @@ namespace Field3DTools {
 const float SPARSE_THRESHOLD = 0.0000001 ;
 
 // ---------------------  Infos
-void getFieldNames       ( Field3D::Field3DInputFile *file   , std::vector< std::string > &names );
-bool getFieldsResolution ( Field3D::Field3DInputFile *inFile , unsigned int (&res)[3]            );
+
+// Each fluid is written in its own partition, named after the fluid.
+// An empty partition name stands for every partition of the file.
+void getPartitionNames   ( Field3D::Field3DInputFile *file   , std::vector< std::string > &names );
+void getFieldNames       ( Field3D::Field3DInputFile *file   , std::vector< std::string > &names , const std::string &partition = std::string() );
+bool getFieldsResolution ( Field3D::Field3DInputFile *inFile , unsigned int (&res)[3]            , const std::string &partition = std::string() );
+
+// partition storing the given fluid : the one named after it, or the only one
+// of the file ( renamed fluid, files written before the multi-fluid support ).
+// Returns an empty string if there isn't any match.
+std::string findPartition( const std::vector< std::string > &partitions , const std::string &fluidName );
+
+// name of the global metadata storing the dynamic offset of a fluid,
+// the global "Offset" entry is kept for the files written before it
+std::string offsetMetadataName( const std::string &fluidName );
 
 //std::string getScalarFieldValueType( Field3D::Field3DInputFile *file , std::string name );
 //FieldRes::dataTypeString()
@@ -66,25 +83,230 @@ bool getFieldsResolution ( Field3D::Field3DInputFile *inFile , unsigned int (&re
 //FieldBase::className()
 //FieldBase::typedef Field<Data_T> class_type;
 
+// every class and value type the layers are read from, see field3D_Dispatch.h
+// for the order : the half, float and double variants of a class follow
 enum SupportedFieldTypeEnum {
-	DenseScalarField_Half   ,
-	DenseScalarField_Float  ,
-	SparseScalarField_Half  ,
-	SparseScalarField_Float ,
-	DenseVectorField_Half   ,
-	DenseVectorField_Float  ,
-	SparseVectorField_Half  ,
-	SparseVectorField_Float ,
-	MACField_Half           ,
-	MACField_Float          ,
+	DenseScalarField_Half    ,
+	DenseScalarField_Float   ,
+	DenseScalarField_Double  ,
+	SparseScalarField_Half   ,
+	SparseScalarField_Float  ,
+	SparseScalarField_Double ,
+	DenseVectorField_Half    ,
+	DenseVectorField_Float   ,
+	DenseVectorField_Double  ,
+	SparseVectorField_Half   ,
+	SparseVectorField_Float  ,
+	SparseVectorField_Double ,
+	MACField_Half            ,
+	MACField_Float           ,
+	MACField_Double          ,
 	TypeUnsupported
 };
 
-enum FieldTypeEnum      { DENSE , SPARSE } ;
+// AUTO picks DENSE or SPARSE per channel and per frame ( see chooseFieldType )
+enum FieldTypeEnum      { DENSE , SPARSE , AUTO } ;
 enum FieldDataTypeEnum  { FLOAT , HALF   } ;
 
 
-bool getFieldValueType( Field3D::Field3DInputFile *inFile , std::string name, SupportedFieldTypeEnum &type) ;
+// ---------------------  Static channels
+
+// Channels which don't change from a frame to the next ( coord, falloff, ... )
+// can be stored once : the next frames only hold an empty sparse layer, and
+// a global metadata naming the file of the sequence holding the data.
+// Off unless FIELD3D_DEDUP_CHANNELS=1, other Field3D readers only see the
+// empty layers.
+bool useChannelDedup();
+
+std::string referenceMetadataName( const std::string &fluidName, const std::string &channelName );
+
+// 64 bits hash of a buffer, chained through the seed. Independent lanes of
+// 32 bits xxh32 rounds, which the compiler vectorizes : 32 bits multiplies
+// are SSE4.1 and AVX2 instructions, 64 bits ones have none ( see SIMD_FLAGS
+// in CMakeLists.txt ).
+unsigned long long contentHash( const void *data, size_t bytes, unsigned long long seed = 0 );
+
+// the empty layer standing for a channel stored in another file
+bool writeReferenceLayer(
+		Field3D::Field3DOutputFile *out       ,
+		const char *                fluidName ,
+		const char *                fieldName ,
+		unsigned int                res[3]    ,
+		double                      transform[4][4] ,
+		bool                        vector    );
+
+
+// ---------------------  Block-sparse MAC channels
+
+// Field3D has no sparse MAC field : unless FIELD3D_SPARSE_VELOCITY is 0, the
+// sparse formats store each face component of MAC channels in its own sparse
+// scalar layer ( see staggeredLayerName ), its blocks culled independently of
+// the other components. The extents of a component layer are the fluid's,
+// its data window is one face larger along its axis, and it's tagged with
+// this metadata holding 1 + its axis. Other Field3D readers see three scalar
+// fields of faces, FIELD3D_SPARSE_VELOCITY=0 keeps dense MAC fields for them.
+const char * const STAGGERED_METADATA = "staggered" ;
+
+// "velocity_u", "velocity_v" and "velocity_w" for the axis 0, 1 and 2
+std::string staggeredLayerName( const std::string &channelName, int axis );
+
+// the three component layers of a staggered MAC channel are in the partition
+bool hasStaggeredLayers( Field3D::Field3DInputFile *file, const std::string &partition, const std::string &channelName );
+
+// which blocks of faces are kept : the ones holding a face above
+// SPARSE_THRESHOLD in magnitude, or the ones next to the density
+enum SparseVelocityEnum { VELOCITY_DENSE , VELOCITY_MAGNITUDE , VELOCITY_DENSITY_MASK } ;
+
+// FIELD3D_SPARSE_VELOCITY : "0" or "dense", "density", magnitude otherwise
+SparseVelocityEnum sparseVelocity();
+
+// mask above SPARSE_THRESHOLD on one side of the face (i,j,k) of the
+// given axis ( 0 for u faces, 1 for v, 2 for w )
+bool faceMasked( const float *mask, const unsigned int res[3], int i, int j, int k, int axis );
+
+
+
+// ---------------------  Storage cost
+
+// block order of the SparseFields written by the plugin ( Field3D's default ),
+// blocks are 2^order voxels wide
+const int SPARSE_BLOCK_ORDER = 4 ;
+const int MIN_BLOCK_ORDER    = 2 ;
+const int MAX_BLOCK_ORDER    = 7 ;
+const int BLOCK_ORDER_AUTO   = -1 ;
+
+// what the sparse writers keep of a Maya array : voxels above SPARSE_THRESHOLD
+// ( squared magnitude for vectors ) and the blocks holding at least one of them.
+// Negative scalars are lost by the sparse writers, they are counted apart.
+struct Occupancy {
+	Occupancy() : voxels(0), activeVoxels(0), negativeVoxels(0), blocks(0), activeBlocks(0) {}
+	long long voxels, activeVoxels, negativeVoxels, blocks, activeBlocks;
+};
+
+// b and c are NULL for scalar channels
+void measureOccupancy( const unsigned int res[3], int blockOrder, const float *a, const float *b, const float *c, Occupancy &occupancy );
+
+// decode time per stored value of each format, and per sparse block
+struct DecodeCost {
+	DecodeCost();               // rough defaults, field3d_analyze measures them
+	double valueNs[2][2];       // [DENSE|SPARSE][FieldDataTypeEnum]
+	double blockNs;
+};
+
+// uncompressed size and decode time of a channel stored in a format
+void estimateStorage(
+		const Occupancy   &occupancy  ,
+		int                blockOrder ,
+		int                components ,
+		FieldTypeEnum      type       ,
+		FieldDataTypeEnum  dataType   ,
+		const DecodeCost  &cost       ,
+		long long         &bytes      ,
+		double            &decodeNs   );
+
+// weighted size and decode time relative to the dense field :
+// a weight of 0 only looks at the size, 1 only at the decode time
+const double AUTO_DECODE_WEIGHT = 0.25 ;
+
+double relativeCost( long long bytes, double decodeNs, long long denseBytes, double denseNs, double decodeWeight );
+
+// block order of a sparse channel set with FIELD3D_BLOCK_ORDER : comma separated
+// [format:][channel=]order entries, order being a number or "auto", the most
+// specific entry wins. ex : "5,density=3,f3d-sparse-half:temperature=auto"
+// Returns SPARSE_BLOCK_ORDER when nothing is set.
+int blockOrderSetting( const std::string &format, const std::string &channel );
+
+// block order with the lowest weighted cost for this array ( b and c are NULL
+// for scalar channels ), among MIN_BLOCK_ORDER to MAX_BLOCK_ORDER
+int tuneBlockOrder(
+		const unsigned int res[3] ,
+		const float       *a      ,
+		const float       *b      ,
+		const float       *c      ,
+		FieldDataTypeEnum  dataType ,
+		double             decodeWeight = AUTO_DECODE_WEIGHT ,
+		const DecodeCost  &cost         = DecodeCost()       );
+
+// global metadata recording the block order of a sparse channel
+std::string blockOrderMetadataName( const std::string &fluidName, const std::string &channelName );
+
+// profiling counter of the layers written with a block order
+const char *blockOrderCounter( int blockOrder );
+
+// name of the cache format registered in Maya ( "f3d-sparse-half", ... )
+std::string formatName( FieldTypeEnum type, FieldDataTypeEnum dataType );
+
+// DENSE or SPARSE, whichever costs less. Sparse is never picked
+// when it would drop negative values.
+FieldTypeEnum chooseFieldType(
+		const Occupancy   &occupancy  ,
+		int                blockOrder ,
+		int                components ,
+		FieldDataTypeEnum  dataType   ,
+		double             decodeWeight = AUTO_DECODE_WEIGHT ,
+		const DecodeCost  &cost         = DecodeCost()       );
+
+
+// ---------------------  HDF5 access
+
+// HDF5 isn't re-entrant unless it was built thread-safe, so every access
+// to a file ( open, read, write, close ) holds this lock. The conversions
+// from/to Maya arrays are done outside of it, so several fluids can still
+// be read in parallel.
+class HDF5Lock {
+public:
+	HDF5Lock  ();
+	~HDF5Lock ();
+private:
+	HDF5Lock            ( const HDF5Lock & );
+	HDF5Lock &operator= ( const HDF5Lock & );
+};
+
+// Field3DInputFile::read*Layers() holding the HDF5 lock,
+// restricted to a partition unless it's empty
+template<typename Data_T>
+typename Field3D::Field<Data_T>::Vec readScalarLayers(
+		const Field3D::Field3DInputFile *in        ,
+		const std::string               &partition ,
+		const std::string               &name
+)
+{
+	HDF5Lock lock;
+	if( partition.empty() ) return in->readScalarLayers<Data_T>(name);
+	if( !name.empty()     ) return in->readScalarLayers<Data_T>(partition, name);
+
+	// every layer of the partition
+	typename Field3D::Field<Data_T>::Vec layers;
+	std::vector<std::string> names;
+	in->getScalarLayerNames(names, partition);
+	for(size_t i=0; i<names.size(); i++) {
+		typename Field3D::Field<Data_T>::Vec sl = in->readScalarLayers<Data_T>(partition, names[i]);
+		layers.insert(layers.end(), sl.begin(), sl.end());
+	}
+	return layers;
+}
+
+template<typename Data_T>
+typename Field3D::Field< FIELD3D_VEC3_T<Data_T> >::Vec readVectorLayers(
+		const Field3D::Field3DInputFile *in        ,
+		const std::string               &partition ,
+		const std::string               &name
+)
+{
+	HDF5Lock lock;
+	if( partition.empty() ) return in->readVectorLayers<Data_T>(name);
+	if( !name.empty()     ) return in->readVectorLayers<Data_T>(partition, name);
+
+	// every layer of the partition
+	typename Field3D::Field< FIELD3D_VEC3_T<Data_T> >::Vec layers;
+	std::vector<std::string> names;
+	in->getVectorLayerNames(names, partition);
+	for(size_t i=0; i<names.size(); i++) {
+		typename Field3D::Field< FIELD3D_VEC3_T<Data_T> >::Vec vl = in->readVectorLayers<Data_T>(partition, names[i]);
+		layers.insert(layers.end(), vl.begin(), vl.end());
+	}
+	return layers;
+}
 
 
 template<typename Data_T>
@@ -110,170 +332,156 @@ void setFieldProperties(
 }
 
 
-// ---------------------  Read Field3d field into raw arrays
-template< class FieldType ,typename MayaArray >
-bool readScalarField(
-		Field3D::Field3DInputFile  *in       ,
-		const char *      /*fluidName*/      ,
-		const char *      fieldName          ,
-		MayaArray         &data
-)
+// number of allocated blocks of a sparse field ( used for profiling )
+template<typename Data_T>
+long long countAllocatedBlocks( const Field3D::SparseField<Data_T> &field )
 {
-
-	typedef typename FieldType::value_type ImportType;
-
-	typename Field3D::Field<ImportType >::Vec sl    = in->readScalarLayers<ImportType>(fieldName) ;
-	typename FieldType::Ptr                   field = Field3D::field_dynamic_cast< FieldType >(sl[0]);
-	if( !field ) {
-		ERROR( std::string("Failed to read ") + fieldName + " : Dynamic downcasting failed ");
-		return false;
-	}
-
-	// non-safe cast to unsigned int : but resolution
-	// should'nt be stored as ints in field3D anyway
-	Field3D::V3i reso = field->dataResolution();
-	unsigned int resolution[3];
-	resolution[0] = (unsigned int) reso.x;
-	resolution[1] = (unsigned int) reso.y;
-	resolution[2] = (unsigned int) reso.z;
+	long long count = 0;
+	Field3D::V3i blocks = field.blockRes();
+	for(int k=0; k<blocks.z; k++)
+		for(int j=0; j<blocks.y; j++)
+			for(int i=0; i<blocks.x; i++)
+				if( field.blockIsAllocated(i,j,k) ) count++;
+	return count;
+}
 
 
-	DEBUG( "Start copy " );
-	typename FieldType::const_iterator it = field->cbegin();
+// ---------------------  Decode fields into contiguous buffers
 
-	for ( ; it != field->cend(); ++it) {
-		const unsigned int src = it.x + resolution[0]*it.y + resolution[0]*resolution[1]*it.z;
+inline bool isStaggered( const Field3D::FieldBase &field )
+{
+	return field.metadata().intMetadata(STAGGERED_METADATA, 0) != 0;
+}
 
-#if defined(DEBUG_MODE)
-		unsigned int arraySize = resolution[0]*resolution[1]*resolution[2] ;
-		if( src <  arraySize ) {
-#endif
-			// TODO : check conversion
-			data[src] = (float) *it;
+// face component held by a staggered layer : 0 for u, 1 for v, 2 for w
+inline int staggeredAxis( const Field3D::FieldBase &field )
+{
+	return field.metadata().intMetadata(STAGGERED_METADATA, 0) - 1;
+}
 
-#if defined(DEBUG_MODE)
-		}
-		else {
-			std::stringstream idx,len;
-			idx<<src; len<<arraySize;
-			ERROR( std::string("Failed to copy channel ") + fieldName + " into field : Index (" + idx.str() + ") is out of bounds (" + len.str()+ ")") ;
-			return false;
-		}
-#endif
+// resolution of the channel held by a layer : its data window,
+// the extents of a staggered layer
+inline Field3D::V3i channelResolution( const Field3D::FieldRes &field )
+{
+	if( !isStaggered(field) ) return field.dataResolution();
+	const Field3D::Box3i extents = field.extents();
+	return extents.max - extents.min + Field3D::V3i(1);
+}
 
-	}
-	DEBUG( "End copy " );
+// number of values per voxel in the destination buffer
+template<typename Data_T>
+struct VoxelComponents                            { enum { value = 1 }; };
+template<typename Base_T>
+struct VoxelComponents< FIELD3D_VEC3_T<Base_T> >  { enum { value = 3 }; };
 
-	return true;
+template<typename Data_T, typename Dest_T>
+inline void storeVoxel( Dest_T *dst, const Data_T &value )
+{
+	dst[0] = (Dest_T) value;
 }
 
-
-template< typename FieldType ,typename MayaArray >
-bool readVectorField(
-		Field3D::Field3DInputFile  *in       ,
-		const char *      /*fluidName*/      ,
-		const char *      fieldName          ,
-		MayaArray         &data
-)
+template<typename Base_T, typename Dest_T>
+inline void storeVoxel( Dest_T *dst, const FIELD3D_VEC3_T<Base_T> &value )
 {
+	dst[0] = (Dest_T) value.x;
+	dst[1] = (Dest_T) value.y;
+	dst[2] = (Dest_T) value.z;
+}
 
-	typedef typename FieldType::value_type ImportType;
-	typedef typename ImportType::BaseType  DataType;
 
-	typename Field3D::Field<ImportType>::Vec sl    = in->readVectorLayers<DataType>(fieldName)       ;
-	typename FieldType::Ptr                  field = Field3D::field_dynamic_cast< FieldType >(sl[0]) ;
-	if( !field ) {
-		ERROR( std::string("Failed to read ") + fieldName + " : Dynamic downcasting failed ");
-		return false;
+// Maya's layout ( x first ) is the one of dense fields : walk the storage linearly
+template<typename Data_T, typename Dest_T>
+void copyVoxels( const Field3D::DenseField<Data_T> &field , Dest_T *data )
+{
+	const size_t         N   = VoxelComponents<Data_T>::value;
+	const Field3D::Box3i dw  = field.dataWindow();
+	const Field3D::V3i   res = field.dataResolution();
+	const size_t         count = (size_t) res.x * res.y * res.z;
+
+	const Data_T *src = &field.fastValue(dw.min.x, dw.min.y, dw.min.z);
+	for(size_t i=0; i<count; i++) {
+		storeVoxel(data + i*N, src[i]);
 	}
+}
 
-	// non-safe cast to unsigned int : but resolution
-	// should'nt be stored as ints in field3D anyway
-	Field3D::V3i reso = field->dataResolution();
-	unsigned int resolution[3];
-	resolution[0] = (unsigned int) reso.x;
-	resolution[1] = (unsigned int) reso.y;
-	resolution[2] = (unsigned int) reso.z;
-
-
-	typename FieldType::const_iterator it   = field->cbegin();
-	typename FieldType::const_iterator iend = field->cend();
-	for ( ; it != iend; ++it)  {
-		data[ 0 + (it.x)*3 + (it.y)*3*resolution[0] + (it.z)*3*resolution[0]*resolution[1] ] = (*it).x;
-		data[ 1 + (it.x)*3 + (it.y)*3*resolution[0] + (it.z)*3*resolution[0]*resolution[1] ] = (*it).y;
-		data[ 2 + (it.x)*3 + (it.y)*3*resolution[0] + (it.z)*3*resolution[0]*resolution[1] ] = (*it).z;
+// block by block : empty blocks are filled with their single value,
+// allocated ones are read voxel by voxel
+template<typename Data_T, typename Dest_T>
+void copyVoxels( const Field3D::SparseField<Data_T> &field , Dest_T *data )
+{
+	const size_t         N      = VoxelComponents<Data_T>::value;
+	const Field3D::Box3i dw     = field.dataWindow();
+	const Field3D::V3i   res    = field.dataResolution();
+	const Field3D::V3i   blocks = field.blockRes();
+	const int            size   = field.blockSize();
+
+	for(int bk=0; bk<blocks.z; bk++)
+	for(int bj=0; bj<blocks.y; bj++)
+	for(int bi=0; bi<blocks.x; bi++) {
+
+		const int i0 = bi*size, i1 = std::min(i0+size, res.x);
+		const int j0 = bj*size, j1 = std::min(j0+size, res.y);
+		const int k0 = bk*size, k1 = std::min(k0+size, res.z);
+
+		const bool   allocated = field.blockIsAllocated(bi,bj,bk);
+		const Data_T empty     = field.getBlockEmptyValue(bi,bj,bk);
+
+		for(int k=k0; k<k1; k++)
+		for(int j=j0; j<j1; j++) {
+			Dest_T *dst = data + N * ( (size_t) i0 + (size_t) res.x * ( j + (size_t) res.y * k ) );
+			if( !allocated ) {
+				for(int i=i0; i<i1; i++, dst+=N) storeVoxel(dst, empty);
+			}
+			else {
+				for(int i=i0; i<i1; i++, dst+=N) storeVoxel(dst, field.fastValue(i+dw.min.x, j+dw.min.y, k+dw.min.z));
+			}
+		}
 	}
-
-	return true;
 }
 
-
-
-template< typename ImportType , typename MayaArray >
-bool readMACField(
-		Field3D::Field3DInputFile  *in       ,
-		const char *      /*fluidName*/      ,
-		const char *      fieldName          ,
-		MayaArray         &data
-)
+// each MAC component is stored contiguously ( x first ) like in Maya,
+// Maya appends them one after the other : u, v then w
+template<typename Base_T, typename Dest_T>
+void copyVoxels( const Field3D::MACField< FIELD3D_VEC3_T<Base_T> > &field , Dest_T *data )
 {
+	const Field3D::V3i   s  = field.getComponentSize();
+	const Field3D::Box3i dw = field.dataWindow();
+
+	const Base_T *u = &field.u(dw.min.x, dw.min.y, dw.min.z);
+	const Base_T *v = &field.v(dw.min.x, dw.min.y, dw.min.z);
+	const Base_T *w = &field.w(dw.min.x, dw.min.y, dw.min.z);
+	Dest_T *dstU = data;
+	Dest_T *dstV = dstU + s.x;
+	Dest_T *dstW = dstV + s.y;
+	for(int i=0; i<s.x; i++) dstU[i] = (Dest_T) u[i];
+	for(int i=0; i<s.y; i++) dstV[i] = (Dest_T) v[i];
+	for(int i=0; i<s.z; i++) dstW[i] = (Dest_T) w[i];
+}
 
-	typename Field3D::Field<FIELD3D_VEC3_T<ImportType> >::Vec    sl    = in->readVectorLayers<ImportType>(fieldName) ;
-	typename Field3D::MACField<FIELD3D_VEC3_T<ImportType> >::Ptr field = Field3D::field_dynamic_cast< Field3D::MACField<FIELD3D_VEC3_T<ImportType> > >(sl[0]);
-	if( !field ) {
-		ERROR( std::string("Failed to read ") + fieldName + " : Dynamic downcasting failed  ");
-		return false;
-	}
-
-	// non-safe cast to unsigned int : but resolution
-	// should'nt be stored as ints in field3D anyway
-	Field3D::V3i reso = field->dataResolution();
-	unsigned int resolution[3];
-	resolution[0] = (unsigned int) reso.x;
-	resolution[1] = (unsigned int) reso.y;
-	resolution[2] = (unsigned int) reso.z;
-
-
-	Field3D::V3i s = field->getComponentSize();
-
-	DEBUG( "Start copy " );
-	// copy data into MAC field
-	Field3D::MACComponent compo[3]={Field3D::MACCompU,Field3D::MACCompV,Field3D::MACCompW};
-	unsigned int off=0;
-	unsigned int r[3] = {0,0,0};
-	for(unsigned int cp=0;cp<3;cp++) {
-
-		if(cp==0) {
-			r[0]=resolution[0]+1;
-			r[1]=resolution[1];
-			r[2]=resolution[2];
-			off=0;
-		}
-		else if(cp==1) {
-			r[0]=resolution[0];
-			r[1]=resolution[1]+1;
-			r[2]=resolution[2];
-			off+=s.x ;//r[0]*r[1]*r[2];
-		}
-		else if(cp==2) {
-			r[0]=resolution[0];
-			r[1]=resolution[1];
-			r[2]=resolution[2]+1;
-			off+= s.y; //r[0]*r[1]*r[2];
-		}
 
-		unsigned int src=0;
-		typename Field3D::MACField<FIELD3D_VEC3_T<ImportType> >::mac_comp_iterator i    = field->begin_comp(compo[cp]);
-		typename Field3D::MACField<FIELD3D_VEC3_T<ImportType> >::mac_comp_iterator iend = field->end_comp(compo[cp]);
-		for ( ; i != iend; ++i)  {
-			src = off + i.x  + i.y*r[0] + i.z*r[0]*r[1];
-			data[src]=(*i);
-		}
+// the faces of one component out of its staggered layer, at its place among
+// Maya's u, v then w faces : data is the start of the channel. The faces of
+// empty blocks get their empty value. False when the layer can't hold them.
+template<typename FieldType, typename Dest_T>
+bool copyStaggeredVoxels( const FieldType & , Dest_T * )
+{
+	return false;
+}
 
-	}
+template<typename Data_T, typename Dest_T>
+bool copyStaggeredVoxels( const Field3D::SparseField<Data_T> &field , Dest_T *data )
+{
+	const int          axis = staggeredAxis(field);
+	const Field3D::V3i r    = channelResolution(field);
+	if( VoxelComponents<Data_T>::value != 1 || axis < 0 || axis > 2 ) return false;
 
-	DEBUG( "End copy " );
+	Field3D::V3i faces = r;
+	faces[axis] += 1;
+	if( field.dataResolution() != faces ) return false;
 
+	const size_t nx = r.x, ny = r.y, nz = r.z;
+	const size_t offset[3] = { 0, (nx+1)*ny*nz, (nx+1)*ny*nz + nx*(ny+1)*nz };
+	copyVoxels(field, data + offset[axis]);
 	return true;
 }
 
@@ -295,12 +503,14 @@ bool writeDenseScalarField(
 	}
 
 	// field declaration
-	typename Field3D::DenseField<ExportType>::Ptr field( new Field3D::DenseField<ExportType>() ) ;
+	typename Field3D::DenseField<ExportType>::Ptr field = newField< Field3D::DenseField<ExportType> >() ;
 
 	// properties
 	Field3DTools::setFieldProperties( *field.get(), fluidName, fieldName, transform);
 
 	// copy channel into the scalar field
+	PROFILE_START(convert);
+	PROFILE_COUNT("bytes_in", (long long) res[0]*res[1]*res[2]*sizeof(float));
 	field->setSize(Field3D::V3i(res[0],res[1],res[2]));
 	for(unsigned int k=0; k<res[2];k++) {
 		for(unsigned int j=0; j<res[1];j++) {
@@ -312,8 +522,20 @@ bool writeDenseScalarField(
 		}
 	}
 
+	PROFILE_STOP(convert, "convert", fieldName);
+	PROFILE_BUFFER(field->memSize());
+
 	// write it onto disk
-	if( !out->writeScalarLayer<ExportType>(field) ) {
+	PROFILE_START(write);
+	bool written;
+	{
+		HDF5Lock lock;
+		written = out->writeScalarLayer<ExportType>(field);
+	}
+	PROFILE_STOP(write, "hdf5_write", fieldName);
+	PROFILE_BUFFER(-field->memSize());
+
+	if( !written ) {
 		ERROR( std::string("Problem while writing dense scalar field ") + fieldName + " : Unknown Reason ");
 		return false;
 	}
@@ -330,7 +552,8 @@ bool writeSparseScalarField(
 		const char *    fieldName           ,
 		unsigned int    res[3]              ,
 		double          transform[4][4]     ,
-		float *         data
+		float *         data                ,
+		int             blockOrder = SPARSE_BLOCK_ORDER
 )
 {
 
@@ -342,13 +565,17 @@ bool writeSparseScalarField(
 	}
 
 	// field declaration
-	typename Field3D::SparseField<ExportType>::Ptr field( new Field3D::SparseField<ExportType>() );
+	typename Field3D::SparseField<ExportType>::Ptr field = newField< Field3D::SparseField<ExportType> >();
 
 	// properties
 	Field3DTools::setFieldProperties( *field.get(), fluidName, fieldName, transform);
 
 	// copy channel into the scalar field
+	PROFILE_START(convert);
+	PROFILE_COUNT("bytes_in", (long long) res[0]*res[1]*res[2]*sizeof(float));
+	field->setBlockOrder(blockOrder);
 	field->setSize(Field3D::V3i(res[0],res[1],res[2]));
+	field->clear(ExportType(0));   // may come from the pool : skipped voxels must be empty
 	for(unsigned int k=0; k<res[2];k++) {
 		for(unsigned int j=0; j<res[1];j++) {
 			for(unsigned int i=0; i<res[0];i++) {
@@ -361,8 +588,21 @@ bool writeSparseScalarField(
 		}
 	}
 
+	PROFILE_STOP(convert, "convert", fieldName);
+	PROFILE_COUNT("sparse_blocks", countAllocatedBlocks(*field));
+	PROFILE_BUFFER(field->memSize());
+
 	// write it onto disk
-	if( !out->writeScalarLayer<ExportType>(field) ) {
+	PROFILE_START(write);
+	bool written;
+	{
+		HDF5Lock lock;
+		written = out->writeScalarLayer<ExportType>(field);
+	}
+	PROFILE_STOP(write, "hdf5_write", fieldName);
+	PROFILE_BUFFER(-field->memSize());
+
+	if( !written ) {
 		ERROR( std::string("Problem while writing sparse scalar field ") + fieldName + " : Unknown Reason ");
 		return false;
 	}
@@ -387,18 +627,20 @@ extern bool writeDenseVectorField(
 {
 
 	// check
-	if( data0 == NULL || data0 == NULL || data2 == NULL ) {
+	if( data0 == NULL || data1 == NULL || data2 == NULL ) {
 		ERROR("Arrays are NULL");
 		return false;
 	}
 
 	// field declaration
-	typename Field3D::DenseField<FIELD3D_VEC3_T<ExportType> >::Ptr field( new Field3D::DenseField<FIELD3D_VEC3_T<ExportType> > );
+	typename Field3D::DenseField<FIELD3D_VEC3_T<ExportType> >::Ptr field = newField< Field3D::DenseField<FIELD3D_VEC3_T<ExportType> > >();
 
 	// properties
 	Field3DTools::setFieldProperties(*field.get(), fluidName, fieldName, transform);
 
 	// copy channel into the vector field
+	PROFILE_START(convert);
+	PROFILE_COUNT("bytes_in", (long long) res[0]*res[1]*res[2]*3*sizeof(float));
 	field->setSize(Field3D::V3i(res[0],res[1],res[2]));
 	for(unsigned int k=0; k<res[2];k++) {
 		for(unsigned int j=0; j<res[1];j++) {
@@ -412,8 +654,20 @@ extern bool writeDenseVectorField(
 		}
 	}
 
+	PROFILE_STOP(convert, "convert", fieldName);
+	PROFILE_BUFFER(field->memSize());
+
 	// write it onto disk
-	if( !out->writeScalarLayer<FIELD3D_VEC3_T<ExportType> >(field) ) {
+	PROFILE_START(write);
+	bool written;
+	{
+		HDF5Lock lock;
+		written = out->writeScalarLayer<FIELD3D_VEC3_T<ExportType> >(field);
+	}
+	PROFILE_STOP(write, "hdf5_write", fieldName);
+	PROFILE_BUFFER(-field->memSize());
+
+	if( !written ) {
 		ERROR( std::string("Problem while writing dense vector field ") + fieldName + " : Unknown Reason ");
 		return false;
 	}
@@ -431,25 +685,30 @@ extern bool writeSparseVectorField(
 		double          transform[4][4]     ,
 		const float *   data0               ,
 		const float *   data1               ,
-		const float *   data2
+		const float *   data2               ,
+		int             blockOrder = SPARSE_BLOCK_ORDER
 )
 {
 
 
 	// check
-	if( data0 == NULL || data0 == NULL || data2 == NULL ) {
+	if( data0 == NULL || data1 == NULL || data2 == NULL ) {
 		ERROR("Arrays are NULL");
 		return false;
 	}
 
 	// field declaration
-	typename Field3D::DenseField<FIELD3D_VEC3_T<ExportType> >::Ptr field( new Field3D::DenseField<FIELD3D_VEC3_T<ExportType> >() );
+	typename Field3D::SparseField<FIELD3D_VEC3_T<ExportType> >::Ptr field = newField< Field3D::SparseField<FIELD3D_VEC3_T<ExportType> > >();
 
 	// properties
 	Field3DTools::setFieldProperties(*field, fluidName, fieldName, transform);
 
 	// copy channel into the vector field
+	PROFILE_START(convert);
+	PROFILE_COUNT("bytes_in", (long long) res[0]*res[1]*res[2]*3*sizeof(float));
+	field->setBlockOrder(blockOrder);
 	field->setSize(Field3D::V3i(res[0],res[1],res[2]));
+	field->clear(FIELD3D_VEC3_T<ExportType>(0));   // may come from the pool : skipped voxels must be empty
 	for(unsigned int k=0; k<res[2];k++) {
 		for(unsigned int j=0; j<res[1];j++) {
 			for(unsigned int i=0; i<res[0];i++) {
@@ -465,8 +724,21 @@ extern bool writeSparseVectorField(
 		}
 	}
 
+	PROFILE_STOP(convert, "convert", fieldName);
+	PROFILE_COUNT("sparse_blocks", countAllocatedBlocks(*field));
+	PROFILE_BUFFER(field->memSize());
+
 	// write it onto disk
-	if( !out->writeScalarLayer<FIELD3D_VEC3_T<ExportType> >(field) ) {
+	PROFILE_START(write);
+	bool written;
+	{
+		HDF5Lock lock;
+		written = out->writeScalarLayer<FIELD3D_VEC3_T<ExportType> >(field);
+	}
+	PROFILE_STOP(write, "hdf5_write", fieldName);
+	PROFILE_BUFFER(-field->memSize());
+
+	if( !written ) {
 		ERROR( std::string("Problem while writing sparse vector field ") + fieldName + " : Unknown Reason ");
 		return false;
 	}
@@ -495,12 +767,14 @@ extern bool writeMACVectorField(
 	}
 
 	// field declaration
-	typename Field3D::MACField<FIELD3D_VEC3_T<ExportType> >::Ptr field(new Field3D::MACField<FIELD3D_VEC3_T<ExportType> >());
+	typename Field3D::MACField<FIELD3D_VEC3_T<ExportType> >::Ptr field = newField< Field3D::MACField<FIELD3D_VEC3_T<ExportType> > >();
 
 	// properties
 	Field3DTools::setFieldProperties(*field, fluidName, fieldName, transform);
 
 	// copy channel into the vector field
+	PROFILE_START(convert);
+	PROFILE_COUNT("bytes_in", (long long) ( (res[0]+1)*res[1]*res[2] + res[0]*(res[1]+1)*res[2] + res[0]*res[1]*(res[2]+1) ) * sizeof(float));
 	field->setSize(Field3D::V3i(res[0],res[1],res[2]));
 
 	// do the common job for all components (instead of doing it per component)
@@ -528,8 +802,20 @@ extern bool writeMACVectorField(
 		for(unsigned int y = 0; y < res[1]; y++)
 			field->w(x,y,res[2])= (ExportType) *(vz + x + res[0]*y + res[0]*res[1]*res[2] ) ;
 
+	PROFILE_STOP(convert, "convert", fieldName);
+	PROFILE_BUFFER(field->memSize());
+
 	// write it onto disk
-	if(!out->writeScalarLayer<FIELD3D_VEC3_T<ExportType> >(field)) {
+	PROFILE_START(write);
+	bool written;
+	{
+		HDF5Lock lock;
+		written = out->writeScalarLayer<FIELD3D_VEC3_T<ExportType> >(field);
+	}
+	PROFILE_STOP(write, "hdf5_write", fieldName);
+	PROFILE_BUFFER(-field->memSize());
+
+	if( !written ) {
 		ERROR( std::string("Problem while writing MAC vector field ") + fieldName + " : Unknown Reason ");
 		return false;
 	}
@@ -537,6 +823,98 @@ extern bool writeMACVectorField(
 	return true;
 }
 
+// MAC channel as three staggered sparse layers ( see STAGGERED_METADATA ). The
+// blocks of each component are culled on their own : a block is kept when one
+// of its faces is above SPARSE_THRESHOLD in magnitude, or when a mask is given
+// ( density ) and is above it on one side of one of its faces. The faces of
+// kept blocks are all stored as is, culled ones read as 0.
+template< typename ExportType >
+extern bool writeSparseMACField(
+		Field3D::Field3DOutputFile *out     ,
+		const char *    fluidName           ,
+		const char *    fieldName           ,
+		unsigned int    res[3]              ,
+		double          transform[4][4]     ,
+		const float *   vx                  ,
+		const float *   vy                  ,
+		const float *   vz                  ,
+		int             blockOrder = SPARSE_BLOCK_ORDER ,
+		const float *   mask       = NULL
+)
+{
+
+	// check
+	if( vx == NULL || vy == NULL || vz == NULL ) {
+		ERROR("Arrays are NULL");
+		return false;
+	}
+
+	const float *components[3] = { vx, vy, vz };
+	const int    nx = res[0], ny = res[1], nz = res[2];
+
+	for(int axis=0; axis<3; axis++) {
+
+		const std::string layerName = staggeredLayerName(fieldName, axis);
+		const float      *faces     = components[axis];
+		const int         sx = nx + (axis == 0), sy = ny + (axis == 1), sz = nz + (axis == 2);
+
+		// field declaration, pooled apart from the sparse scalar fields
+		typename Field3D::SparseField<ExportType>::Ptr field = newField< Field3D::SparseField<ExportType> >("staggered");
+
+		// properties
+		Field3DTools::setFieldProperties(*field, fluidName, layerName.c_str(), transform);
+		field->metadata().setIntMetadata(STAGGERED_METADATA, axis + 1);
+
+		PROFILE_START(convert);
+		PROFILE_COUNT("bytes_in", (long long) sx*sy*sz*sizeof(float));
+		field->setBlockOrder(blockOrder);
+		field->setSize( Field3D::Box3i( Field3D::V3i(0), Field3D::V3i(nx-1, ny-1, nz-1) ),
+		                Field3D::Box3i( Field3D::V3i(0), Field3D::V3i(sx-1, sy-1, sz-1) ) );
+		field->clear(ExportType(0));   // may come from the pool : culled blocks must be empty
+
+		// blocks to keep
+		const Field3D::V3i blocks = field->blockRes();
+		std::vector<char>  keep( (size_t) blocks.x * blocks.y * blocks.z, 0 );
+		for(int k=0; k<sz; k++)
+			for(int j=0; j<sy; j++)
+				for(int i=0; i<sx; i++) {
+					char &block = keep[ (i >> blockOrder) + blocks.x * ( (j >> blockOrder) + (size_t) blocks.y * (k >> blockOrder) ) ];
+					if( block ) continue;
+					block = mask ? faceMasked(mask, res, i, j, k, axis)
+					             : std::fabs( faces[ i + (size_t) sx * ( j + (size_t) sy * k ) ] ) > SPARSE_THRESHOLD;
+				}
+
+		// copy the faces of the kept blocks
+		for(int k=0; k<sz; k++)
+			for(int j=0; j<sy; j++)
+				for(int i=0; i<sx; i++) {
+					if( !keep[ (i >> blockOrder) + blocks.x * ( (j >> blockOrder) + (size_t) blocks.y * (k >> blockOrder) ) ] ) continue;
+					field->fastLValue(i,j,k) = (ExportType) faces[ i + (size_t) sx * ( j + (size_t) sy * k ) ];
+				}
+
+		PROFILE_STOP(convert, "convert", fieldName);
+		PROFILE_COUNT("sparse_blocks", countAllocatedBlocks(*field));
+		PROFILE_BUFFER(field->memSize());
+
+		// write it onto disk
+		PROFILE_START(write);
+		bool written;
+		{
+			HDF5Lock lock;
+			written = out->writeScalarLayer<ExportType>(field);
+		}
+		PROFILE_STOP(write, "hdf5_write", fieldName);
+		PROFILE_BUFFER(-field->memSize());
+
+		if( !written ) {
+			ERROR( "Problem while writing sparse MAC field " + layerName + " : Unknown Reason ");
+			return false;
+		}
+	}
+
+	return true;
+}
+
 
 
 
@@ -0,0 +1,124 @@
+// Copyright (c) 2011 Prime Focus Film.
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions
+// are met:
+//
+// Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+// Redistributions in binary form must reproduce the above copyright
+// notice, this list of conditions and the following disclaimer in the
+// documentation and/or other materials provided with the
+// distribution. Neither the name of Prime Focus Film nor the
+// names of its contributors may be used to endorse or promote
+// products derived from this software without specific prior written
+// permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+// FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+// COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+// INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+// HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+// OF THE POSSIBILITY OF SUCH DAMAGE.
+
+
+#include "maya_Channels.h"
+
+using namespace std;
+
+namespace MayaTools {
+
+// ------------------------------------------- ACCESSORS
+
+static MStatus getDensity( MFnFluid &fluid, float *&a, float *&b, float *&c ) {
+	MStatus status;
+	a = fluid.density(&status);
+	b = c = NULL;
+	return status;
+}
+
+static MStatus getPressure( MFnFluid &fluid, float *&a, float *&b, float *&c ) {
+	MStatus status;
+	a = fluid.pressure(&status);
+	b = c = NULL;
+	return status;
+}
+
+static MStatus getFuel( MFnFluid &fluid, float *&a, float *&b, float *&c ) {
+	MStatus status;
+	a = fluid.fuel(&status);
+	b = c = NULL;
+	return status;
+}
+
+static MStatus getTemperature( MFnFluid &fluid, float *&a, float *&b, float *&c ) {
+	MStatus status;
+	a = fluid.temperature(&status);
+	b = c = NULL;
+	return status;
+}
+
+static MStatus getFalloff( MFnFluid &fluid, float *&a, float *&b, float *&c ) {
+	MStatus status;
+	a = fluid.falloff(&status);
+	b = c = NULL;
+	return status;
+}
+
+static MStatus getColors( MFnFluid &fluid, float *&a, float *&b, float *&c ) {
+	return fluid.getColors(a, b, c);
+}
+
+static MStatus getCoordinates( MFnFluid &fluid, float *&a, float *&b, float *&c ) {
+	return fluid.getCoordinates(a, b, c);
+}
+
+static MStatus getVelocity( MFnFluid &fluid, float *&a, float *&b, float *&c ) {
+	return fluid.getVelocity(a, b, c);
+}
+
+
+// ------------------------------------------- REGISTRY
+
+static const ChannelDescriptor CHANNELS[] = {
+	{ "resolution"         , Field3DTools::SCALAR_CHANNEL , 3 , RESOLUTION_STORAGE , NULL           },
+	{ "offset"             , Field3DTools::SCALAR_CHANNEL , 3 , OFFSET_STORAGE     , NULL           },
+	{ "density"            , Field3DTools::SCALAR_CHANNEL , 1 , FORMAT_STORAGE     , getDensity     },
+	{ "pressure"           , Field3DTools::SCALAR_CHANNEL , 1 , FORMAT_STORAGE     , getPressure    },
+	{ "fuel"               , Field3DTools::SCALAR_CHANNEL , 1 , FORMAT_STORAGE     , getFuel        },
+	{ "temperature"        , Field3DTools::SCALAR_CHANNEL , 1 , FORMAT_STORAGE     , getTemperature },
+	{ "falloff"            , Field3DTools::SCALAR_CHANNEL , 1 , FORMAT_STORAGE     , getFalloff     },
+	{ "color"              , Field3DTools::VECTOR_CHANNEL , 3 , DENSE_STORAGE      , getColors      },
+	{ "coord"              , Field3DTools::VECTOR_CHANNEL , 3 , DENSE_STORAGE      , getCoordinates },
+	{ "textureCoordinates" , Field3DTools::VECTOR_CHANNEL , 3 , DENSE_STORAGE      , getCoordinates },
+	{ "velocity"           , Field3DTools::MAC_CHANNEL    , 3 , MAC_STORAGE        , getVelocity    },
+};
+
+static const ChannelDescriptor CUSTOM_CHANNEL =
+	{ "custom"             , Field3DTools::SCALAR_CHANNEL , 1 , FORMAT_STORAGE     , NULL           };
+
+
+const ChannelDescriptor &findChannel( const string &channelName ) {
+	for(size_t i=0; i<sizeof(CHANNELS)/sizeof(CHANNELS[0]); i++) {
+		if( channelName == CHANNELS[i].name ) return CHANNELS[i];
+	}
+	return CUSTOM_CHANNEL;
+}
+
+bool isCustomChannel( const ChannelDescriptor &channel ) {
+	return &channel == &CUSTOM_CHANNEL;
+}
+
+bool isImplicitChannel( const ChannelDescriptor &channel ) {
+	return channel.storage == RESOLUTION_STORAGE || channel.storage == OFFSET_STORAGE;
+}
+
+}
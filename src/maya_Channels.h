@@ -0,0 +1,81 @@
+// Copyright (c) 2011 Prime Focus Film.
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions
+// are met:
+//
+// Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+// Redistributions in binary form must reproduce the above copyright
+// notice, this list of conditions and the following disclaimer in the
+// documentation and/or other materials provided with the
+// distribution. Neither the name of Prime Focus Film nor the
+// names of its contributors may be used to endorse or promote
+// products derived from this software without specific prior written
+// permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+// FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+// COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+// INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+// HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+// OF THE POSSIBILITY OF SUCH DAMAGE.
+
+
+#ifndef MAYA_CHANNELS_H
+#define MAYA_CHANNELS_H
+
+#include <maya/MFnFluid.h>
+#include <maya/MStatus.h>
+
+#include <string>
+
+#include "field3D_Resample.h"
+
+// The fluid channels Maya caches, and how each one is stored. A channel
+// name is resolved once, when Maya names the channel it writes or reads,
+// every later call goes through its descriptor. Supporting a new channel
+// is a new entry of the table in maya_Channels.cpp.
+
+namespace MayaTools {
+
+enum ChannelStorage {
+	RESOLUTION_STORAGE ,   // implicit : the resolution of the fluid reading the cache
+	OFFSET_STORAGE     ,   // implicit : the auto-resize offset, kept as metadata
+	FORMAT_STORAGE     ,   // dense, sparse or auto, as chosen by the cache format
+	DENSE_STORAGE      ,   // the sparse threshold would alter them ( color, coordinates )
+	MAC_STORAGE            // MAC field ( velocity )
+};
+
+// the buffers of the channel in the fluid, b and c are NULL for scalar channels
+typedef MStatus (*ChannelAccessor)( MFnFluid &fluid, float *&a, float *&b, float *&c );
+
+struct ChannelDescriptor {
+	const char                  *name       ;
+	Field3DTools::ChannelLayout  layout     ;
+	unsigned int                 components ;   // of a voxel, values for implicit channels
+	ChannelStorage               storage    ;
+	ChannelAccessor              accessor   ;   // NULL : Maya's array holds the data
+};
+
+// unknown channels get a scalar descriptor without accessor, they're
+// written from Maya's array when it holds one value per voxel, as vector
+// layers when it holds three
+const ChannelDescriptor &findChannel( const std::string &channelName );
+
+bool isCustomChannel( const ChannelDescriptor &channel );
+
+// resolution and offset : their values are made up on read, never written
+bool isImplicitChannel( const ChannelDescriptor &channel );
+
+}
+
+#endif
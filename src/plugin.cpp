@@ -31,15 +31,21 @@
 
 
 #include "plugin.h"
+#include "tinyLogger.h"
 
 MStatus initializePlugin( MObject obj )
 {
 	MFnPlugin plugin( obj, "Prime Focus London", "1.0" );
 
+	// register Field3D's IO classes once for all the cache formats
+	Field3DTools::initIO();
+
 	CHECK_MSTATUS_AND_RETURN_IT( plugin.registerCacheFormat("f3d-dense-half"  , Field3dCacheFormat::DHCreator) );
 	CHECK_MSTATUS_AND_RETURN_IT( plugin.registerCacheFormat("f3d-dense-float" , Field3dCacheFormat::DFCreator) );
 	CHECK_MSTATUS_AND_RETURN_IT( plugin.registerCacheFormat("f3d-sparse-half" , Field3dCacheFormat::SHCreator) );
 	CHECK_MSTATUS_AND_RETURN_IT( plugin.registerCacheFormat("f3d-sparse-float", Field3dCacheFormat::SFCreator) );
+	CHECK_MSTATUS_AND_RETURN_IT( plugin.registerCacheFormat("f3d-auto-float"  , Field3dCacheFormat::AFCreator) );
+	CHECK_MSTATUS_AND_RETURN_IT( plugin.registerCacheFormat("f3d-auto-half"   , Field3dCacheFormat::AHCreator) );
 
 	return MStatus::kSuccess;
 }
@@ -52,6 +58,14 @@ MStatus uninitializePlugin( MObject obj )
 	CHECK_MSTATUS_AND_RETURN_IT( plugin.deregisterCacheFormat("f3d-dense-float" ) );
 	CHECK_MSTATUS_AND_RETURN_IT( plugin.deregisterCacheFormat("f3d-sparse-half" ) );
 	CHECK_MSTATUS_AND_RETURN_IT( plugin.deregisterCacheFormat("f3d-sparse-float") );
+	CHECK_MSTATUS_AND_RETURN_IT( plugin.deregisterCacheFormat("f3d-auto-float"  ) );
+	CHECK_MSTATUS_AND_RETURN_IT( plugin.deregisterCacheFormat("f3d-auto-half"   ) );
+
+	// close the files kept opened for playback
+	Field3DTools::InputFilePool::instance().clear();
+
+	// the log writer thread must not outlive the plugin's code
+	tinyLogger::shutdown();
 
 	return MStatus::kSuccess;
 }
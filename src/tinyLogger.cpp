@@ -32,6 +32,14 @@
 
 #include "tinyLogger.h"
 
+#include <pthread.h>
+#include <semaphore.h>
+#include <time.h>
+#include <cstdlib>
+#include <cstring>
+
+using namespace std;
+
 #if !defined(NO_TTY)
 
 const char *blue   = "\E[34m\033[1m";
@@ -47,3 +55,252 @@ const char *yellow = "";
 const char *normal = "";
 
 #endif
+
+
+namespace tinyLogger {
+
+volatile int minimumSeverity = kDebug;
+
+namespace {
+
+// Bounded multi-producer queue ( D. Vyukov's design ) : each slot carries a
+// sequence number telling whether it's free for the producer of a given
+// position or ready for the consumer. Producers only ever do one CAS.
+const unsigned int QUEUE_SIZE   = 1024 ;    // power of 2
+const unsigned int MESSAGE_SIZE = 256  ;
+
+struct Slot {
+	volatile unsigned int  sequence ;
+	Severity               severity ;
+	const char            *file     ;
+	const char            *function ;
+	int                    line     ;
+	char                   text[MESSAGE_SIZE];
+};
+
+Slot                  queue[QUEUE_SIZE];
+volatile unsigned int enqueuePos = 0;
+volatile unsigned int dequeuePos = 0;       // written by the consumer only
+
+// rate limiting, per one second window
+volatile int          maxPerSecond   = 200;
+volatile time_t       windowStart    = 0;
+volatile int          windowCount    = 0;
+volatile int          suppressed     = 0;
+volatile int          dropped        = 0;
+
+// background thread
+enum State { kStopped , kRunning , kShutdown };
+volatile int          state          = kStopped;
+pthread_once_t        startOnce      = PTHREAD_ONCE_INIT;
+pthread_t             writer;
+sem_t                 pending;               // posted once per message
+volatile unsigned int written        = 0;    // messages handled by the writer
+
+
+void write( const Slot &slot ) {
+
+	switch( slot.severity ) {
+		case kDebug :
+			cout << blue << "[DEBUG] " << blue << slot.file << "::" << slot.function << "():" << slot.line << normal << " : " << slot.text << "\n";
+			break;
+		case kTrace :
+			cout << yellow << "[TRACE] " << slot.file << "::" << slot.function << "():" << slot.line << normal << "\n";
+			break;
+		case kLog :
+			cout << yellow << "[LOG  ] " << blue << slot.file << "::" << slot.function << "():" << slot.line << normal << " : " << slot.text << "\n";
+			break;
+		case kWarning :
+			cout << yellow << "[WARN ] " << blue << slot.file << "::" << slot.function << "():" << slot.line << normal << " : " << slot.text << "\n";
+			break;
+		default :
+			cerr << red << "[ERROR] " << slot.file << "::" << slot.function << "():" << slot.line << " : " << slot.text << normal << "\n";
+			break;
+	}
+}
+
+
+// consumer side, only called by one thread at a time
+unsigned int drain() {
+
+	unsigned int count = 0;
+	while( true ) {
+		Slot &slot = queue[ dequeuePos & (QUEUE_SIZE-1) ];
+		if( slot.sequence != dequeuePos + 1 ) break;
+		__sync_synchronize();
+
+		write(slot);
+
+		__sync_synchronize();
+		slot.sequence = dequeuePos + QUEUE_SIZE;
+		dequeuePos++;
+		count++;
+	}
+
+	// report what the producers had to throw away
+	int lost = __sync_fetch_and_and(&suppressed, 0);
+	if( lost ) cout << yellow << "[LOG  ] " << normal << lost << " messages suppressed by the rate limit\n";
+	lost = __sync_fetch_and_and(&dropped, 0);
+	if( lost ) cout << yellow << "[LOG  ] " << normal << lost << " messages dropped, log queue full\n";
+
+	if( count ) {
+		cout.flush();
+		cerr.flush();
+	}
+	return count;
+}
+
+
+void *writerLoop( void * ) {
+	while( true ) {
+		while( sem_wait(&pending) != 0 ) {}
+		unsigned int count = drain();
+		__sync_fetch_and_add(&written, count ? count : 1);
+		if( state == kShutdown ) {
+			drain();
+			return NULL;
+		}
+	}
+}
+
+
+void start() {
+
+	// runtime settings
+	const char *level = getenv("FIELD3D_LOG_LEVEL");
+	if( level ) {
+		string l(level);
+		if     ( l == "debug"   ) minimumSeverity = kDebug;
+		else if( l == "trace"   ) minimumSeverity = kTrace;
+		else if( l == "log"     ) minimumSeverity = kLog;
+		else if( l == "warning" ) minimumSeverity = kWarning;
+		else if( l == "error"   ) minimumSeverity = kError;
+		else if( l == "none"    ) minimumSeverity = kNone;
+	}
+	const char *rate = getenv("FIELD3D_LOG_RATE");
+	if( rate ) maxPerSecond = atoi(rate);
+
+	for(unsigned int i=0; i<QUEUE_SIZE; i++) queue[i].sequence = i;
+
+	sem_init(&pending, 0, 0);
+	if( pthread_create(&writer, NULL, writerLoop, NULL) == 0 ) {
+		state = kRunning;
+		atexit(shutdown);
+	}
+	else {
+		state = kShutdown;
+	}
+}
+
+
+// true if the message fits in the rate of the current second
+bool withinRate() {
+	if( maxPerSecond <= 0 ) return true;
+
+	time_t now   = time(NULL);
+	time_t begin = windowStart;
+	if( now != begin && __sync_bool_compare_and_swap(&windowStart, begin, now) ) {
+		windowCount = 0;
+	}
+	return __sync_add_and_fetch(&windowCount, 1) <= maxPerSecond;
+}
+
+}
+
+
+void push( Severity severity, const char *file, const char *function, int line, const string &message ) {
+
+	pthread_once(&startOnce, start);
+	if( !enabled(severity) ) return;
+
+	// errors always get through, a burst of messages mustn't hide a failure
+	if( severity < kError && !withinRate() ) {
+		__sync_fetch_and_add(&suppressed, 1);
+		return;
+	}
+
+	// after shutdown there is no writer anymore
+	if( state != kRunning ) {
+		Slot slot;
+		slot.severity = severity;
+		slot.file     = file;
+		slot.function = function;
+		slot.line     = line;
+		strncpy(slot.text, message.c_str(), MESSAGE_SIZE-1);
+		slot.text[MESSAGE_SIZE-1] = '\0';
+		write(slot);
+		cout.flush();
+		return;
+	}
+
+	// claim a position
+	Slot         *slot = NULL;
+	unsigned int  pos  = enqueuePos;
+	while( true ) {
+		slot = &queue[ pos & (QUEUE_SIZE-1) ];
+		unsigned int sequence = slot->sequence;
+		int          diff     = (int) ( sequence - pos );
+
+		if( diff == 0 ) {
+			if( __sync_bool_compare_and_swap(&enqueuePos, pos, pos+1) ) break;
+			pos = enqueuePos;
+		}
+		else if( diff < 0 ) {
+			// full : never block the caller
+			__sync_fetch_and_add(&dropped, 1);
+			return;
+		}
+		else {
+			pos = enqueuePos;
+		}
+	}
+
+	slot->severity = severity;
+	slot->file     = file;
+	slot->function = function;
+	slot->line     = line;
+	strncpy(slot->text, message.c_str(), MESSAGE_SIZE-1);
+	slot->text[MESSAGE_SIZE-1] = '\0';
+
+	// publish
+	__sync_synchronize();
+	slot->sequence = pos + 1;
+	sem_post(&pending);
+}
+
+
+void setLevel( Severity severity ) {
+	pthread_once(&startOnce, start);
+	minimumSeverity = severity;
+}
+
+void setRate( int messagesPerSecond ) {
+	pthread_once(&startOnce, start);
+	maxPerSecond = messagesPerSecond;
+}
+
+
+void flush() {
+	if( state != kRunning ) return;
+
+	// wake up the writer until it caught up with every published message
+	unsigned int target = enqueuePos;
+	while( state == kRunning && (int) ( dequeuePos - target ) < 0 ) {
+		unsigned int before = written;
+		sem_post(&pending);
+		while( written == before && state == kRunning ) {
+			struct timespec ts = { 0 , 1000000 };
+			nanosleep(&ts, NULL);
+		}
+	}
+}
+
+
+void shutdown() {
+	if( !__sync_bool_compare_and_swap(&state, kRunning, kShutdown) ) return;
+	sem_post(&pending);
+	pthread_join(writer, NULL);
+	sem_destroy(&pending);
+}
+
+}
@@ -33,6 +33,8 @@
 #define LOG_H
 
 #include <iostream>
+#include <sstream>
+#include <string>
 
 
 //----- Tiny log macros :
@@ -41,13 +43,56 @@ extern const char *red    ;
 extern const char *yellow ;
 extern const char *normal ;
 
-#define DEBUG_MODE
+
+//----- Asynchronous back-end :
+// Messages are formatted by the caller, pushed in a lock-free ring buffer
+// and written by a background thread, so the caller never waits for the
+// console. When the buffer is full messages are dropped, not waited for.
+//
+// Runtime settings ( environment ) :
+//    FIELD3D_LOG_LEVEL  : debug, trace, log, warning, error or none ( default debug )
+//    FIELD3D_LOG_RATE   : max messages per second, extra ones are counted
+//                         and reported as suppressed ( default 200 ).
+//                         Errors are never suppressed.
+namespace tinyLogger {
+
+enum Severity { kDebug = 0 , kTrace , kLog , kWarning , kError , kNone };
+
+extern volatile int minimumSeverity;
+
+inline bool enabled( Severity severity ) { return severity >= minimumSeverity; }
+
+void push     ( Severity severity, const char *file, const char *function, int line, const std::string &message );
+void setLevel ( Severity severity );
+void setRate  ( int messagesPerSecond );
+
+// wait until every pushed message has been written
+void flush    ();
+
+// drain and stop the background thread ( on plugin unload ). Later
+// messages are written synchronously.
+void shutdown ();
+
+}
+
+// a single statement, so that it can be used as the body of an if / else
+#define TINYLOGGER_PUSH(severity, message) \
+	do { if( tinyLogger::enabled(severity) ) { \
+		std::ostringstream _tinyLoggerStream; _tinyLoggerStream << message; \
+		tinyLogger::push(severity, __FILE__, __FUNCTION__, __LINE__, _tinyLoggerStream.str()); } } while(0)
+
+
+// DEBUG and TRACE are compiled in unless NO_DEBUG_MODE or NDEBUG is defined
+#if !defined(NO_DEBUG_MODE) && !defined(DEBUG_MODE)
+	#define DEBUG_MODE
+#endif
+
 #if defined (DEBUG_MODE) && !defined(NDEBUG)
 	#define DEBUG(message) \
-		std::cout<< blue << "[DEBUG] " << blue <<__FILE__<<"::"<<__FUNCTION__<<"():"<<__LINE__<< normal << " : "<< message << std::endl ;
+		TINYLOGGER_PUSH(tinyLogger::kDebug, message)
 
 	#define TRACE() \
-		std::cout<< yellow << "[TRACE] " <<__FILE__<<"::"<<__FUNCTION__<<"():"<<__LINE__<< normal << std::endl ;
+		TINYLOGGER_PUSH(tinyLogger::kTrace, "")
 
 #else
 	#define DEBUG(message)
@@ -61,13 +106,13 @@ extern const char *normal ;
 	#define ERROR(message)
 #else
 	#define LOG(message) \
-			std::cout<< yellow << "[LOG  ] " << blue <<__FILE__<<"::"<<__FUNCTION__<<"():"<<__LINE__<< normal << " : "<< message << std::endl ;
+		TINYLOGGER_PUSH(tinyLogger::kLog, message)
 
 	#define WARNING(message) \
-			std::cout<< yellow << "[WARN ] " << blue <<__FILE__<<"::"<<__FUNCTION__<<"():"<<__LINE__<< normal << " : "<< message << std::endl ;
+		TINYLOGGER_PUSH(tinyLogger::kWarning, message)
 
 	#define ERROR(message) \
-			std::cerr<< red    << "[ERROR] " << __FILE__<<"::"<<__FUNCTION__<<"():"<<__LINE__<< " : "<< message << std::endl ;
+		TINYLOGGER_PUSH(tinyLogger::kError, message)
 #endif
 
 
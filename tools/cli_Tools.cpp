@@ -0,0 +1,195 @@
+// Copyright (c) 2011 Prime Focus Film.
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions
+// are met:
+//
+// Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+// Redistributions in binary form must reproduce the above copyright
+// notice, this list of conditions and the following disclaimer in the
+// documentation and/or other materials provided with the
+// distribution. Neither the name of Prime Focus Film nor the
+// names of its contributors may be used to endorse or promote
+// products derived from this software without specific prior written
+// permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+// FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+// COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+// INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+// HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+// OF THE POSSIBILITY OF SUCH DAMAGE.
+
+
+#include "cli_Tools.h"
+
+#include <sys/time.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <time.h>
+
+#include <cstdlib>
+#include <cstring>
+#include <cstdio>
+#include <sstream>
+
+using namespace std;
+
+namespace CliTools {
+
+double now() {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+long peakRSS() {
+	struct rusage usage;
+	if( getrusage(RUSAGE_SELF, &usage) != 0 ) return -1;
+	return usage.ru_maxrss;
+}
+
+long long fileSize( const string &path ) {
+	struct stat st;
+	if( stat(path.c_str(), &st) != 0 ) return -1;
+	return (long long) st.st_size;
+}
+
+
+bool hasArg( int argc, char **argv, const char *name ) {
+	for(int i=1; i<argc; i++) {
+		if( strcmp(argv[i],name) == 0 ) return true;
+	}
+	return false;
+}
+
+string getArg( int argc, char **argv, const char *name, const string &defaultValue ) {
+	for(int i=1; i<argc-1; i++) {
+		if( strcmp(argv[i],name) == 0 ) return argv[i+1];
+	}
+	return defaultValue;
+}
+
+void split( const string &str, char sep, vector< string > &tokens ) {
+	tokens.clear();
+	stringstream ss(str);
+	string token;
+	while( getline(ss, token, sep) ) {
+		if( !token.empty() ) tokens.push_back(token);
+	}
+}
+
+void splitInt( const string &str, char sep, vector< int > &values ) {
+	vector<string> tokens;
+	split(str, sep, tokens);
+	values.clear();
+	for(vector<string>::iterator it=tokens.begin(); it!=tokens.end(); ++it) {
+		values.push_back( atoi(it->c_str()) );
+	}
+}
+
+void splitFloat( const string &str, char sep, vector< float > &values ) {
+	vector<string> tokens;
+	split(str, sep, tokens);
+	values.clear();
+	for(vector<string>::iterator it=tokens.begin(); it!=tokens.end(); ++it) {
+		values.push_back( (float) atof(it->c_str()) );
+	}
+}
+
+
+string jsonEscape( const string &str ) {
+	string res;
+	res.reserve(str.size());
+	for(string::const_iterator it=str.begin(); it!=str.end(); ++it) {
+		switch(*it) {
+			case '"'  : res += "\\\""; break;
+			case '\\' : res += "\\\\"; break;
+			case '\n' : res += "\\n" ; break;
+			case '\t' : res += "\\t" ; break;
+			default   : res += *it   ; break;
+		}
+	}
+	return res;
+}
+
+
+// ------------------------------------------- JSON WRITER
+
+JsonWriter::JsonWriter( ostream &out ) : m_out(out) {
+}
+
+void JsonWriter::separator( const char *key ) {
+	if( !m_first.empty() ) {
+		if( !m_first.back() ) m_out << ",";
+		m_first.back() = false;
+		m_out << "\n" << string(2*m_first.size(), ' ');
+	}
+	if( key ) m_out << "\"" << jsonEscape(key) << "\": ";
+}
+
+void JsonWriter::beginObject( const char *key ) {
+	separator(key);
+	m_out << "{";
+	m_first.push_back(true);
+}
+
+void JsonWriter::endObject() {
+	m_first.pop_back();
+	m_out << "\n" << string(2*m_first.size(), ' ') << "}";
+	if( m_first.empty() ) m_out << "\n";
+}
+
+void JsonWriter::beginArray( const char *key ) {
+	separator(key);
+	m_out << "[";
+	m_first.push_back(true);
+}
+
+void JsonWriter::endArray() {
+	m_first.pop_back();
+	m_out << "\n" << string(2*m_first.size(), ' ') << "]";
+	if( m_first.empty() ) m_out << "\n";
+}
+
+void JsonWriter::value( const char *key, const string &val ) {
+	separator(key);
+	m_out << "\"" << jsonEscape(val) << "\"";
+}
+
+void JsonWriter::value( const char *key, const char *val ) {
+	value(key, string(val));
+}
+
+void JsonWriter::value( const char *key, double val ) {
+	separator(key);
+	char buffer[64];
+	snprintf(buffer, sizeof(buffer), "%.6g", val);
+	m_out << buffer;
+}
+
+void JsonWriter::value( const char *key, long long val ) {
+	separator(key);
+	m_out << val;
+}
+
+void JsonWriter::value( const char *key, int val ) {
+	separator(key);
+	m_out << val;
+}
+
+void JsonWriter::value( const char *key, bool val ) {
+	separator(key);
+	m_out << ( val ? "true" : "false" );
+}
+
+}
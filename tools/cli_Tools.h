@@ -0,0 +1,87 @@
+// Copyright (c) 2011 Prime Focus Film.
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions
+// are met:
+//
+// Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+// Redistributions in binary form must reproduce the above copyright
+// notice, this list of conditions and the following disclaimer in the
+// documentation and/or other materials provided with the
+// distribution. Neither the name of Prime Focus Film nor the
+// names of its contributors may be used to endorse or promote
+// products derived from this software without specific prior written
+// permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+// FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+// COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+// INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+// HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+// OF THE POSSIBILITY OF SUCH DAMAGE.
+
+
+#ifndef CLITOOLS_H
+#define CLITOOLS_H
+
+#include <string>
+#include <vector>
+#include <ostream>
+
+// Small helpers shared by the standalone command line tools
+// ( benchmark, ... ). Nothing in here depends on Maya.
+
+namespace CliTools {
+
+// ---------------------  Timing
+double       now         ();                                   // monotonic time in seconds
+long         peakRSS     ();                                   // peak resident set size in KB
+long long    fileSize    ( const std::string &path );          // -1 if the file doesn't exist
+
+// ---------------------  Arguments
+bool         hasArg      ( int argc, char **argv, const char *name );
+std::string  getArg      ( int argc, char **argv, const char *name, const std::string &defaultValue );
+void         split       ( const std::string &str, char sep, std::vector< std::string > &tokens );
+void         splitInt    ( const std::string &str, char sep, std::vector< int >         &values );
+void         splitFloat  ( const std::string &str, char sep, std::vector< float >       &values );
+
+// ---------------------  JSON output
+std::string  jsonEscape  ( const std::string &str );
+
+// Minimal streaming JSON writer : keeps track of commas and nesting
+// so the tools can dump their results without any dependency.
+class JsonWriter {
+public:
+	JsonWriter( std::ostream &out );
+
+	void beginObject ( const char *key = NULL );
+	void endObject   ();
+	void beginArray  ( const char *key = NULL );
+	void endArray    ();
+
+	void value ( const char *key, const std::string &val );
+	void value ( const char *key, const char        *val );
+	void value ( const char *key, double             val );
+	void value ( const char *key, long long          val );
+	void value ( const char *key, int                val );
+	void value ( const char *key, bool               val );
+
+private:
+	void separator( const char *key );
+
+	std::ostream       &m_out   ;
+	std::vector<bool>   m_first ;
+};
+
+}
+
+#endif
@@ -0,0 +1,456 @@
+// Copyright (c) 2011 Prime Focus Film.
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions
+// are met:
+//
+// Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+// Redistributions in binary form must reproduce the above copyright
+// notice, this list of conditions and the following disclaimer in the
+// documentation and/or other materials provided with the
+// distribution. Neither the name of Prime Focus Film nor the
+// names of its contributors may be used to endorse or promote
+// products derived from this software without specific prior written
+// permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+// FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+// COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+// INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+// HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+// OF THE POSSIBILITY OF SUCH DAMAGE.
+
+
+// field3d_analyze : scans a cache sequence and reports, per frame and channel,
+// the value range, the voxels and sparse blocks a sparse format would keep,
+// the error of half floats, and the projected size and decode time of every
+// cache format, along with a recommendation per channel. Files are scanned
+// in parallel on every core. Results are reported as JSON.
+//
+// usage :
+//     field3d_analyze [--threads N] [--half-tolerance 0.001]
+//                     [--decode-weight 0.25] [--output report.json]
+//                     file.f3d [file.f3d ...]
+
+#include "field3D_Tools.h"
+#include "cli_Tools.h"
+#include "layer_Tools.h"
+
+#include <OpenEXR/IlmThreadPool.h>
+
+#include <unistd.h>
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <set>
+
+using namespace std;
+
+
+// ------------------------------------------- FORMATS
+
+struct AnalyzeFormat {
+	const char                      *name     ;
+	Field3DTools::FieldTypeEnum      type     ;
+	Field3DTools::FieldDataTypeEnum  dataType ;
+};
+
+static const AnalyzeFormat FORMATS[] = {
+	{ "dense-half"   , Field3DTools::DENSE  , Field3DTools::HALF  },
+	{ "dense-float"  , Field3DTools::DENSE  , Field3DTools::FLOAT },
+	{ "sparse-half"  , Field3DTools::SPARSE , Field3DTools::HALF  },
+	{ "sparse-float" , Field3DTools::SPARSE , Field3DTools::FLOAT }
+};
+static const int NB_FORMATS  = sizeof(FORMATS) / sizeof(FORMATS[0]);
+static const int DENSE_FLOAT = 1;
+
+// largest finite half
+static const float HALF_MAX = 65504.0f;
+
+
+// ------------------------------------------- CALIBRATION
+
+// decode time of each format on this machine, measured on in-memory fields
+// so that the projections don't depend on the disk
+template<typename FieldType>
+static double timeDecode( const typename FieldType::Ptr &field, size_t values ) {
+	vector<float> data(values);
+	double best = 1e30;
+	for(int it=0; it<3; it++) {
+		const double start = CliTools::now();
+		Field3DTools::copyVoxels(*field, &data[0]);
+		best = std::min(best, CliTools::now() - start);
+	}
+	return best * 1e9;
+}
+
+template<typename Data_T>
+static void calibrateType( Field3DTools::FieldDataTypeEnum dataType, Field3DTools::DecodeCost &cost ) {
+
+	const int          RES  = 64;
+	const size_t       N    = (size_t) RES * RES * RES;
+	const Field3D::V3i res(RES, RES, RES);
+
+	typename Field3D::DenseField<Data_T>::Ptr dense(new Field3D::DenseField<Data_T>);
+	dense->setSize(res);
+	for(int k=0; k<RES; k++) for(int j=0; j<RES; j++) for(int i=0; i<RES; i++) dense->fastLValue(i,j,k) = Data_T(1.0f);
+	cost.valueNs[Field3DTools::DENSE][dataType] = timeDecode< Field3D::DenseField<Data_T> >(dense, N) / N;
+
+	// an empty field only pays for its blocks
+	typename Field3D::SparseField<Data_T>::Ptr sparse(new Field3D::SparseField<Data_T>);
+	sparse->setSize(res);
+	const Field3D::V3i blocks = sparse->blockRes();
+	const double       empty  = timeDecode< Field3D::SparseField<Data_T> >(sparse, N);
+	cost.blockNs = empty / std::max(blocks.x * blocks.y * blocks.z, 1);
+
+	for(int k=0; k<RES; k++) for(int j=0; j<RES; j++) for(int i=0; i<RES; i++) sparse->fastLValue(i,j,k) = Data_T(1.0f);
+	cost.valueNs[Field3DTools::SPARSE][dataType] = std::max( timeDecode< Field3D::SparseField<Data_T> >(sparse, N) - empty, 0.0 ) / N;
+}
+
+static void calibrate( Field3DTools::DecodeCost &cost ) {
+	calibrateType<Field3D::half>( Field3DTools::HALF , cost );
+	calibrateType<float>        ( Field3DTools::FLOAT, cost );
+}
+
+
+// ------------------------------------------- ANALYSIS
+
+struct LayerReport {
+	LayerReport() : components(1), minValue(0), maxValue(0), halfAbsError(0), halfRelError(0), halfOverflows(0), recommended(-1) {
+		for(int f=0; f<NB_FORMATS; f++) { bytes[f] = 0; decodeNs[f] = 0; allowed[f] = false; }
+	}
+
+	LayerTools::Layer        layer         ;   // metadata only, values are released
+	int                      components    ;
+	Field3DTools::Occupancy  occupancy     ;
+	float                    minValue      ;
+	float                    maxValue      ;
+	double                   halfAbsError  ;
+	double                   halfRelError  ;   // relative to the largest absolute value
+	long long                halfOverflows ;
+	long long                bytes    [NB_FORMATS];
+	double                   decodeNs [NB_FORMATS];
+	bool                     allowed  [NB_FORMATS];
+	int                      recommended   ;
+};
+
+struct FileReport {
+	FileReport() : ok(false), seconds(0), fileBytes(0) {}
+	string               path      ;
+	bool                 ok        ;
+	string               error     ;
+	double               seconds   ;
+	long long            fileBytes ;
+	vector<LayerReport>  layers    ;
+};
+
+struct Settings {
+	double                    halfTolerance ;
+	double                    decodeWeight  ;
+	Field3DTools::DecodeCost  cost          ;
+};
+
+
+// weighted size and decode time, relative to dense float
+static double formatCost( const LayerReport &report, int f, double decodeWeight ) {
+	return Field3DTools::relativeCost(report.bytes[f], report.decodeNs[f], report.bytes[DENSE_FLOAT], report.decodeNs[DENSE_FLOAT], decodeWeight);
+}
+
+static int recommend( const LayerReport &report, double decodeWeight ) {
+	int best = -1;
+	for(int f=0; f<NB_FORMATS; f++) {
+		if( !report.allowed[f] ) continue;
+		if( best < 0 || formatCost(report, f, decodeWeight) < formatCost(report, best, decodeWeight) ) best = f;
+	}
+	return best;
+}
+
+static void analyzeLayer( LayerTools::Layer &layer, const Settings &settings, LayerReport &report ) {
+
+	const vector<float> &values = layer.values;
+
+	// range and half precision
+	float  maxAbs = 0.0f;
+	report.minValue = values.empty() ? 0.0f : values[0];
+	report.maxValue = report.minValue;
+	for(size_t i=0; i<values.size(); i++) {
+		const float v = values[i];
+		report.minValue = std::min(report.minValue, v);
+		report.maxValue = std::max(report.maxValue, v);
+		maxAbs          = std::max(maxAbs, std::fabs(v));
+		if( std::fabs(v) > HALF_MAX ) {
+			report.halfOverflows++;
+			continue;
+		}
+		const double error = std::fabs( (double) (float) Field3D::half(v) - v );
+		report.halfAbsError = std::max(report.halfAbsError, error);
+	}
+	report.halfRelError = maxAbs > 0.0f ? report.halfAbsError / maxAbs : 0.0;
+
+	// what a sparse writer would keep, MAC channels aren't measured
+	if( layer.kind == LayerTools::SCALAR ) {
+		report.components = 1;
+		Field3DTools::measureOccupancy(layer.res, Field3DTools::SPARSE_BLOCK_ORDER, &values[0], NULL, NULL, report.occupancy);
+	}
+	else if( layer.kind == LayerTools::VECTOR ) {
+		report.components = 3;
+		const size_t count = values.size() / 3;
+		vector<float> a(count), b(count), c(count);
+		for(size_t i=0; i<count; i++) {
+			a[i] = values[3*i  ];
+			b[i] = values[3*i+1];
+			c[i] = values[3*i+2];
+		}
+		Field3DTools::measureOccupancy(layer.res, Field3DTools::SPARSE_BLOCK_ORDER, &a[0], &b[0], &c[0], report.occupancy);
+	}
+	else {
+		report.components         = 1;
+		report.occupancy.voxels   = (long long) values.size();
+		for(size_t i=0; i<values.size(); i++)
+			if( values[i] > Field3DTools::SPARSE_THRESHOLD ) report.occupancy.activeVoxels++;
+	}
+
+	// projections : the plugin only writes scalar channels as sparse fields
+	const bool halfOk = report.halfOverflows == 0 && report.halfRelError <= settings.halfTolerance;
+	for(int f=0; f<NB_FORMATS; f++) {
+		Field3DTools::estimateStorage(report.occupancy, Field3DTools::SPARSE_BLOCK_ORDER, report.components,
+				FORMATS[f].type, FORMATS[f].dataType, settings.cost, report.bytes[f], report.decodeNs[f]);
+		report.allowed[f] = ( FORMATS[f].type == Field3DTools::DENSE || ( layer.kind == LayerTools::SCALAR && report.occupancy.negativeVoxels == 0 ) ) &&
+		                    ( FORMATS[f].dataType == Field3DTools::FLOAT || halfOk );
+	}
+	report.recommended = recommend(report, settings.decodeWeight);
+}
+
+static bool analyzeFile( const Settings &settings, FileReport &report ) {
+
+	Field3D::Field3DInputFile in;
+	if( !LayerTools::openInput(in, report.path) ) {
+		report.error = "can't open the file";
+		return false;
+	}
+
+	vector<LayerTools::LayerId> ids;
+	LayerTools::listLayers(&in, ids);
+
+	bool ok = true;
+	for(size_t i=0; i<ids.size(); i++) {
+		LayerReport layerReport;
+		if( !LayerTools::readLayer(&in, ids[i], layerReport.layer) ) {
+			report.error = "can't read " + ids[i].partition + ":" + ids[i].name;
+			ok = false;
+			continue;
+		}
+		// counted with the file holding its data
+		if( !layerReport.layer.reference.empty() ) continue;
+
+		analyzeLayer(layerReport.layer, settings, layerReport);
+		vector<float>().swap(layerReport.layer.values);
+		report.layers.push_back(layerReport);
+	}
+
+	LayerTools::closeInput(in);
+	return ok;
+}
+
+
+class AnalyzeTask : public IlmThread::Task {
+public:
+	AnalyzeTask( IlmThread::TaskGroup *group, const Settings &settings, FileReport &report ) : IlmThread::Task(group), m_settings(settings), m_report(report) {}
+
+	virtual void execute() {
+		const double start = CliTools::now();
+		m_report.ok        = analyzeFile(m_settings, m_report);
+		m_report.seconds   = CliTools::now() - start;
+	}
+
+private:
+	const Settings  &m_settings ;
+	FileReport      &m_report   ;
+};
+
+
+// ------------------------------------------- OUTPUT
+
+static void writeFormats( CliTools::JsonWriter &json, const LayerReport &report ) {
+	json.beginObject("formats");
+	for(int f=0; f<NB_FORMATS; f++) {
+		json.beginObject(FORMATS[f].name);
+		json.value( "bytes"     , report.bytes[f]            );
+		json.value( "decode_ms" , report.decodeNs[f] * 1e-6  );
+		json.value( "allowed"   , report.allowed[f]          );
+		json.endObject();
+	}
+	json.endObject();
+	json.value( "recommended", report.recommended >= 0 ? FORMATS[report.recommended].name : "none" );
+}
+
+static void writeLayer( CliTools::JsonWriter &json, const LayerReport &report ) {
+	const LayerTools::Layer       &layer = report.layer;
+	const Field3DTools::Occupancy &occ   = report.occupancy;
+
+	json.beginObject();
+	json.value( "partition"        , layer.partition );
+	json.value( "channel"          , layer.name );
+	json.value( "kind"             , LayerTools::kindName(layer.kind) );
+	json.value( "stored_as"        , LayerTools::typeName(layer.type) );
+	json.value( "res_x"            , (int) layer.res[0] );
+	json.value( "res_y"            , (int) layer.res[1] );
+	json.value( "res_z"            , (int) layer.res[2] );
+	json.value( "min"              , (double) report.minValue );
+	json.value( "max"              , (double) report.maxValue );
+	json.value( "active_voxels"    , occ.voxels ? (double) occ.activeVoxels / occ.voxels : 0.0 );
+	json.value( "negative_voxels"  , occ.negativeVoxels );
+	if( layer.kind != LayerTools::MAC ) {
+		json.value( "active_blocks", occ.blocks ? (double) occ.activeBlocks / occ.blocks : 0.0 );
+	}
+	if( layer.totalBlocks ) {
+		json.value( "stored_blocks", (double) layer.allocatedBlocks / layer.totalBlocks );
+	}
+	json.value( "half_abs_error"   , report.halfAbsError  );
+	json.value( "half_rel_error"   , report.halfRelError  );
+	json.value( "half_overflows"   , report.halfOverflows );
+	writeFormats(json, report);
+	json.endObject();
+}
+
+
+// ------------------------------------------- MAIN
+
+int main( int argc, char **argv ) {
+
+	if( argc < 2 || CliTools::hasArg(argc, argv, "--help") || CliTools::hasArg(argc, argv, "-h") ) {
+		cout << "usage : field3d_analyze [--threads N] [--half-tolerance 0.001] [--decode-weight 0.25]" << endl;
+		cout << "                        [--output report.json] file.f3d [file.f3d ...]"                 << endl;
+		return 0;
+	}
+
+	Settings settings;
+	settings.halfTolerance  = atof( CliTools::getArg(argc, argv, "--half-tolerance", "0.001").c_str() );
+	settings.decodeWeight   = atof( CliTools::getArg(argc, argv, "--decode-weight" , "0.25" ).c_str() );
+	settings.decodeWeight   = std::min( std::max(settings.decodeWeight, 0.0), 1.0 );
+	const string outputPath = CliTools::getArg(argc, argv, "--output", "");
+	int threads = atoi( CliTools::getArg(argc, argv, "--threads", "0").c_str() );
+	if( threads < 1 ) threads = std::max( 1L, sysconf(_SC_NPROCESSORS_ONLN) );
+
+	// everything which is neither an option nor the value of an option
+	static const char *WITH_VALUE[] = { "--threads", "--half-tolerance", "--decode-weight", "--output" };
+	set<string> withValue( WITH_VALUE, WITH_VALUE + sizeof(WITH_VALUE) / sizeof(WITH_VALUE[0]) );
+	vector<FileReport> files;
+	for(int i=1; i<argc; i++) {
+		const string arg = argv[i];
+		if( arg.compare(0, 2, "--") == 0 ) {
+			if( withValue.count(arg) ) i++;
+			continue;
+		}
+		FileReport report;
+		report.path      = arg;
+		report.fileBytes = CliTools::fileSize(arg);
+		files.push_back(report);
+	}
+
+	Field3D::initIO();
+	calibrate(settings.cost);
+
+	const double start = CliTools::now();
+	{
+		IlmThread::ThreadPool pool(threads);
+		IlmThread::TaskGroup  group;
+		for(size_t i=0; i<files.size(); i++) {
+			pool.addTask( new AnalyzeTask(&group, settings, files[i]) );
+		}
+	}
+	const double seconds = CliTools::now() - start;
+
+	// whole sequence per channel : sums of the projections, worst errors
+	typedef map< pair<string,string>, LayerReport > ChannelMap;
+	ChannelMap channels;
+	int failures = 0;
+	for(size_t i=0; i<files.size(); i++) {
+		if( !files[i].ok ) failures++;
+		for(size_t l=0; l<files[i].layers.size(); l++) {
+			const LayerReport   &frame = files[i].layers[l];
+			pair<string,string>  key   = make_pair(frame.layer.partition, frame.layer.name);
+			ChannelMap::iterator it    = channels.find(key);
+			if( it == channels.end() ) {
+				channels.insert( make_pair(key, frame) );
+				continue;
+			}
+			LayerReport &total = it->second;
+			total.minValue       = std::min(total.minValue, frame.minValue);
+			total.maxValue       = std::max(total.maxValue, frame.maxValue);
+			total.halfAbsError   = std::max(total.halfAbsError, frame.halfAbsError);
+			total.halfRelError   = std::max(total.halfRelError, frame.halfRelError);
+			total.halfOverflows += frame.halfOverflows;
+			for(int f=0; f<NB_FORMATS; f++) {
+				total.bytes[f]    += frame.bytes[f];
+				total.decodeNs[f] += frame.decodeNs[f];
+				total.allowed[f]   = total.allowed[f] && frame.allowed[f];
+			}
+		}
+	}
+
+	ofstream outputFile;
+	if( !outputPath.empty() ) outputFile.open(outputPath.c_str());
+	ostream &output = outputPath.empty() ? cout : outputFile;
+
+	CliTools::JsonWriter json(output);
+	json.beginObject();
+	json.value      ( "tool"           , "field3d_analyze"      );
+	json.value      ( "threads"        , threads                );
+	json.value      ( "seconds"        , seconds                );
+	json.value      ( "half_tolerance" , settings.halfTolerance );
+	json.value      ( "decode_weight"  , settings.decodeWeight  );
+	json.value      ( "block_order"    , Field3DTools::SPARSE_BLOCK_ORDER );
+
+	json.beginObject( "decode_ns" );
+	for(int f=0; f<NB_FORMATS; f++) json.value( FORMATS[f].name, settings.cost.valueNs[FORMATS[f].type][FORMATS[f].dataType] );
+	json.value      ( "sparse_block", settings.cost.blockNs );
+	json.endObject  ();
+
+	json.beginArray ( "channels" );
+	for(ChannelMap::iterator it=channels.begin(); it!=channels.end(); ++it) {
+		LayerReport &total = it->second;
+		total.recommended  = recommend(total, settings.decodeWeight);
+		json.beginObject();
+		json.value( "partition"      , total.layer.partition );
+		json.value( "channel"        , total.layer.name );
+		json.value( "kind"           , LayerTools::kindName(total.layer.kind) );
+		json.value( "min"            , (double) total.minValue );
+		json.value( "max"            , (double) total.maxValue );
+		json.value( "half_rel_error" , total.halfRelError );
+		writeFormats(json, total);
+		json.endObject();
+	}
+	json.endArray   ();
+
+	json.beginArray ( "frames" );
+	for(size_t i=0; i<files.size(); i++) {
+		const FileReport &file = files[i];
+		json.beginObject();
+		json.value( "file"    , file.path      );
+		json.value( "ok"      , file.ok        );
+		if( !file.error.empty() ) json.value( "error", file.error );
+		json.value( "bytes"   , file.fileBytes );
+		json.value( "seconds" , file.seconds   );
+		json.beginArray("layers");
+		for(size_t l=0; l<file.layers.size(); l++) writeLayer(json, file.layers[l]);
+		json.endArray();
+		json.endObject();
+	}
+	json.endArray   ();
+	json.endObject  ();
+
+	return failures ? 1 : 0;
+}
@@ -0,0 +1,621 @@
+// Copyright (c) 2011 Prime Focus Film.
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions
+// are met:
+//
+// Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+// Redistributions in binary form must reproduce the above copyright
+// notice, this list of conditions and the following disclaimer in the
+// documentation and/or other materials provided with the
+// distribution. Neither the name of Prime Focus Film nor the
+// names of its contributors may be used to endorse or promote
+// products derived from this software without specific prior written
+// permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+// FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+// COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+// INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+// HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+// OF THE POSSIBILITY OF SUCH DAMAGE.
+
+
+// field3d_assemble : merges the per-frame files of a cache into a single
+// container, so renderers and pipelines open and seek one file instead of
+// thousands. Frames are read and validated in parallel, a single writer
+// appends them in frame order. They are copied as they are, at the HDF5 level
+// ( no decoding, no compression again ), and the container is a regular
+// Field3D file :
+//  _ frame labels are the file names without ".f3d", '.' and '@' being
+//    replaced by '_' ( fluidShape1Frame12.f3d => fluidShape1Frame12 )
+//  _ partition "fluid" of a frame becomes "fluid@label"
+//  _ global metadata "name" of a frame becomes "name@label"
+//  _ the frame index is stored as global metadata : "FrameCount" and
+//    "Frame_<i>", the label of the i-th frame
+// The container is written next to the output with a journal of the frames
+// it already holds : an interrupted run resumes where it stopped.
+//
+// usage :
+//     field3d_assemble --container cache.f3d [--threads N]
+//                      [--output result.json] frame.f3d [frame.f3d ...]
+
+#include "field3D_Tools.h"
+#include "cli_Tools.h"
+#include "layer_Tools.h"
+
+#include <OpenEXR/IlmThreadPool.h>
+
+#include <hdf5.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cctype>
+#include <cfloat>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <set>
+#include <sstream>
+
+using namespace std;
+
+// group of the global metadata in Field3D files
+static const char *GLOBAL_METADATA = "field3d_global_metadata";
+
+
+// ------------------------------------------- FRAMES
+
+struct FrameResult {
+	FrameResult() : status("pending"), validated(false), layers(0), bytes(0) {}
+	string     path, label, status, error;
+	bool       validated  ;
+	int        layers     ;
+	long long  bytes      ;
+	string     signature  ;   // partition:layer of every layer
+	set<string> references ;  // files holding its static channels
+};
+
+// file name without extension, '.' and '@' would be read as
+// the separators of the container's names
+static string frameLabel( const string &path ) {
+	string label = path.substr( path.rfind('/') + 1 );
+	if( label.size() > 4 && label.compare(label.size()-4, 4, ".f3d") == 0 ) label.erase(label.size()-4);
+	for(size_t i=0; i<label.size(); i++) {
+		if( label[i] == '.' || label[i] == '@' ) label[i] = '_';
+	}
+	return label;
+}
+
+// frame numbers are compared as numbers : Frame2 < Frame10
+static bool naturalLess( const string &a, const string &b ) {
+	size_t i = 0, j = 0;
+	while( i < a.size() && j < b.size() ) {
+		if( isdigit(a[i]) && isdigit(b[j]) ) {
+			size_t ei = i, ej = j;
+			while( ei < a.size() && isdigit(a[ei]) ) ei++;
+			while( ej < b.size() && isdigit(b[ej]) ) ej++;
+			const long long na = atoll( a.substr(i, ei-i).c_str() );
+			const long long nb = atoll( b.substr(j, ej-j).c_str() );
+			if( na != nb ) return na < nb;
+			i = ei; j = ej;
+		}
+		else {
+			if( a[i] != b[j] ) return a[i] < b[j];
+			i++; j++;
+		}
+	}
+	return a.size() - i < b.size() - j;
+}
+
+static bool validateFrame( FrameResult &frame ) {
+
+	Field3D::Field3DInputFile in;
+	if( !LayerTools::openInput(in, frame.path) ) {
+		frame.error = "can't open the file";
+		return false;
+	}
+
+	vector<LayerTools::LayerId> ids;
+	LayerTools::listLayers(&in, ids);
+	if( ids.empty() ) frame.error = "no layer";
+
+	// decoding every layer catches truncated files, and the simulation
+	// blowing up is checked on the way
+	stringstream signature;
+	for(size_t i=0; i<ids.size() && frame.error.empty(); i++) {
+		LayerTools::Layer layer;
+		if( !LayerTools::readLayer(&in, ids[i], layer) ) {
+			frame.error = "can't read " + ids[i].partition + ":" + ids[i].name;
+			break;
+		}
+		if( !layer.reference.empty() ) frame.references.insert(layer.reference);
+
+		for(size_t v=0; v<layer.values.size(); v++) {
+			const float value = layer.values[v];
+			if( value != value || fabs(value) > FLT_MAX ) {
+				frame.error = "non finite values in " + ids[i].partition + ":" + ids[i].name;
+				break;
+			}
+		}
+		signature << ids[i].partition << ":" << ids[i].name << ";";
+		frame.layers++;
+	}
+
+	LayerTools::closeInput(in);
+	frame.signature = signature.str();
+	return frame.error.empty();
+}
+
+
+// ------------------------------------------- CONTAINER
+
+static herr_t collectLinkName( hid_t, const char *name, const H5L_info_t *, void *names ) {
+	static_cast< vector<string>* >(names)->push_back(name);
+	return 0;
+}
+
+// Field3D names the partition groups "partition" or "partition.N",
+// the label goes before the suffix so the container keeps this layout
+static string containerGroupName( const string &group, const string &label ) {
+	const size_t dot = group.rfind('.');
+	if( dot != string::npos && dot+1 < group.size() && group.find_first_not_of("0123456789", dot+1) == string::npos ) {
+		return group.substr(0, dot) + "@" + label + group.substr(dot);
+	}
+	return group + "@" + label;
+}
+
+static bool readStringAttribute( hid_t location, const string &name, string &value ) {
+	if( H5Aexists(location, name.c_str()) <= 0 ) return false;
+	hid_t attr = H5Aopen(location, name.c_str(), H5P_DEFAULT);
+	if( attr < 0 ) return false;
+	hid_t type = H5Aget_type(attr);
+	bool  ok   = H5Tget_class(type) == H5T_STRING && H5Tis_variable_str(type) <= 0;
+	if( ok ) {
+		vector<char> buffer( H5Tget_size(type) + 1, 0 );
+		ok    = H5Aread(attr, type, &buffer[0]) >= 0;
+		value = &buffer[0];
+	}
+	H5Tclose(type);
+	H5Aclose(attr);
+	return ok;
+}
+
+// attributes are copied with their own type, whatever it is
+static bool copyAttribute( hid_t source, const char *name, hid_t destination, const string &newName ) {
+	hid_t attr  = H5Aopen(source, name, H5P_DEFAULT);
+	if( attr < 0 ) return false;
+	hid_t type  = H5Aget_type (attr);
+	hid_t space = H5Aget_space(attr);
+
+	const hssize_t points = std::max( H5Sget_simple_extent_npoints(space), (hssize_t) 1 );
+	vector<char>   buffer( H5Tget_size(type) * points );
+	bool ok = H5Aread(attr, type, &buffer[0]) >= 0;
+
+	if( ok ) {
+		if( H5Aexists(destination, newName.c_str()) > 0 ) H5Adelete(destination, newName.c_str());
+		hid_t copy = H5Acreate2(destination, newName.c_str(), type, space, H5P_DEFAULT, H5P_DEFAULT);
+		ok = copy >= 0 && H5Awrite(copy, type, &buffer[0]) >= 0;
+		if( copy >= 0 ) H5Aclose(copy);
+	}
+
+	H5Sclose(space);
+	H5Tclose(type);
+	H5Aclose(attr);
+	return ok;
+}
+
+struct MetadataCopy {
+	hid_t   destination ;
+	string  suffix      ;
+	bool    ok          ;
+};
+
+static herr_t copyMetadata( hid_t location, const char *name, const H5A_info_t *, void *data ) {
+	MetadataCopy *copy = static_cast<MetadataCopy *>(data);
+	copy->ok = copyAttribute(location, name, copy->destination, name + copy->suffix) && copy->ok;
+	return 0;
+}
+
+struct MetadataNames {
+	string          suffix ;
+	vector<string>  names  ;
+};
+
+static herr_t collectFrameMetadata( hid_t, const char *name, const H5A_info_t *, void *data ) {
+	MetadataNames *names = static_cast<MetadataNames *>(data);
+	const string   str   = name;
+	if( str.size() > names->suffix.size() && str.compare(str.size() - names->suffix.size(), names->suffix.size(), names->suffix) == 0 ) {
+		names->names.push_back(str);
+	}
+	return 0;
+}
+
+// what an interrupted copy of the frame may have left
+static void removeFrame( hid_t container, const string &label ) {
+	vector<string> groups;
+	hsize_t index = 0;
+	H5Literate(container, H5_INDEX_NAME, H5_ITER_NATIVE, &index, collectLinkName, &groups);
+	for(size_t i=0; i<groups.size(); i++) {
+		const size_t at = groups[i].find('@');
+		if( at == string::npos ) continue;
+		const string rest = groups[i].substr(at+1);
+		if( rest == label || ( rest.compare(0, label.size()+1, label + ".") == 0 ) ) {
+			H5Ldelete(container, groups[i].c_str(), H5P_DEFAULT);
+		}
+	}
+
+	hid_t global = H5Gopen2(container, GLOBAL_METADATA, H5P_DEFAULT);
+	if( global < 0 ) return;
+	MetadataNames names;
+	names.suffix = "@" + label;
+	hsize_t n = 0;
+	H5Aiterate2(global, H5_INDEX_NAME, H5_ITER_NATIVE, &n, collectFrameMetadata, &names);
+	for(size_t i=0; i<names.names.size(); i++) H5Adelete(global, names.names[i].c_str());
+	H5Gclose(global);
+}
+
+// partitions and global metadata of the frame, renamed after its label
+static bool appendFrame( hid_t container, const FrameResult &frame ) {
+
+	Field3DTools::HDF5Lock lock;
+
+	hid_t file = H5Fopen(frame.path.c_str(), H5F_ACC_RDONLY, H5P_DEFAULT);
+	if( file < 0 ) return false;
+
+	vector<string> groups;
+	hsize_t index = 0;
+	H5Literate(file, H5_INDEX_NAME, H5_ITER_NATIVE, &index, collectLinkName, &groups);
+
+	bool ok = true;
+	for(size_t i=0; i<groups.size() && ok; i++) {
+		if( groups[i] != GLOBAL_METADATA ) {
+			const string name = containerGroupName(groups[i], frame.label);
+			ok = H5Ocopy(file, groups[i].c_str(), container, name.c_str(), H5P_DEFAULT, H5P_DEFAULT) >= 0;
+			continue;
+		}
+
+		hid_t source      = H5Gopen2(file     , GLOBAL_METADATA, H5P_DEFAULT);
+		hid_t destination = H5Gopen2(container, GLOBAL_METADATA, H5P_DEFAULT);
+		MetadataCopy copy;
+		copy.destination = destination;
+		copy.suffix      = "@" + frame.label;
+		copy.ok          = source >= 0 && destination >= 0;
+		if( copy.ok ) {
+			hsize_t n = 0;
+			H5Aiterate2(source, H5_INDEX_NAME, H5_ITER_NATIVE, &n, copyMetadata, &copy);
+		}
+		if( source      >= 0 ) H5Gclose(source);
+		if( destination >= 0 ) H5Gclose(destination);
+		ok = copy.ok;
+	}
+	H5Fclose(file);
+
+	// the journal only records frames which made it to the disk
+	return ok && H5Fflush(container, H5F_SCOPE_GLOBAL) >= 0;
+}
+
+// the frame index is written by Field3D, as any other global metadata
+static bool createContainer( const string &path, const vector<FrameResult> &frames ) {
+	Field3D::Field3DOutputFile out;
+	if( !LayerTools::createOutput(out, path) ) return false;
+
+	out.metadata().setStrMetadata("Info", "Field3D frame container ( field3d_assemble )");
+	out.metadata().setIntMetadata("FrameCount", (int) frames.size());
+	for(size_t i=0; i<frames.size(); i++) {
+		stringstream name;
+		name << "Frame_" << i;
+		out.metadata().setStrMetadata(name.str(), frames[i].label);
+	}
+	return LayerTools::closeOutput(out);
+}
+
+// a container left by an interrupted run, for the same frames
+static bool sameFrames( hid_t container, const vector<FrameResult> &frames ) {
+	hid_t global = H5Gopen2(container, GLOBAL_METADATA, H5P_DEFAULT);
+	if( global < 0 ) return false;
+	bool same = true;
+	for(size_t i=0; i<frames.size() && same; i++) {
+		stringstream name;
+		name << "Frame_" << i;
+		string label;
+		same = readStringAttribute(global, name.str(), label) && label == frames[i].label;
+	}
+	stringstream next;
+	next << "Frame_" << frames.size();
+	same = same && H5Aexists(global, next.str().c_str()) <= 0;
+	H5Gclose(global);
+	return same;
+}
+
+
+// ------------------------------------------- ASSEMBLE
+
+// validated frames are handed to the writer in order
+class Assembler {
+public:
+	Assembler() : aborted(false) {
+		pthread_mutex_init(&m_mutex, NULL);
+		pthread_cond_init (&m_ready, NULL);
+	}
+	~Assembler() {
+		pthread_cond_destroy (&m_ready);
+		pthread_mutex_destroy(&m_mutex);
+	}
+
+	vector<FrameResult>  frames  ;
+	volatile bool        aborted ;   // the writer stopped, skip the remaining frames
+
+	void validated( size_t i ) {
+		pthread_mutex_lock(&m_mutex);
+		frames[i].validated = true;
+		pthread_cond_broadcast(&m_ready);
+		pthread_mutex_unlock(&m_mutex);
+	}
+
+	void waitFor( size_t i ) {
+		pthread_mutex_lock(&m_mutex);
+		while( !frames[i].validated ) pthread_cond_wait(&m_ready, &m_mutex);
+		pthread_mutex_unlock(&m_mutex);
+	}
+
+private:
+	pthread_mutex_t  m_mutex ;
+	pthread_cond_t   m_ready ;
+};
+
+
+class ValidateTask : public IlmThread::Task {
+public:
+	ValidateTask( IlmThread::TaskGroup *group, Assembler &assembler, size_t index ) : IlmThread::Task(group), m_assembler(assembler), m_index(index) {}
+
+	virtual void execute() {
+		FrameResult &frame = m_assembler.frames[m_index];
+		if( m_assembler.aborted ) frame.error = "not validated";
+		else if( validateFrame(frame) ) frame.status = "valid";
+		m_assembler.validated(m_index);
+	}
+
+private:
+	Assembler  &m_assembler ;
+	size_t      m_index     ;
+};
+
+
+// everything which is neither an option nor the value of an option
+static void getInputs( int argc, char **argv, vector<string> &inputs ) {
+	static const char *WITH_VALUE[] = { "--container", "--threads", "--output" };
+	set<string> withValue( WITH_VALUE, WITH_VALUE + sizeof(WITH_VALUE) / sizeof(WITH_VALUE[0]) );
+
+	for(int i=1; i<argc; i++) {
+		const string arg = argv[i];
+		if( arg.compare(0, 2, "--") != 0 ) inputs.push_back(arg);
+		else if( withValue.count(arg) ) i++;
+	}
+}
+
+static void readJournal( const string &path, set<string> &done ) {
+	ifstream journal(path.c_str());
+	string   line;
+	while( getline(journal, line) ) {
+		if( !line.empty() ) done.insert(line);
+	}
+}
+
+
+// ------------------------------------------- MAIN
+
+int main( int argc, char **argv ) {
+
+	if( argc < 2 || CliTools::hasArg(argc, argv, "--help") || CliTools::hasArg(argc, argv, "-h") ) {
+		cout << "usage : field3d_assemble --container cache.f3d [--threads N]" << endl;
+		cout << "                         [--output result.json] frame.f3d [frame.f3d ...]" << endl;
+		return 0;
+	}
+
+	const string containerPath = CliTools::getArg(argc, argv, "--container", "");
+	const string outputPath    = CliTools::getArg(argc, argv, "--output"   , "");
+	int threads = atoi( CliTools::getArg(argc, argv, "--threads", "0").c_str() );
+	if( threads < 1 ) threads = std::max( 1L, sysconf(_SC_NPROCESSORS_ONLN) );
+
+	if( containerPath.empty() ) {
+		cerr << "field3d_assemble : --container is mandatory" << endl;
+		return 1;
+	}
+
+	vector<string> inputs;
+	getInputs(argc, argv, inputs);
+	std::sort(inputs.begin(), inputs.end(), naturalLess);
+	if( inputs.empty() ) {
+		cerr << "field3d_assemble : no frame to assemble" << endl;
+		return 1;
+	}
+
+	Assembler assembler;
+	map<string,size_t> frameOfFile;
+	assembler.frames.resize(inputs.size());
+	for(size_t i=0; i<inputs.size(); i++) {
+		FrameResult &frame = assembler.frames[i];
+		frame.path  = inputs[i];
+		frame.label = frameLabel(inputs[i]);
+		frame.bytes = CliTools::fileSize(inputs[i]);
+
+		const string file = inputs[i].substr( inputs[i].rfind('/') + 1 );
+		if( frameOfFile.count(file) ) {
+			cerr << "field3d_assemble : " << file << " is given twice" << endl;
+			return 1;
+		}
+		frameOfFile[file] = i;
+		for(size_t j=0; j<i; j++) {
+			if( assembler.frames[j].label == frame.label ) {
+				cerr << "field3d_assemble : " << inputs[j] << " and " << inputs[i] << " have the same label " << frame.label << endl;
+				return 1;
+			}
+		}
+	}
+
+	Field3D::initIO();
+
+	// resume the container of an interrupted run, if it's still readable
+	// and made of the same frames
+	const string tmpPath     = containerPath + ".tmp";
+	const string journalPath = containerPath + ".journal";
+	set<string> done;
+	hid_t container = -1;
+	bool  resumed   = false;
+	if( CliTools::fileSize(tmpPath) > 0 ) {
+		Field3DTools::HDF5Lock lock;
+		H5E_BEGIN_TRY {
+			container = H5Fopen(tmpPath.c_str(), H5F_ACC_RDWR, H5P_DEFAULT);
+		} H5E_END_TRY;
+		if( container >= 0 && sameFrames(container, assembler.frames) ) {
+			readJournal(journalPath, done);
+			resumed = true;
+		}
+		else if( container >= 0 ) {
+			H5Fclose(container);
+			container = -1;
+		}
+	}
+	if( container < 0 ) {
+		remove(journalPath.c_str());
+		if( !createContainer(tmpPath, assembler.frames) ) {
+			cerr << "field3d_assemble : can't create " << tmpPath << endl;
+			return 1;
+		}
+		Field3DTools::HDF5Lock lock;
+		container = H5Fopen(tmpPath.c_str(), H5F_ACC_RDWR, H5P_DEFAULT);
+		if( container < 0 ) {
+			cerr << "field3d_assemble : can't open " << tmpPath << endl;
+			return 1;
+		}
+	}
+
+	// the frames before the first missing one are in the container
+	size_t first = 0;
+	while( first < assembler.frames.size() && done.count(assembler.frames[first].label) ) {
+		assembler.frames[first].status    = "resumed";
+		assembler.frames[first].validated = true;
+		first++;
+	}
+
+	const double start = CliTools::now();
+	int written = 0;
+	{
+		// the task group waits for all the tasks when it goes out of scope
+		IlmThread::ThreadPool pool(threads);
+		IlmThread::TaskGroup  group;
+		for(size_t i=first; i<assembler.frames.size(); i++) {
+			pool.addTask( new ValidateTask(&group, assembler, i) );
+		}
+
+		ofstream journal(journalPath.c_str(), ios::app);
+		string   signature;
+
+		for(size_t i=first; i<assembler.frames.size(); i++) {
+			assembler.waitFor(i);
+			FrameResult &frame = assembler.frames[i];
+			if( frame.status != "valid" ) {
+				frame.status = "failed";
+				assembler.aborted = true;
+				break;
+			}
+
+			// every frame holds the same fluids and channels
+			if( signature.empty() ) signature = frame.signature;
+			if( frame.signature != signature ) frame.error = "its fluids or channels differ from the previous frames";
+
+			// static channels must come from a frame already in the container
+			for(set<string>::const_iterator it=frame.references.begin(); it!=frame.references.end() && frame.error.empty(); ++it) {
+				map<string,size_t>::const_iterator found = frameOfFile.find(*it);
+				if( found == frameOfFile.end() || found->second >= i ) frame.error = "it references " + *it + " which is not an earlier frame";
+			}
+
+			if( frame.error.empty() ) {
+				// only the frame being written when the run stopped may be partial,
+				// even the first one of the container when its journal is empty
+				if( i == first && resumed ) {
+					Field3DTools::HDF5Lock lock;
+					removeFrame(container, frame.label);
+				}
+				if( !appendFrame(container, frame) ) frame.error = "can't copy it into the container";
+			}
+			if( !frame.error.empty() ) {
+				frame.status = "failed";
+				assembler.aborted = true;
+				break;
+			}
+
+			journal << frame.label << endl;
+			frame.status = "written";
+			written++;
+		}
+	}
+	const double seconds = CliTools::now() - start;
+
+	int failures = 0;
+	for(size_t i=0; i<assembler.frames.size(); i++) {
+		if( assembler.frames[i].status == "failed" ) failures++;
+	}
+
+	{
+		Field3DTools::HDF5Lock lock;
+		H5Fclose(container);
+	}
+
+	// complete : the container replaces the output, the journal is useless
+	if( !failures ) {
+		if( rename(tmpPath.c_str(), containerPath.c_str()) != 0 ) {
+			cerr << "field3d_assemble : can't rename " << tmpPath << endl;
+			failures++;
+		}
+		else {
+			remove(journalPath.c_str());
+		}
+	}
+
+	ofstream outputFile;
+	if( !outputPath.empty() ) outputFile.open(outputPath.c_str());
+	ostream &output = outputPath.empty() ? cout : outputFile;
+
+	CliTools::JsonWriter json(output);
+	json.beginObject();
+	json.value      ( "tool"           , "field3d_assemble" );
+	json.value      ( "container"      , failures ? tmpPath : containerPath );
+	json.value      ( "complete"       , failures == 0 );
+	json.value      ( "threads"        , threads        );
+	json.value      ( "seconds"        , seconds        );
+	json.value      ( "frames"         , (int) assembler.frames.size() );
+	json.value      ( "written"        , written        );
+	json.value      ( "resumed"        , (int) first    );
+	json.value      ( "container_bytes", CliTools::fileSize(failures ? tmpPath : containerPath) );
+	json.value      ( "peak_rss_kb"    , (long long) CliTools::peakRSS() );
+	json.beginArray ( "files" );
+	for(size_t i=0; i<assembler.frames.size(); i++) {
+		const FrameResult &frame = assembler.frames[i];
+		json.beginObject();
+		json.value( "input"  , frame.path   );
+		json.value( "label"  , frame.label  );
+		json.value( "status" , frame.status );
+		if( !frame.error.empty() ) json.value( "error", frame.error );
+		json.value( "layers" , frame.layers );
+		json.value( "bytes"  , frame.bytes  );
+		json.endObject();
+	}
+	json.endArray();
+	json.endObject();
+
+	return failures ? 1 : 0;
+}
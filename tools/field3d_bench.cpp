@@ -0,0 +1,691 @@
+// Copyright (c) 2011 Prime Focus Film.
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions
+// are met:
+//
+// Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+// Redistributions in binary form must reproduce the above copyright
+// notice, this list of conditions and the following disclaimer in the
+// documentation and/or other materials provided with the
+// distribution. Neither the name of Prime Focus Film nor the
+// names of its contributors may be used to endorse or promote
+// products derived from this software without specific prior written
+// permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+// FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+// COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+// INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+// HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+// OF THE POSSIBILITY OF SUCH DAMAGE.
+
+
+// field3d_bench : standalone benchmark of the Field3DTools read and write
+// templates. Synthetic scalar, vector and MAC fluids are generated in memory,
+// written through every cache format and read back, without Maya.
+//
+// Every case is verified : the values read back must match the written ones,
+// exactly for float formats, within half's rounding for half formats, voxels
+// culled by the sparse formats reading as 0, and be stored as the format's
+// field type. Throughput can be checked against a baseline recorded earlier.
+// MAC channels are benched as three sparse layers of faces in the sparse
+// formats unless FIELD3D_SPARSE_VELOCITY is 0, as the plugin writes them.
+// The auto formats pick dense or sparse scalar fields the way the plugin does.
+//
+// Times are checked as ratios to a calibration kernel : the same floats
+// written to and read from a bare HDF5 dataset, so that one baseline holds
+// on machines and disks of any speed.
+//
+// usage :
+//     field3d_bench [--res 64,128,256,96x64x48] [--sparsity 1,0.25,0.05]
+//                   [--kinds scalar,vector,mac]
+//                   [--formats dense-half,dense-float,sparse-half,sparse-float,auto-half,auto-float]
+//                   [--block-orders 3,4,5]
+//                   [--iterations 3] [--dir /tmp] [--output result.json] [--keep]
+//                   [--baseline bench.baseline [--margin 0.25]] [--record-baseline bench.baseline]
+
+#include "field3D_Tools.h"
+#include "field3D_Dispatch.h"
+#include "cli_Tools.h"
+#include "synthetic_Fluid.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <sstream>
+
+#include <hdf5.h>
+
+using namespace std;
+
+
+// ------------------------------------------- FORMATS
+
+struct BenchFormat {
+	const char                      *name     ;
+	Field3DTools::FieldTypeEnum      type     ;
+	Field3DTools::FieldDataTypeEnum  dataType ;
+};
+
+static const BenchFormat FORMATS[] = {
+	{ "dense-half"   , Field3DTools::DENSE  , Field3DTools::HALF  },
+	{ "dense-float"  , Field3DTools::DENSE  , Field3DTools::FLOAT },
+	{ "sparse-half"  , Field3DTools::SPARSE , Field3DTools::HALF  },
+	{ "sparse-float" , Field3DTools::SPARSE , Field3DTools::FLOAT },
+	{ "auto-half"    , Field3DTools::AUTO   , Field3DTools::HALF  },
+	{ "auto-float"   , Field3DTools::AUTO   , Field3DTools::FLOAT }
+};
+static const int NB_FORMATS = sizeof(FORMATS) / sizeof(FORMATS[0]);
+
+enum ChannelKind { SCALAR , VECTOR , MAC };
+
+static const char *kindName( ChannelKind kind ) {
+	switch(kind) {
+		case SCALAR : return "scalar";
+		case VECTOR : return "vector";
+		default     : return "mac";
+	}
+}
+
+static const char *channelName( ChannelKind kind ) {
+	switch(kind) {
+		case SCALAR : return "density";
+		case VECTOR : return "color";
+		default     : return "velocity";
+	}
+}
+
+
+// the format a channel is written with : f3d-auto-* picks dense or sparse
+// scalar fields from their occupancy, and keeps the others dense, as
+// Field3dCacheFormat::writeArray
+static BenchFormat resolveFormat( const BenchFormat &format, ChannelKind kind, const SyntheticFluid::Fluid &fluid, int blockOrder ) {
+	BenchFormat resolved = format;
+	if( format.type != Field3DTools::AUTO ) return resolved;
+
+	resolved.type = Field3DTools::DENSE;
+	if( kind == SCALAR ) {
+		Field3DTools::Occupancy occupancy;
+		Field3DTools::measureOccupancy(fluid.res, blockOrder, &fluid.density[0], NULL, NULL, occupancy);
+		if( Field3DTools::chooseFieldType(occupancy, blockOrder, 1, format.dataType) == Field3DTools::SPARSE ) resolved.type = Field3DTools::SPARSE;
+	}
+	return resolved;
+}
+
+
+// write one channel of the fluid with the same writers
+// as Field3dCacheFormat::writeArray
+static bool writeChannel(
+		Field3D::Field3DOutputFile *out    ,
+		const string               &path   ,
+		const BenchFormat          &format ,
+		ChannelKind                 kind   ,
+		SyntheticFluid::Fluid      &fluid  ,
+		int                         blockOrder
+)
+{
+	double transform[4][4] = {
+			{ 1.0 , 0.0 , 0.0 , 0.0 } ,
+			{ 0.0 , 1.0 , 0.0 , 0.0 } ,
+			{ 0.0 , 0.0 , 1.0 , 0.0 } ,
+			{ 0.0 , 0.0 , 0.0 , 1.0 }
+	};
+
+	const char *name = channelName(kind);
+
+	if( kind == SCALAR ) {
+		Field3DTools::ScalarChannelWriter writer(out, path, "fluid", name, fluid.res, transform, &fluid.density[0], format.type, blockOrder);
+		return Field3DTools::dispatchDataType(format.dataType, writer);
+	}
+
+	// the plugin keeps vector channels dense, the sparse writer is benched on its own
+	if( kind == VECTOR && format.type == Field3DTools::SPARSE ) {
+		const float *a = &fluid.color[0][0], *b = &fluid.color[1][0], *c = &fluid.color[2][0];
+		if( format.dataType == Field3DTools::HALF )
+			return Field3DTools::writeSparseVectorField<Field3D::half>(out, "fluid", name, fluid.res, transform, a, b, c, blockOrder);
+		return Field3DTools::writeSparseVectorField<float>(out, "fluid", name, fluid.res, transform, a, b, c, blockOrder);
+	}
+
+	// velocity culled around the density with FIELD3D_SPARSE_VELOCITY=density
+	const vector<float> *source = kind == VECTOR ? fluid.color : fluid.velocity;
+	const float         *mask   = Field3DTools::sparseVelocity() == Field3DTools::VELOCITY_DENSITY_MASK ? &fluid.density[0] : NULL;
+	Field3DTools::VectorChannelWriter writer(out, path, "fluid", name, fluid.res, transform, &source[0][0], &source[1][0], &source[2][0], kind == MAC,
+	                                         format.type, blockOrder, mask);
+	return Field3DTools::dispatchDataType(format.dataType, writer);
+}
+
+
+// read one channel back, probing the stored type
+// the same way Field3dCacheFormat::readArray does
+static bool readChannel(
+		Field3D::Field3DInputFile *in   ,
+		ChannelKind                kind ,
+		vector<float>             &data ,
+		Field3DTools::SupportedFieldTypeEnum &fieldType
+)
+{
+	const Field3DTools::ChannelLayout layout = kind == SCALAR ? Field3DTools::SCALAR_CHANNEL : ( kind == VECTOR ? Field3DTools::VECTOR_CHANNEL : Field3DTools::MAC_CHANNEL );
+	return Field3DTools::readField(in, "fluid", channelName(kind), layout, &data[0], data.size(), fieldType);
+}
+
+
+// what the channel dedup ( FIELD3D_DEDUP_CHANNELS ) hashes before every
+// write, chained the same way as Field3dCacheFormat::writeReference
+static unsigned long long hashChannel( ChannelKind kind, const SyntheticFluid::Fluid &fluid ) {
+	unsigned long long hash = Field3DTools::contentHash(fluid.res, 3 * sizeof(unsigned int), kind);
+	if( kind == SCALAR ) return Field3DTools::contentHash(&fluid.density[0], fluid.density.size() * sizeof(float), hash);
+
+	const vector<float> *source = kind == VECTOR ? fluid.color : fluid.velocity;
+	for(int c=0; c<3; c++) hash = Field3DTools::contentHash(&source[c][0], source[c].size() * sizeof(float), hash);
+	return hash;
+}
+
+static size_t channelSize( ChannelKind kind, const unsigned int res[3] ) {
+	if( kind == SCALAR ) return size_t(res[0])*res[1]*res[2];
+	if( kind == VECTOR ) return size_t(res[0])*res[1]*res[2]*3;
+	return size_t(res[0]+1)*res[1]*res[2] + size_t(res[0])*(res[1]+1)*res[2] + size_t(res[0])*res[1]*(res[2]+1);
+}
+
+
+// ------------------------------------------- VERIFICATION
+
+struct Verification {
+	Verification() : ok(false), mismatches(0), maxError(0.0) {}
+	bool       ok         ;
+	long long  mismatches ;
+	double     maxError   ;
+};
+
+// the value as the format stores it
+static float storedValue( Field3DTools::FieldDataTypeEnum dataType, float value ) {
+	return dataType == Field3DTools::HALF ? (float) Field3D::half(value) : value;
+}
+
+// largest difference allowed : none for floats, half's rounding otherwise
+// ( 11 significant bits, subnormals spaced by 2^-24 )
+static double tolerance( Field3DTools::FieldDataTypeEnum dataType, float value ) {
+	if( dataType == Field3DTools::FLOAT ) return 0.0;
+	return fabs(value) / 2048.0 + 1.0 / 16777216.0;
+}
+
+// the channel as it reads back, in the layout Field3DTools::readField decodes to :
+// the voxels the sparse writers cull ( same tests on the stored values ) read as 0
+// MAC channels written as sparse layers of faces ( see Field3DTools::writeSparseMACField )
+static bool sparseMAC( const BenchFormat &format, ChannelKind kind ) {
+	return kind == MAC && format.type == Field3DTools::SPARSE && Field3DTools::sparseVelocity() != Field3DTools::VELOCITY_DENSE;
+}
+
+// faces of the culled blocks set to 0, the blocks of each component being
+// taken on the grid of its own faces
+static void cullFaceBlocks( const SyntheticFluid::Fluid &fluid, int blockOrder, vector<float> &values ) {
+	const unsigned int *res  = fluid.res;
+	const float        *mask = Field3DTools::sparseVelocity() == Field3DTools::VELOCITY_DENSITY_MASK ? &fluid.density[0] : NULL;
+	const int           size = 1 << blockOrder;
+
+	float *faces = &values[0];
+	for(int axis=0; axis<3; axis++) {
+		const int sx = res[0] + (axis == 0), sy = res[1] + (axis == 1), sz = res[2] + (axis == 2);
+		const int bx = (sx + size - 1) / size, by = (sy + size - 1) / size, bz = (sz + size - 1) / size;
+
+		// same tests as the writer
+		vector<char> keep( (size_t) bx * by * bz, 0 );
+		for(int k=0; k<sz; k++)
+			for(int j=0; j<sy; j++)
+				for(int i=0; i<sx; i++) {
+					const bool on = mask ? Field3DTools::faceMasked(mask, res, i, j, k, axis)
+					                     : fabs( faces[i + (size_t) sx * ( j + (size_t) sy * k )] ) > Field3DTools::SPARSE_THRESHOLD;
+					if( on ) keep[ (i >> blockOrder) + bx * ( (j >> blockOrder) + (size_t) by * (k >> blockOrder) ) ] = 1;
+				}
+
+		for(int k=0; k<sz; k++)
+			for(int j=0; j<sy; j++)
+				for(int i=0; i<sx; i++) {
+					if( !keep[ (i >> blockOrder) + bx * ( (j >> blockOrder) + (size_t) by * (k >> blockOrder) ) ] )
+						faces[i + (size_t) sx * ( j + (size_t) sy * k )] = 0.0f;
+				}
+
+		faces += fluid.velocity[axis].size();
+	}
+}
+
+static void expectedChannel( const BenchFormat &format, ChannelKind kind, const SyntheticFluid::Fluid &fluid, int blockOrder, vector<float> &values ) {
+	const bool   sparse = format.type == Field3DTools::SPARSE;
+	const size_t voxels = size_t(fluid.res[0])*fluid.res[1]*fluid.res[2];
+
+	if( kind == SCALAR ) {
+		values = fluid.density;
+		if( !sparse ) return;
+		for(size_t i=0; i<voxels; i++) {
+			if( !( storedValue(format.dataType, values[i]) > Field3DTools::SPARSE_THRESHOLD ) ) values[i] = 0.0f;
+		}
+		return;
+	}
+
+	if( kind == VECTOR ) {
+		values.resize(voxels*3);
+		for(size_t i=0; i<voxels; i++) {
+			const float a = storedValue(format.dataType, fluid.color[0][i]);
+			const float b = storedValue(format.dataType, fluid.color[1][i]);
+			const float c = storedValue(format.dataType, fluid.color[2][i]);
+			const bool  kept = !sparse || a*a + b*b + c*c > Field3DTools::SPARSE_THRESHOLD;
+			for(int k=0; k<3; k++) values[3*i+k] = kept ? fluid.color[k][i] : 0.0f;
+		}
+		return;
+	}
+
+	// MAC faces u, v then w
+	values.clear();
+	for(int k=0; k<3; k++) values.insert(values.end(), fluid.velocity[k].begin(), fluid.velocity[k].end());
+	if( sparseMAC(format, kind) ) cullFaceBlocks(fluid, blockOrder, values);
+}
+
+static void verifyChannel( const vector<float> &expected, const vector<float> &values, Field3DTools::FieldDataTypeEnum dataType, Verification &verification ) {
+	verification.mismatches = expected.size() == values.size() ? 0 : 1;
+	verification.maxError   = 0.0;
+	for(size_t i=0; i<expected.size() && i<values.size(); i++) {
+		const double error = fabs( (double) values[i] - expected[i] );
+		if( !( error <= tolerance(dataType, expected[i]) ) ) verification.mismatches++;
+		if( !( error <= verification.maxError ) ) verification.maxError = error;
+	}
+	verification.ok = verification.mismatches == 0;
+}
+
+// the field type each format writes, the half, float and double
+// variants of a class following each other
+static Field3DTools::SupportedFieldTypeEnum expectedType( const BenchFormat &format, ChannelKind kind ) {
+	using namespace Field3DTools;
+	const bool sparse = format.type == SPARSE;
+	int type = sparseMAC(format, kind) ? SparseScalarField_Half : MACField_Half;
+	if( kind == SCALAR ) type = sparse ? SparseScalarField_Half : DenseScalarField_Half;
+	if( kind == VECTOR ) type = sparse ? SparseVectorField_Half : DenseVectorField_Half;
+	return (SupportedFieldTypeEnum) ( type + ( format.dataType == HALF ? 0 : 1 ) );
+}
+
+
+// ------------------------------------------- BASELINES
+
+// times of the read and the write of a case, over the calibration's ones
+struct Budget {
+	Budget() : readRatio(0.0), writeRatio(0.0) {}
+	double readRatio  ;
+	double writeRatio ;
+};
+typedef map<string,Budget> Baseline;
+
+static string caseKey( ChannelKind kind, const BenchFormat &format, const unsigned int res[3], float sparsity, int blockOrder ) {
+	stringstream key;
+	key << kindName(kind) << " " << format.name << " " << res[0] << "x" << res[1] << "x" << res[2] << " " << sparsity << " " << blockOrder;
+	return key.str();
+}
+
+// one case per line : kind format resolution sparsity block_order read_ratio write_ratio,
+// '#' starts a comment
+static bool loadBaseline( const string &path, Baseline &baseline ) {
+	ifstream file(path.c_str());
+	if( !file ) return false;
+
+	string line;
+	while( getline(file, line) ) {
+		if( line.empty() || line[0] == '#' ) continue;
+		stringstream fields(line);
+		string kind, format, res, sparsity, blockOrder;
+		Budget budget;
+		if( !( fields >> kind >> format >> res >> sparsity >> blockOrder >> budget.readRatio >> budget.writeRatio ) ) {
+			WARNING( "Ignoring baseline line : " + line );
+			continue;
+		}
+		baseline[kind + " " + format + " " + res + " " + sparsity + " " + blockOrder] = budget;
+	}
+	return true;
+}
+
+static bool saveBaseline( const string &path, const Baseline &baseline ) {
+	ofstream file(path.c_str());
+	if( !file ) return false;
+
+	file << "# field3d_bench baseline, times over the calibration's : kind format resolution sparsity block_order read_ratio write_ratio" << endl;
+	for(Baseline::const_iterator it=baseline.begin(); it!=baseline.end(); ++it) {
+		file << it->first << " " << it->second.readRatio << " " << it->second.writeRatio << endl;
+	}
+	return file.good();
+}
+
+
+// ------------------------------------------- CALIBRATION
+
+// the floor of a case : the floats of the channel written to a new HDF5 file
+// as one plain dataset, then read back, without Field3D. Best of all iterations
+struct Calibration {
+	double writeTime ;
+	double readTime  ;
+};
+
+static bool calibrate( const string &path, size_t values, int iterations, Calibration &calibration ) {
+	calibration.writeTime = 1e30;
+	calibration.readTime  = 1e30;
+
+	vector<float> data(values, 0.5f), readBack(values);
+	hsize_t dims[1] = { values };
+	bool ok = true;
+
+	for(int it=0; it<iterations && ok; it++) {
+		double start = CliTools::now();
+		hid_t file = H5Fcreate(path.c_str(), H5F_ACC_TRUNC, H5P_DEFAULT, H5P_DEFAULT);
+		if( file < 0 ) return false;
+		hid_t space   = H5Screate_simple(1, dims, NULL);
+		hid_t dataset = H5Dcreate2(file, "data", H5T_NATIVE_FLOAT, space, H5P_DEFAULT, H5P_DEFAULT, H5P_DEFAULT);
+		ok = dataset >= 0 && H5Dwrite(dataset, H5T_NATIVE_FLOAT, H5S_ALL, H5S_ALL, H5P_DEFAULT, &data[0]) >= 0;
+		if( dataset >= 0 ) H5Dclose(dataset);
+		H5Sclose(space);
+		H5Fclose(file);
+		calibration.writeTime = min( calibration.writeTime, CliTools::now() - start );
+		if( !ok ) break;
+
+		start = CliTools::now();
+		file = H5Fopen(path.c_str(), H5F_ACC_RDONLY, H5P_DEFAULT);
+		if( file < 0 ) { ok = false; break; }
+		dataset = H5Dopen2(file, "data", H5P_DEFAULT);
+		ok = dataset >= 0 && H5Dread(dataset, H5T_NATIVE_FLOAT, H5S_ALL, H5S_ALL, H5P_DEFAULT, &readBack[0]) >= 0;
+		if( dataset >= 0 ) H5Dclose(dataset);
+		H5Fclose(file);
+		calibration.readTime = min( calibration.readTime, CliTools::now() - start );
+	}
+
+	remove(path.c_str());
+	return ok;
+}
+
+
+// ------------------------------------------- BENCHMARK
+
+struct CaseResult {
+	bool       ok         ;
+	double     writeTime  ;   // best of all iterations, in seconds
+	double     readTime   ;
+	double     hashTime   ;
+	long long  fileBytes  ;
+	Field3DTools::SupportedFieldTypeEnum storedType ;
+	Verification                         verification ;
+};
+
+
+static CaseResult runCase(
+		const BenchFormat     &format     ,
+		ChannelKind            kind       ,
+		SyntheticFluid::Fluid &fluid      ,
+		const string          &path       ,
+		int                    iterations ,
+		int                    blockOrder
+)
+{
+	CaseResult result;
+	result.ok         = true;
+	result.writeTime  = 1e30;
+	result.readTime   = 1e30;
+	result.hashTime   = 1e30;
+	result.fileBytes  = -1;
+	result.storedType = Field3DTools::TypeUnsupported;
+
+	vector<float> readBack;
+
+	for(int it=0; it<iterations && result.ok; it++) {
+
+		// write : file creation and close are part of the measure
+		// since Maya pays for them on every frame
+		double start = CliTools::now();
+		{
+			Field3D::Field3DOutputFile out;
+			if( !out.create(path) ) {
+				ERROR( "Failed to create " + path );
+				result.ok = false;
+				break;
+			}
+			result.ok = writeChannel(&out, path, format, kind, fluid, blockOrder);
+			out.close();
+		}
+		result.writeTime = min( result.writeTime, CliTools::now() - start );
+		if( !result.ok ) break;
+
+		// read
+		readBack.assign( channelSize(kind, fluid.res), 0.0f );
+		start = CliTools::now();
+		{
+			Field3D::Field3DInputFile in;
+			if( !in.open(path) ) {
+				ERROR( "Failed to open " + path );
+				result.ok = false;
+				break;
+			}
+			result.ok = readChannel(&in, kind, readBack, result.storedType);
+			in.close();
+		}
+		result.readTime = min( result.readTime, CliTools::now() - start );
+
+		// hash, as the dedup does on every write
+		start = CliTools::now();
+		volatile unsigned long long hash = hashChannel(kind, fluid);
+		(void) hash;
+		result.hashTime = min( result.hashTime, CliTools::now() - start );
+	}
+
+	// the last values read back
+	if( result.ok ) {
+		vector<float> expected;
+		expectedChannel(format, kind, fluid, blockOrder, expected);
+		verifyChannel(expected, readBack, format.dataType, result.verification);
+		if( result.storedType != expectedType(format, kind) ) result.verification.ok = false;
+	}
+
+	result.fileBytes = CliTools::fileSize(path);
+	return result;
+}
+
+
+// "64" for a cubic container, "96x64x48" otherwise
+static bool parseResolution( const string &str, unsigned int res[3] ) {
+	vector<int> sizes;
+	CliTools::splitInt(str, 'x', sizes);
+	if( sizes.size() == 1 ) sizes.assign(3, sizes[0]);
+	if( sizes.size() != 3 ) return false;
+	for(int c=0; c<3; c++) {
+		if( sizes[c] < 1 ) return false;
+		res[c] = (unsigned int) sizes[c];
+	}
+	return true;
+}
+
+
+static void writeTiming( CliTools::JsonWriter &json, const char *key, double seconds, double megaBytes, size_t voxels ) {
+	json.beginObject(key);
+	json.value( "seconds"      , seconds                  );
+	json.value( "mb_per_s"     , megaBytes / seconds      );
+	json.value( "ns_per_voxel" , seconds * 1e9 / voxels   );
+	json.endObject();
+}
+
+
+int main( int argc, char **argv ) {
+
+	if( CliTools::hasArg(argc, argv, "--help") || CliTools::hasArg(argc, argv, "-h") ) {
+		cout << "usage : field3d_bench [--res 64,128,256,96x64x48] [--sparsity 1,0.25,0.05] [--kinds scalar,vector,mac]" << endl;
+		cout << "                      [--formats dense-half,dense-float,sparse-half,sparse-float,auto-half,auto-float]" << endl;
+		cout << "                      [--block-orders 3,4,5]"                                               << endl;
+		cout << "                      [--iterations 3] [--dir /tmp] [--output result.json] [--keep]"       << endl;
+		cout << "                      [--baseline bench.baseline [--margin 0.25]] [--record-baseline bench.baseline]" << endl;
+		return 0;
+	}
+
+	vector<int>    blockOrders;
+	vector<float>  sparsities;
+	vector<string> resolutions, kinds, formats;
+	CliTools::split      ( CliTools::getArg(argc, argv, "--res"      , "64,128,256"                                   ), ',', resolutions );
+	CliTools::splitFloat ( CliTools::getArg(argc, argv, "--sparsity" , "1,0.25,0.05"                                  ), ',', sparsities  );
+	CliTools::split      ( CliTools::getArg(argc, argv, "--kinds"    , "scalar,vector,mac"                            ), ',', kinds       );
+	CliTools::split      ( CliTools::getArg(argc, argv, "--formats"  , "dense-half,dense-float,sparse-half,sparse-float,auto-half,auto-float"), ',', formats );
+	CliTools::splitInt   ( CliTools::getArg(argc, argv, "--block-orders", "4"                                       ), ',', blockOrders );
+	if( blockOrders.empty() ) blockOrders.push_back(Field3DTools::SPARSE_BLOCK_ORDER);
+	int    iterations   = atoi( CliTools::getArg(argc, argv, "--iterations", "3").c_str() );
+	string directory    = CliTools::getArg(argc, argv, "--dir"   , "/tmp" );
+	string outputPath   = CliTools::getArg(argc, argv, "--output", ""     );
+	bool   keepFiles    = CliTools::hasArg(argc, argv, "--keep");
+	string baselinePath = CliTools::getArg(argc, argv, "--baseline"       , "" );
+	string recordPath   = CliTools::getArg(argc, argv, "--record-baseline", "" );
+	double margin       = atof( CliTools::getArg(argc, argv, "--margin", "0.25").c_str() );
+
+	if( iterations < 1 ) iterations = 1;
+
+	// throughput budgets of the cases, a case missing from it isn't checked
+	Baseline baseline, recorded;
+	if( !baselinePath.empty() && !loadBaseline(baselinePath, baseline) ) {
+		ERROR( "Failed to read the baseline " + baselinePath );
+		return 1;
+	}
+
+	Field3D::initIO();
+
+	ofstream outputFile;
+	if( !outputPath.empty() ) outputFile.open(outputPath.c_str());
+	ostream &output = outputPath.empty() ? cout : outputFile;
+
+	CliTools::JsonWriter json(output);
+	json.beginObject();
+	json.value      ( "benchmark"  , "field3d_bench" );
+	json.value      ( "iterations" , iterations      );
+	json.beginArray ( "results" );
+
+	int failures = 0;
+
+	for(size_t r=0; r<resolutions.size(); r++) {
+		for(size_t s=0; s<sparsities.size(); s++) {
+
+			unsigned int res[3];
+			if( !parseResolution(resolutions[r], res) ) {
+				ERROR( "Invalid resolution " + resolutions[r] );
+				failures++;
+				break;
+			}
+			SyntheticFluid::Fluid fluid;
+			SyntheticFluid::make(res, sparsities[s], fluid);
+
+			for(size_t k=0; k<kinds.size(); k++) {
+
+				ChannelKind kind = SCALAR;
+				if     ( kinds[k] == "vector" ) kind = VECTOR;
+				else if( kinds[k] == "mac"    ) kind = MAC;
+				else if( kinds[k] != "scalar" ) { ERROR( "Unknown kind " + kinds[k] ); continue; }
+
+				Calibration calibration;
+				if( !calibrate(directory + "/field3d_bench_calibration.h5", channelSize(kind, res), iterations, calibration) ) {
+					ERROR( "Failed to write the calibration file in " + directory );
+					failures++;
+					continue;
+				}
+
+				for(int f=0; f<NB_FORMATS; f++) {
+
+					if( find(formats.begin(), formats.end(), string(FORMATS[f].name)) == formats.end() ) continue;
+
+					// sparse scalar and MAC fields are run with every block order,
+					// auto scalar ones too as the block order changes their pick
+					const bool sparse = ( FORMATS[f].type == Field3DTools::SPARSE && ( kind == SCALAR || sparseMAC(FORMATS[f], kind) ) ) ||
+					                    ( FORMATS[f].type == Field3DTools::AUTO   && kind == SCALAR );
+					for(size_t o=0; o<( sparse ? blockOrders.size() : 1 ); o++) {
+
+						const int         blockOrder = sparse ? blockOrders[o] : Field3DTools::SPARSE_BLOCK_ORDER;
+						const BenchFormat format     = resolveFormat(FORMATS[f], kind, fluid, blockOrder);
+
+						stringstream path;
+						path << directory << "/field3d_bench_" << kindName(kind) << "_" << FORMATS[f].name << "_" << res[0] << "x" << res[1] << "x" << res[2] << "_" << sparsities[s] << "_" << blockOrder << ".f3d";
+
+						CaseResult result = runCase(format, kind, fluid, path.str(), iterations, blockOrder);
+						if( !keepFiles ) remove(path.str().c_str());
+
+						size_t voxels    = size_t(res[0])*res[1]*res[2];
+						double megaBytes = channelSize(kind, res) * sizeof(float) / ( 1024.0 * 1024.0 );
+
+						stringstream resStr;
+						resStr << res[0] << "x" << res[1] << "x" << res[2];
+
+						json.beginObject();
+						json.value ( "kind"         , kindName(kind)        );
+						json.value ( "format"       , FORMATS[f].name       );
+						json.value ( "resolution"   , resStr.str()          );
+						json.value ( "sparsity"     , (double) sparsities[s]);
+						json.value ( "occupancy"    , fluid.occupancy       );
+						if( sparse ) json.value( "block_order", blockOrder );
+						json.value ( "ok"           , result.ok             );
+						json.value ( "source_bytes" , (long long) ( channelSize(kind, res) * sizeof(float) ) );
+						json.value ( "file_bytes"   , result.fileBytes      );
+
+						bool passed = result.ok;
+						if( result.ok ) {
+							writeTiming( json, "write", result.writeTime, megaBytes, voxels );
+							writeTiming( json, "read" , result.readTime , megaBytes, voxels );
+							writeTiming( json, "hash" , result.hashTime , megaBytes, voxels );
+							writeTiming( json, "calibration_write", calibration.writeTime, megaBytes, voxels );
+							writeTiming( json, "calibration_read" , calibration.readTime , megaBytes, voxels );
+
+							json.value      ( "stored_as"  , Field3DTools::fieldTypeName(result.storedType) );
+							json.beginObject( "verify" );
+							json.value      ( "ok"         , result.verification.ok         );
+							json.value      ( "mismatches" , result.verification.mismatches );
+							json.value      ( "max_error"  , result.verification.maxError   );
+							json.endObject  ();
+							passed = result.verification.ok;
+
+							// throughput, against the baseline
+							const string key = caseKey(kind, FORMATS[f], res, sparsities[s], blockOrder);
+							Budget measured;
+							measured.readRatio  = result.readTime  / calibration.readTime;
+							measured.writeRatio = result.writeTime / calibration.writeTime;
+							recorded[key] = measured;
+							json.value( "read_ratio"  , measured.readRatio  );
+							json.value( "write_ratio" , measured.writeRatio );
+
+							Baseline::const_iterator budget = baseline.find(key);
+							if( budget != baseline.end() ) {
+								const bool inBudget = measured.readRatio  <= budget->second.readRatio  * ( 1.0 + margin ) &&
+								                      measured.writeRatio <= budget->second.writeRatio * ( 1.0 + margin );
+								json.beginObject( "budget" );
+								json.value      ( "read_ratio"  , budget->second.readRatio  );
+								json.value      ( "write_ratio" , budget->second.writeRatio );
+								json.value      ( "ok"          , inBudget                  );
+								json.endObject  ();
+								passed = passed && inBudget;
+							}
+						}
+						json.value ( "peak_rss_kb"  , (long long) CliTools::peakRSS() );
+						json.endObject();
+
+						if( !passed ) failures++;
+					}
+				}
+			}
+		}
+	}
+
+	json.endArray();
+	json.value( "failures", failures );
+	json.endObject();
+
+	if( !recordPath.empty() && !saveBaseline(recordPath, recorded) ) {
+		ERROR( "Failed to write the baseline " + recordPath );
+		return 1;
+	}
+
+	return failures ? 1 : 0;
+}
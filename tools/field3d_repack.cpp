@@ -0,0 +1,368 @@
+// Copyright (c) 2011 Prime Focus Film.
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions
+// are met:
+//
+// Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+// Redistributions in binary form must reproduce the above copyright
+// notice, this list of conditions and the following disclaimer in the
+// documentation and/or other materials provided with the
+// distribution. Neither the name of Prime Focus Film nor the
+// names of its contributors may be used to endorse or promote
+// products derived from this software without specific prior written
+// permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+// FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+// COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+// INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+// HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+// OF THE POSSIBILITY OF SUCH DAMAGE.
+
+
+// field3d_repack : offline conversion of existing Field3D caches between the
+// cache formats ( dense/sparse, half/float ), without Maya. Files are repacked
+// in parallel on every core within a memory budget. Each converted file is
+// recorded in a job list, so an interrupted run resumes where it stopped.
+//
+// usage :
+//     field3d_repack --format sparse-half --output-dir DIR
+//                    [--threads N] [--memory 4096] [--jobs repack.jobs]
+//                    [--output result.json] file.f3d [file.f3d ...]
+
+#include "field3D_Tools.h"
+#include "field3D_FieldPool.h"
+#include "cli_Tools.h"
+#include "layer_Tools.h"
+
+#include <OpenEXR/IlmThreadPool.h>
+#include <OpenEXR/IlmThreadMutex.h>
+
+#include <pthread.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <set>
+
+using namespace std;
+
+
+// ------------------------------------------- MEMORY BUDGET
+
+// Jobs wait until their estimated memory fits in the budget.
+// A job bigger than the whole budget runs alone.
+class MemoryBudget {
+public:
+	MemoryBudget( long long bytes ) : m_total(bytes), m_used(0) {
+		pthread_mutex_init(&m_mutex, NULL);
+		pthread_cond_init (&m_freed, NULL);
+	}
+	~MemoryBudget() {
+		pthread_cond_destroy (&m_freed);
+		pthread_mutex_destroy(&m_mutex);
+	}
+
+	// returns the amount actually reserved, to give back to release()
+	long long acquire( long long bytes ) {
+		bytes = std::min(bytes, m_total);
+		pthread_mutex_lock(&m_mutex);
+		while( m_used > 0 && m_used + bytes > m_total ) pthread_cond_wait(&m_freed, &m_mutex);
+		m_used += bytes;
+		pthread_mutex_unlock(&m_mutex);
+		return bytes;
+	}
+
+	void release( long long bytes ) {
+		pthread_mutex_lock(&m_mutex);
+		m_used -= bytes;
+		pthread_cond_broadcast(&m_freed);
+		pthread_mutex_unlock(&m_mutex);
+	}
+
+private:
+	long long        m_total ;
+	long long        m_used  ;
+	pthread_mutex_t  m_mutex ;
+	pthread_cond_t   m_freed ;
+};
+
+
+// ------------------------------------------- REPACK
+
+struct RepackResult {
+	RepackResult() : status("failed"), seconds(0), inputBytes(0), outputBytes(0), layers(0), peakBytes(0) {}
+	string     input, output, status, error;
+	double     seconds     ;
+	long long  inputBytes  ;
+	long long  outputBytes ;
+	int        layers      ;
+	long long  peakBytes   ;   // biggest decoded layer
+};
+
+struct Repacker {
+	Repacker( long long memory ) : budget(memory), ratio(16.0) {}
+
+	Field3DTools::FieldTypeEnum      type      ;
+	Field3DTools::FieldDataTypeEnum  dataType  ;
+	string                           jobsPath  ;
+	MemoryBudget                     budget    ;
+	vector<RepackResult>             results   ;
+
+	// memory used per byte of input, learned from the files already done
+	double estimate( long long inputBytes ) {
+		IlmThread::Lock lock(mutex);
+		return ratio * std::max(inputBytes, 1LL);
+	}
+	void learn( long long inputBytes, long long peakBytes ) {
+		IlmThread::Lock lock(mutex);
+		ratio = std::max(ratio, (double) peakBytes / std::max(inputBytes, 1LL));
+	}
+	void recordDone( const string &input ) {
+		if( jobsPath.empty() ) return;
+		IlmThread::Lock lock(mutex);
+		ofstream jobs(jobsPath.c_str(), ios::app);
+		jobs << input << "\n";
+	}
+
+private:
+	IlmThread::Mutex  mutex ;
+	double            ratio ;
+};
+
+
+static bool repackFile( Repacker &repacker, RepackResult &result ) {
+
+	Field3D::Field3DInputFile in;
+	if( !LayerTools::openInput(in, result.input) ) {
+		result.error = "can't open the input file";
+		return false;
+	}
+
+	vector<LayerTools::LayerId> ids;
+	LayerTools::listLayers(&in, ids);
+
+	// written next to the output and renamed once complete,
+	// so a killed job never leaves a truncated cache behind
+	const string tmpPath = result.output + ".tmp";
+	Field3D::Field3DOutputFile out;
+	if( !LayerTools::createOutput(out, tmpPath) ) {
+		result.error = "can't create the output file";
+		LayerTools::closeInput(in);
+		return false;
+	}
+
+	// fields and staging buffers are reused from a layer to the next
+	Field3DTools::FieldPool       pool;
+	Field3DTools::ScopedFieldPool scopedPool(pool);
+
+	bool ok = true;
+	for(size_t i=0; i<ids.size() && ok; i++) {
+		LayerTools::Layer layer;
+		if( !LayerTools::readLayer(&in, ids[i], layer) ) {
+			result.error = "can't read " + ids[i].partition + ":" + ids[i].name;
+			ok = false;
+			break;
+		}
+
+		// decoded floats + the converted field
+		result.peakBytes = std::max(result.peakBytes, (long long) ( layer.values.size() * 2 * sizeof(float) ));
+
+		if( !LayerTools::writeLayer(&out, tmpPath, layer, repacker.type, repacker.dataType) ) {
+			result.error = "can't write " + ids[i].partition + ":" + ids[i].name;
+			ok = false;
+			break;
+		}
+		result.layers++;
+	}
+
+	if( ok ) LayerTools::copyGlobalMetadata(&in, &out);
+	ok = LayerTools::closeOutput(out) && ok;
+	LayerTools::closeInput(in);
+
+	if( !ok ) {
+		if( result.error.empty() ) result.error = "can't write the global metadata";
+		remove(tmpPath.c_str());
+		return false;
+	}
+	if( rename(tmpPath.c_str(), result.output.c_str()) != 0 ) {
+		result.error = "can't rename " + tmpPath;
+		remove(tmpPath.c_str());
+		return false;
+	}
+	return true;
+}
+
+
+class RepackTask : public IlmThread::Task {
+public:
+	RepackTask( IlmThread::TaskGroup *group, Repacker &repacker, size_t index ) : IlmThread::Task(group), m_repacker(repacker), m_index(index) {}
+
+	virtual void execute() {
+		RepackResult &result = m_repacker.results[m_index];
+
+		const long long reserved = m_repacker.budget.acquire( (long long) m_repacker.estimate(result.inputBytes) );
+		const double    start    = CliTools::now();
+
+		if( repackFile(m_repacker, result) ) {
+			result.status      = "ok";
+			result.outputBytes = CliTools::fileSize(result.output);
+			m_repacker.learn(result.inputBytes, result.peakBytes);
+			m_repacker.recordDone(result.input);
+		}
+		result.seconds = CliTools::now() - start;
+
+		m_repacker.budget.release(reserved);
+	}
+
+private:
+	Repacker  &m_repacker ;
+	size_t     m_index    ;
+};
+
+
+// ------------------------------------------- ARGUMENTS
+
+// everything which is neither an option nor the value of an option
+static void getInputs( int argc, char **argv, vector<string> &inputs ) {
+	static const char *WITH_VALUE[] = { "--format", "--output-dir", "--threads", "--memory", "--jobs", "--output" };
+	set<string> withValue( WITH_VALUE, WITH_VALUE + sizeof(WITH_VALUE) / sizeof(WITH_VALUE[0]) );
+
+	for(int i=1; i<argc; i++) {
+		const string arg = argv[i];
+		if( arg.compare(0, 2, "--") != 0 ) inputs.push_back(arg);
+		else if( withValue.count(arg) ) i++;
+	}
+}
+
+static void readJobs( const string &path, set<string> &done ) {
+	ifstream jobs(path.c_str());
+	string   line;
+	while( getline(jobs, line) ) {
+		if( !line.empty() ) done.insert(line);
+	}
+}
+
+static string baseName( const string &path ) {
+	return path.substr( path.rfind('/') + 1 );
+}
+
+
+// ------------------------------------------- MAIN
+
+int main( int argc, char **argv ) {
+
+	if( argc < 2 || CliTools::hasArg(argc, argv, "--help") || CliTools::hasArg(argc, argv, "-h") ) {
+		cout << "usage : field3d_repack --format dense-half|dense-float|sparse-half|sparse-float --output-dir DIR" << endl;
+		cout << "                       [--threads N] [--memory 4096] [--jobs repack.jobs]"                          << endl;
+		cout << "                       [--output result.json] file.f3d [file.f3d ...]"                               << endl;
+		return 0;
+	}
+
+	const string format     = CliTools::getArg(argc, argv, "--format"    , "sparse-half");
+	const string outputDir  = CliTools::getArg(argc, argv, "--output-dir", ""           );
+	const string jobsPath   = CliTools::getArg(argc, argv, "--jobs"      , ""           );
+	const string outputPath = CliTools::getArg(argc, argv, "--output"    , ""           );
+	int       threads = atoi( CliTools::getArg(argc, argv, "--threads", "0"   ).c_str() );
+	long long memory  = atoll( CliTools::getArg(argc, argv, "--memory" , "4096").c_str() );
+
+	if( threads < 1 ) threads = std::max( 1L, sysconf(_SC_NPROCESSORS_ONLN) );
+	if( memory  < 1 ) memory  = 1;
+
+	Repacker repacker( memory * 1024 * 1024 );
+	repacker.jobsPath = jobsPath;
+	if( !LayerTools::parseFormat(format, repacker.type, repacker.dataType) ) {
+		cerr << "field3d_repack : unknown format " << format << endl;
+		return 1;
+	}
+	if( outputDir.empty() ) {
+		cerr << "field3d_repack : --output-dir is mandatory" << endl;
+		return 1;
+	}
+
+	vector<string> inputs;
+	getInputs(argc, argv, inputs);
+
+	set<string> done;
+	if( !jobsPath.empty() ) readJobs(jobsPath, done);
+
+	Field3D::initIO();
+
+	// done jobs are skipped as long as their output is still there
+	vector<size_t> todo;
+	repacker.results.resize(inputs.size());
+	for(size_t i=0; i<inputs.size(); i++) {
+		RepackResult &result = repacker.results[i];
+		result.input      = inputs[i];
+		result.output     = outputDir + "/" + baseName(inputs[i]);
+		result.inputBytes = CliTools::fileSize(inputs[i]);
+
+		if( result.output == result.input ) {
+			result.error = "the output would overwrite the input";
+		}
+		else if( done.count(result.input) && CliTools::fileSize(result.output) >= 0 ) {
+			result.status      = "skipped";
+			result.outputBytes = CliTools::fileSize(result.output);
+		}
+		else {
+			todo.push_back(i);
+		}
+	}
+
+	// the task group waits for all the tasks when it goes out of scope
+	const double start = CliTools::now();
+	{
+		IlmThread::ThreadPool pool(threads);
+		IlmThread::TaskGroup  group;
+		for(size_t i=0; i<todo.size(); i++) {
+			pool.addTask( new RepackTask(&group, repacker, todo[i]) );
+		}
+	}
+	const double seconds = CliTools::now() - start;
+
+	ofstream outputFile;
+	if( !outputPath.empty() ) outputFile.open(outputPath.c_str());
+	ostream &output = outputPath.empty() ? cout : outputFile;
+
+	int failures = 0;
+
+	CliTools::JsonWriter json(output);
+	json.beginObject();
+	json.value      ( "tool"      , "field3d_repack" );
+	json.value      ( "format"    , format           );
+	json.value      ( "threads"   , threads          );
+	json.value      ( "seconds"   , seconds          );
+	json.value      ( "peak_rss_kb", (long long) CliTools::peakRSS() );
+	json.beginArray ( "files" );
+	for(size_t i=0; i<repacker.results.size(); i++) {
+		const RepackResult &result = repacker.results[i];
+		if( result.status == "failed" ) failures++;
+
+		json.beginObject();
+		json.value( "input"        , result.input       );
+		json.value( "output"       , result.output      );
+		json.value( "status"       , result.status      );
+		if( !result.error.empty() ) json.value( "error", result.error );
+		json.value( "layers"       , result.layers      );
+		json.value( "seconds"      , result.seconds     );
+		json.value( "input_bytes"  , result.inputBytes  );
+		json.value( "output_bytes" , result.outputBytes );
+		json.endObject();
+	}
+	json.endArray();
+	json.endObject();
+
+	return failures ? 1 : 0;
+}
@@ -0,0 +1,335 @@
+// Copyright (c) 2011 Prime Focus Film.
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions
+// are met:
+//
+// Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+// Redistributions in binary form must reproduce the above copyright
+// notice, this list of conditions and the following disclaimer in the
+// documentation and/or other materials provided with the
+// distribution. Neither the name of Prime Focus Film nor the
+// names of its contributors may be used to endorse or promote
+// products derived from this software without specific prior written
+// permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+// FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+// COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+// INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+// HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+// OF THE POSSIBILITY OF SUCH DAMAGE.
+
+
+// field3d_session_bench : replays Maya-like cache sessions against the real
+// Field3dCacheFormat code, compiled against the Maya API stand-in found in
+// tools/mayaStub. Every MPxCacheFormat call is timed and the latency
+// distribution of each call is reported as JSON.
+//
+// usage :
+//     field3d_session_bench [--format f3d-sparse-half] [--res 128] [--frames 24]
+//                           [--channels density,velocity,temperature]
+//                           [--sparsity 0.25] [--dir /tmp] [--output result.json] [--keep]
+//                           [--profile profile.json] [--read-res 96]
+//
+// --profile dumps the cache session counters ( needs -DENABLE_PROFILING=ON ).
+// --read-res plays the cache back into a fluid of another resolution, the
+// channels being resampled on read.
+
+#include "field3D_Format.h"
+#include "cli_Tools.h"
+#include "synthetic_Fluid.h"
+
+#include "MayaStub.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
+using namespace std;
+
+
+// ------------------------------------------- LATENCY STATS
+
+class CallStats {
+public:
+	void add( const string &call, double seconds ) {
+		if( m_samples.find(call) == m_samples.end() ) m_order.push_back(call);
+		m_samples[call].push_back(seconds);
+	}
+
+	void write( CliTools::JsonWriter &json ) {
+		json.beginArray("calls");
+		for(vector<string>::iterator it=m_order.begin(); it!=m_order.end(); ++it) {
+			vector<double> &s = m_samples[*it];
+			sort(s.begin(), s.end());
+			double total = 0.0;
+			for(size_t i=0; i<s.size(); i++) total += s[i];
+
+			json.beginObject();
+			json.value( "call"     , *it                               );
+			json.value( "count"    , (long long) s.size()              );
+			json.value( "total_ms" , total * 1e3                       );
+			json.value( "mean_us"  , total * 1e6 / s.size()            );
+			json.value( "p50_us"   , percentile(s, 0.50) * 1e6         );
+			json.value( "p90_us"   , percentile(s, 0.90) * 1e6         );
+			json.value( "p99_us"   , percentile(s, 0.99) * 1e6         );
+			json.value( "max_us"   , s.back() * 1e6                    );
+			json.endObject();
+		}
+		json.endArray();
+	}
+
+private:
+	static double percentile( const vector<double> &sorted, double p ) {
+		size_t idx = (size_t) ( p * (sorted.size() - 1) + 0.5 );
+		return sorted[ min(idx, sorted.size()-1) ];
+	}
+
+	map< string, vector<double> > m_samples;
+	vector< string >              m_order  ;
+};
+
+
+// time one call, the sample is recorded when leaving the scope
+class ScopedSample {
+public:
+	ScopedSample( CallStats &stats, const char *call ) : m_stats(stats), m_call(call), m_start(CliTools::now()) {}
+	~ScopedSample() { m_stats.add(m_call, CliTools::now() - m_start); }
+private:
+	CallStats   &m_stats;
+	const char  *m_call ;
+	double       m_start;
+};
+
+
+// ------------------------------------------- SESSIONS
+
+static void *createFormat( const string &format ) {
+	if( format == "f3d-dense-half"   ) return Field3dCacheFormat::DHCreator();
+	if( format == "f3d-dense-float"  ) return Field3dCacheFormat::DFCreator();
+	if( format == "f3d-sparse-half"  ) return Field3dCacheFormat::SHCreator();
+	if( format == "f3d-sparse-float" ) return Field3dCacheFormat::SFCreator();
+	if( format == "f3d-auto-float"   ) return Field3dCacheFormat::AFCreator();
+	if( format == "f3d-auto-half"    ) return Field3dCacheFormat::AHCreator();
+	return NULL;
+}
+
+
+static string framePath( const string &directory, int frame ) {
+	stringstream path;
+	path << directory << "/field3d_sessionFrame" << frame << ".f3d";
+	return path.str();
+}
+
+
+// fill the stand-in fluid with the synthetic data of this frame
+static void animateFluid( MayaStub::Node *node, float sparsity, int frame, int nbFrames ) {
+
+	SyntheticFluid::Fluid fluid;
+	SyntheticFluid::make( node->resolution, sparsity, fluid, 0.5f * frame / nbFrames - 0.25f );
+
+	node->density     = fluid.density;
+	node->temperature = fluid.density;
+	node->fuel        = fluid.density;
+	node->pressure    = fluid.density;
+	node->falloff     = fluid.density;
+	for(int c=0; c<3; c++) {
+		node->color[c]    = fluid.color[c];
+		node->coord[c]    = fluid.color[c];
+		node->velocity[c] = fluid.velocity[c];
+	}
+	node->attributes["dynamicOffsetX"] = 0.01 * frame;
+}
+
+
+// what Maya does when caching one frame in "one file per frame" mode
+static bool writeFrame(
+		MPxCacheFormat         &cache    ,
+		CallStats              &stats    ,
+		const string           &path     ,
+		const string           &fluid    ,
+		const vector<string>   &channels ,
+		int                     frame
+)
+{
+	MTime   time(frame, MTime::kFilm), start(1.0, MTime::kFilm), end(frame, MTime::kFilm);
+	MStatus status;
+
+	{ ScopedSample s(stats, "open(kWrite)");   status = cache.open(path.c_str(), MPxCacheFormat::kWrite); }
+	if( !status ) return false;
+
+	{ ScopedSample s(stats, "writeHeader");    status = cache.writeHeader("2.0", start, end); }
+	{ ScopedSample s(stats, "writeTime");      status = cache.writeTime(time); }
+
+	MFloatArray dummy(3);
+	for(size_t c=0; c<channels.size() && status; c++) {
+		MString name = (fluid + "_" + channels[c]).c_str();
+		{ ScopedSample s(stats, "writeChannelName"); status = cache.writeChannelName(name); }
+		if( !status ) break;
+		{ ScopedSample s(stats, "writeFloatArray");  status = cache.writeFloatArray(dummy); }
+	}
+
+	{ ScopedSample s(stats, "close(kWrite)");  cache.close(); }
+	return status;
+}
+
+
+// what Maya does when playing back one frame
+static bool readFrame(
+		MPxCacheFormat         &cache ,
+		CallStats              &stats ,
+		const string           &path  ,
+		int                     frame
+)
+{
+	MTime   time(frame, MTime::kFilm), foundTime;
+	MStatus status;
+
+	{ ScopedSample s(stats, "open(kRead)");    status = cache.open(path.c_str(), MPxCacheFormat::kRead); }
+	if( !status ) return false;
+
+	{ ScopedSample s(stats, "findTime");       cache.findTime(time, foundTime); }
+
+	// enumerate the channels stored in the file
+	vector<MString> names;
+	while( true ) {
+		MString name;
+		MStatus found;
+		{ ScopedSample s(stats, "readChannelName"); found = cache.readChannelName(name); }
+		if( !found ) break;
+		names.push_back(name);
+	}
+
+	MFloatArray array;
+	for(size_t c=0; c<names.size() && status; c++) {
+		{ ScopedSample s(stats, "findChannelName"); status = cache.findChannelName(names[c]); }
+		if( !status ) break;
+
+		unsigned size = 0;
+		{ ScopedSample s(stats, "readArraySize");   size   = cache.readArraySize(); }
+		{ ScopedSample s(stats, "readFloatArray");  status = cache.readFloatArray(array, size); }
+		if( status && array.length() != size ) {
+			cerr << "Read " << array.length() << " values of " << names[c].asChar() << " instead of " << size << endl;
+			status = MS::kFailure;
+		}
+	}
+
+	{ ScopedSample s(stats, "close(kRead)");   cache.close(); }
+	return status;
+}
+
+
+int main( int argc, char **argv ) {
+
+	if( CliTools::hasArg(argc, argv, "--help") || CliTools::hasArg(argc, argv, "-h") ) {
+		cout << "usage : field3d_session_bench [--format f3d-sparse-half] [--res 128] [--frames 24]"          << endl;
+		cout << "                              [--channels density,velocity,temperature] [--sparsity 0.25]"  << endl;
+		cout << "                              [--dir /tmp] [--output result.json] [--keep]"                 << endl;
+		cout << "                              [--profile profile.json] [--read-res 96]"                     << endl;
+		return 0;
+	}
+
+	string         format     = CliTools::getArg(argc, argv, "--format"  , "f3d-sparse-half");
+	unsigned int   res        = (unsigned int) atoi( CliTools::getArg(argc, argv, "--res", "128").c_str() );
+	unsigned int   readRes    = (unsigned int) atoi( CliTools::getArg(argc, argv, "--read-res", "0").c_str() );
+	int            nbFrames   = atoi( CliTools::getArg(argc, argv, "--frames", "24").c_str() );
+	float          sparsity   = (float) atof( CliTools::getArg(argc, argv, "--sparsity", "0.25").c_str() );
+	string         directory  = CliTools::getArg(argc, argv, "--dir"     , "/tmp");
+	string         outputPath = CliTools::getArg(argc, argv, "--output"  , ""    );
+	bool           keepFiles  = CliTools::hasArg(argc, argv, "--keep");
+	string         profile    = CliTools::getArg(argc, argv, "--profile" , ""    );
+	vector<string> channels;
+	CliTools::split( CliTools::getArg(argc, argv, "--channels", "density,velocity,temperature"), ',', channels );
+
+	// Maya always sends the resolution and the offset along with the fluid channels
+	channels.insert(channels.begin(), "offset");
+	channels.insert(channels.begin(), "resolution");
+
+	MPxCacheFormat *cache = (MPxCacheFormat *) createFormat(format);
+	if( !cache ) {
+		cerr << "Unknown format " << format << endl;
+		return 1;
+	}
+
+	const string    fluidName = "fluidShape1";
+	MayaStub::Node *fluid     = MayaStub::addFluid(fluidName, res, res, res);
+
+	CallStats writeStats, readStats;
+	bool      ok = true;
+
+	// write session : the fluid is simulated then cached frame by frame
+	double writeStart = CliTools::now();
+	for(int frame=1; frame<=nbFrames && ok; frame++) {
+		animateFluid(fluid, sparsity, frame, nbFrames);
+		ok = writeFrame(*cache, writeStats, framePath(directory, frame), fluidName, channels, frame);
+	}
+	double writeTime = CliTools::now() - writeStart;
+
+	// read session : playback of the whole range, into a fluid resized
+	// in between when --read-res is given
+	if( readRes == 0 ) readRes = res;
+	fluid->resolution[0] = fluid->resolution[1] = fluid->resolution[2] = readRes;
+	double readStart = CliTools::now();
+	for(int frame=1; frame<=nbFrames && ok; frame++) {
+		ok = readFrame(*cache, readStats, framePath(directory, frame), frame);
+	}
+	double readTime = CliTools::now() - readStart;
+
+	long long diskBytes = 0;
+	for(int frame=1; frame<=nbFrames; frame++) {
+		diskBytes += max( 0LL, CliTools::fileSize(framePath(directory, frame)) );
+		if( !keepFiles ) remove( framePath(directory, frame).c_str() );
+	}
+
+	ofstream outputFile;
+	if( !outputPath.empty() ) outputFile.open(outputPath.c_str());
+	ostream &output = outputPath.empty() ? cout : outputFile;
+
+	CliTools::JsonWriter json(output);
+	json.beginObject();
+	json.value ( "benchmark"   , "field3d_session_bench" );
+	json.value ( "format"      , format                  );
+	json.value ( "resolution"  , (int) res               );
+	json.value ( "read_res"    , (int) readRes           );
+	json.value ( "frames"      , nbFrames                );
+	json.value ( "sparsity"    , (double) sparsity       );
+	json.value ( "ok"          , ok                      );
+	json.value ( "disk_bytes"  , diskBytes               );
+	json.value ( "peak_rss_kb" , (long long) CliTools::peakRSS() );
+
+	json.beginObject("write");
+	json.value ( "seconds"          , writeTime                );
+	json.value ( "frames_per_s"     , nbFrames / writeTime     );
+	writeStats.write(json);
+	json.endObject();
+
+	json.beginObject("read");
+	json.value ( "seconds"          , readTime                 );
+	json.value ( "frames_per_s"     , nbFrames / readTime      );
+	readStats.write(json);
+	json.endObject();
+
+	json.endObject();
+
+	if( !profile.empty() ) {
+		((Field3dCacheFormat *) cache)->profile().write(profile, Field3DProfiler::JSON);
+	}
+
+	delete cache;
+	MayaStub::clearScene();
+
+	return ok ? 0 : 1;
+}
@@ -0,0 +1,273 @@
+// Copyright (c) 2011 Prime Focus Film.
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions
+// are met:
+//
+// Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+// Redistributions in binary form must reproduce the above copyright
+// notice, this list of conditions and the following disclaimer in the
+// documentation and/or other materials provided with the
+// distribution. Neither the name of Prime Focus Film nor the
+// names of its contributors may be used to endorse or promote
+// products derived from this software without specific prior written
+// permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+// FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+// COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+// INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+// HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+// OF THE POSSIBILITY OF SUCH DAMAGE.
+
+
+#include "layer_Tools.h"
+#include "field3D_Dispatch.h"
+
+using namespace std;
+
+namespace LayerTools {
+
+Layer::Layer() : type(Field3DTools::TypeUnsupported), kind(SCALAR), allocatedBlocks(0), totalBlocks(0) {
+	res[0] = res[1] = res[2] = 0;
+	for(int i=0; i<4; i++)
+		for(int j=0; j<4; j++)
+			transform[i][j] = ( i == j ) ? 1.0 : 0.0;
+}
+
+
+// ------------------------------------------- FILES
+
+bool openInput( Field3D::Field3DInputFile &in, const string &path ) {
+	Field3DTools::HDF5Lock lock;
+	return in.open(path);
+}
+
+void closeInput( Field3D::Field3DInputFile &in ) {
+	Field3DTools::HDF5Lock lock;
+	in.close();
+}
+
+bool createOutput( Field3D::Field3DOutputFile &out, const string &path ) {
+	Field3DTools::HDF5Lock lock;
+	return out.create(path);
+}
+
+bool closeOutput( Field3D::Field3DOutputFile &out ) {
+	Field3DTools::HDF5Lock lock;
+	bool written = out.writeGlobalMetadata();
+	out.close();
+	return written;
+}
+
+void listLayers( Field3D::Field3DInputFile *in, vector<LayerId> &layers ) {
+	vector<string> partitions;
+	Field3DTools::getPartitionNames(in, partitions);
+	for(size_t p=0; p<partitions.size(); p++) {
+		vector<string> names;
+		Field3DTools::getFieldNames(in, names, partitions[p]);
+		for(size_t i=0; i<names.size(); i++) {
+			LayerId id;
+			id.partition = partitions[p];
+			id.name      = names[i];
+			layers.push_back(id);
+		}
+	}
+}
+
+void copyGlobalMetadata( Field3D::Field3DInputFile *in, Field3D::Field3DOutputFile *out ) {
+	const Field3D::V3f er(-999.999,-999.999,-999.999);
+
+	string info = in->metadata().strMetadata("Info", "");
+	if( !info.empty() ) out->metadata().setStrMetadata("Info", info);
+
+	Field3D::V3f offset = in->metadata().vecFloatMetadata("Offset", er);
+	if( offset != er ) out->metadata().setVecFloatMetadata("Offset", offset);
+
+	vector<string> partitions;
+	Field3DTools::getPartitionNames(in, partitions);
+	for(size_t p=0; p<partitions.size(); p++) {
+		const string name = Field3DTools::offsetMetadataName(partitions[p]);
+		offset = in->metadata().vecFloatMetadata(name, er);
+		if( offset != er ) out->metadata().setVecFloatMetadata(name, offset);
+	}
+
+	const map<string,string> &strings = in->metadata().strMetadata();
+	for(map<string,string>::const_iterator it=strings.begin(); it!=strings.end(); ++it) {
+		if( it->first.compare(0, 10, "Reference_") == 0 ) out->metadata().setStrMetadata(it->first, it->second);
+	}
+}
+
+
+// ------------------------------------------- DECODE
+
+template<typename FieldType>
+static void getTransform( FieldType &field, double transform[4][4] ) {
+	Field3D::MatrixFieldMapping::Ptr mapping = Field3D::field_dynamic_cast<Field3D::MatrixFieldMapping>(field.mapping());
+	if( !mapping ) return;
+	const Field3D::M44d m = mapping->localToWorld();
+	for(int i=0; i<4; i++)
+		for(int j=0; j<4; j++)
+			transform[i][j] = m[i][j];
+}
+
+template<typename Data_T>
+static void countBlocks( const Field3D::DenseField<Data_T> &, Layer & ) {
+}
+
+template<typename Data_T>
+static void countBlocks( const Field3D::SparseField<Data_T> &field, Layer &layer ) {
+	const Field3D::V3i blocks = field.blockRes();
+	layer.totalBlocks     += (long long) blocks.x * blocks.y * blocks.z;
+	layer.allocatedBlocks += Field3DTools::countAllocatedBlocks(field);
+}
+
+template<typename Data_T>
+static void countBlocks( const Field3D::MACField<Data_T> &, Layer & ) {
+}
+
+// decodes the layer read by Field3DTools::dispatchLayer, whatever its type
+class LayerDecoder {
+public:
+	LayerDecoder( Layer &layer ) : m_layer(layer) {}
+
+	template<class FieldType>
+	bool operator()( FieldType &field, Field3DTools::SupportedFieldTypeEnum type ) {
+		// staggered sparse layers hold a face component of a MAC channel, the
+		// three of them are decoded in turn ( see Field3DTools::writeSparseMACField )
+		const bool         staggered = Field3DTools::isStaggered(field);
+		const Field3D::V3i res       = Field3DTools::channelResolution(field);
+		const bool         first     = !staggered || m_layer.values.empty();
+		if( !first && ( res.x != (int) m_layer.res[0] || res.y != (int) m_layer.res[1] || res.z != (int) m_layer.res[2] ) ) {
+			ERROR( "Failed to read " + m_layer.name + " : its face components don't have the same resolution" );
+			return false;
+		}
+		m_layer.res[0] = res.x;
+		m_layer.res[1] = res.y;
+		m_layer.res[2] = res.z;
+		getTransform(field, m_layer.transform);
+		countBlocks(field, m_layer);
+
+		const Field3DTools::ChannelLayout layout = staggered ? Field3DTools::MAC_CHANNEL : Field3DTools::fieldLayout(type);
+		m_layer.kind = layout == Field3DTools::SCALAR_CHANNEL ? SCALAR : ( layout == Field3DTools::VECTOR_CHANNEL ? VECTOR : MAC );
+		if( first ) m_layer.values.assign( Field3DTools::channelValues(layout, m_layer.res), 0.0f );
+		if( m_layer.values.empty() ) return true;
+		if( !staggered ) {
+			Field3DTools::copyVoxels(field, &m_layer.values[0]);
+			return true;
+		}
+		return Field3DTools::copyStaggeredVoxels(field, &m_layer.values[0]);
+	}
+
+private:
+	Layer &m_layer;
+};
+
+bool readLayer( Field3D::Field3DInputFile *in, const LayerId &id, Layer &layer ) {
+
+	layer.partition = id.partition;
+	layer.name      = id.name;
+
+	// only an empty layer, the data is in another file of the sequence
+	layer.reference = in->metadata().strMetadata(Field3DTools::referenceMetadataName(id.partition, id.name), "");
+
+	LayerDecoder decoder(layer);
+
+	// a MAC channel of the sparse formats : one layer per face component
+	if( Field3DTools::hasStaggeredLayers(in, id.partition, id.name) ) {
+		for(int axis=0; axis<3; axis++) {
+			const string name = Field3DTools::staggeredLayerName(id.name, axis);
+			if( !Field3DTools::dispatchLayer(in, id.partition, name, decoder, layer.type, Field3DTools::SCALAR_LAYERS) ) return false;
+		}
+		return true;
+	}
+	return Field3DTools::dispatchLayer(in, id.partition, id.name, decoder, layer.type);
+}
+
+
+// ------------------------------------------- ENCODE
+
+// Maya hands the components of vector channels as three arrays
+static void splitComponents( const vector<float> &values, vector<float> &a, vector<float> &b, vector<float> &c ) {
+	const size_t count = values.size() / 3;
+	a.resize(count);
+	b.resize(count);
+	c.resize(count);
+	for(size_t i=0; i<count; i++) {
+		a[i] = values[3*i  ];
+		b[i] = values[3*i+1];
+		c[i] = values[3*i+2];
+	}
+}
+
+bool writeLayer(
+		Field3D::Field3DOutputFile      *out      ,
+		const string                    &fileName ,
+		Layer                           &layer    ,
+		Field3DTools::FieldTypeEnum      type     ,
+		Field3DTools::FieldDataTypeEnum  dataType )
+{
+	if( !layer.reference.empty() ) {
+		return Field3DTools::writeReferenceLayer(out, layer.partition.c_str(), layer.name.c_str(), layer.res, layer.transform, layer.kind != SCALAR);
+	}
+	if( layer.values.empty() ) return false;
+
+	const char *fluid = layer.partition.c_str();
+	const char *name  = layer.name.c_str();
+
+	// in the export type of the format ( see field3D_Dispatch.h )
+	if( layer.kind == SCALAR ) {
+		Field3DTools::ScalarChannelWriter writer(out, fileName, fluid, name, layer.res, layer.transform, &layer.values[0], type);
+		return Field3DTools::dispatchDataType(dataType, writer);
+	}
+
+	if( layer.kind == VECTOR ) {
+		vector<float> a, b, c;
+		splitComponents(layer.values, a, b, c);
+		Field3DTools::VectorChannelWriter writer(out, fileName, fluid, name, layer.res, layer.transform, &a[0], &b[0], &c[0], false);
+		return Field3DTools::dispatchDataType(dataType, writer);
+	}
+
+	// MAC faces u, v then w, culled by magnitude in the sparse formats
+	const size_t sx = (size_t) (layer.res[0]+1) * layer.res[1] * layer.res[2];
+	const size_t sy = (size_t) layer.res[0] * (layer.res[1]+1) * layer.res[2];
+	const float *u  = &layer.values[0];
+	Field3DTools::VectorChannelWriter writer(out, fileName, fluid, name, layer.res, layer.transform, u, u + sx, u + sx + sy, true, type);
+	return Field3DTools::dispatchDataType(dataType, writer);
+}
+
+
+// ------------------------------------------- NAMES
+
+const char *kindName( LayerKind kind ) {
+	switch( kind ) {
+		case SCALAR : return "scalar";
+		case VECTOR : return "vector";
+		case MAC    : return "mac";
+	}
+	return "unknown";
+}
+
+const char *typeName( Field3DTools::SupportedFieldTypeEnum type ) {
+	return Field3DTools::fieldTypeName(type);
+}
+
+bool parseFormat( const string &format, Field3DTools::FieldTypeEnum &type, Field3DTools::FieldDataTypeEnum &dataType ) {
+	if     ( format == "dense-half"   ) { type = Field3DTools::DENSE ; dataType = Field3DTools::HALF ; }
+	else if( format == "dense-float"  ) { type = Field3DTools::DENSE ; dataType = Field3DTools::FLOAT; }
+	else if( format == "sparse-half"  ) { type = Field3DTools::SPARSE; dataType = Field3DTools::HALF ; }
+	else if( format == "sparse-float" ) { type = Field3DTools::SPARSE; dataType = Field3DTools::FLOAT; }
+	else return false;
+	return true;
+}
+
+}
@@ -0,0 +1,110 @@
+// Copyright (c) 2011 Prime Focus Film.
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions
+// are met:
+//
+// Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+// Redistributions in binary form must reproduce the above copyright
+// notice, this list of conditions and the following disclaimer in the
+// documentation and/or other materials provided with the
+// distribution. Neither the name of Prime Focus Film nor the
+// names of its contributors may be used to endorse or promote
+// products derived from this software without specific prior written
+// permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+// FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+// COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+// INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+// HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+// OF THE POSSIBILITY OF SUCH DAMAGE.
+
+
+#ifndef LAYERTOOLS_H
+#define LAYERTOOLS_H
+
+#include <string>
+#include <vector>
+
+#include "field3D_Tools.h"
+
+// Whole layers of Field3D files decoded into Maya's layout, for the
+// standalone tools working on existing caches ( repack, ... ).
+// Nothing in here depends on Maya.
+
+namespace LayerTools {
+
+enum LayerKind { SCALAR , VECTOR , MAC };
+
+struct Layer {
+	Layer();
+
+	std::string                           partition ;   // fluid name
+	std::string                           name      ;   // channel name
+	Field3DTools::SupportedFieldTypeEnum  type      ;
+	LayerKind                             kind      ;
+	unsigned int                          res[3]    ;
+	double                                transform[4][4];
+
+	// Maya's layout : x first, vector components interleaved,
+	// MAC faces u then v then w
+	std::vector<float>                    values    ;
+
+	// sparse fields only
+	long long                             allocatedBlocks ;
+	long long                             totalBlocks     ;
+
+	// static channels : the file holding the data, this layer is empty
+	std::string                           reference ;
+};
+
+struct LayerId {
+	std::string partition ;
+	std::string name      ;
+};
+
+// ---------------------  Files
+// Field3D file calls holding the HDF5 lock
+bool openInput   ( Field3D::Field3DInputFile  &in , const std::string &path );
+void closeInput  ( Field3D::Field3DInputFile  &in );
+bool createOutput( Field3D::Field3DOutputFile &out, const std::string &path );
+bool closeOutput ( Field3D::Field3DOutputFile &out );   // writes the global metadata first
+
+// every ( partition, layer ) of the file
+void listLayers  ( Field3D::Field3DInputFile *in, std::vector<LayerId> &layers );
+
+// copy the global metadata written by the plugin ( info, offsets and references )
+void copyGlobalMetadata( Field3D::Field3DInputFile *in, Field3D::Field3DOutputFile *out );
+
+// ---------------------  Layers
+bool readLayer   ( Field3D::Field3DInputFile *in, const LayerId &id, Layer &layer );
+
+// same template selection as Field3dCacheFormat::writeArray, vector channels
+// are always dense. fileName is needed to stream big dense layers.
+// Referenced layers are written as references again.
+bool writeLayer  (
+		Field3D::Field3DOutputFile      *out      ,
+		const std::string               &fileName ,
+		Layer                           &layer    ,
+		Field3DTools::FieldTypeEnum      type     ,
+		Field3DTools::FieldDataTypeEnum  dataType );
+
+const char *kindName ( LayerKind kind );
+const char *typeName ( Field3DTools::SupportedFieldTypeEnum type );
+
+// "dense-half" ... "sparse-float"
+bool parseFormat ( const std::string &format, Field3DTools::FieldTypeEnum &type, Field3DTools::FieldDataTypeEnum &dataType );
+
+}
+
+#endif
@@ -0,0 +1,322 @@
+// Copyright (c) 2011 Prime Focus Film.
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions
+// are met:
+//
+// Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+// Redistributions in binary form must reproduce the above copyright
+// notice, this list of conditions and the following disclaimer in the
+// documentation and/or other materials provided with the
+// distribution. Neither the name of Prime Focus Film nor the
+// names of its contributors may be used to endorse or promote
+// products derived from this software without specific prior written
+// permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+// FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+// COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+// INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+// HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+// OF THE POSSIBILITY OF SUCH DAMAGE.
+
+
+#include "MayaStub.h"
+
+#include <cstring>
+
+using namespace std;
+
+
+// ------------------------------------------- MTime
+
+double MTime::ticksPerSecond( Unit unit ) {
+	switch(unit) {
+		case kHours        : return 1.0 / 3600.0 ;
+		case kMinutes      : return 1.0 / 60.0   ;
+		case kSeconds      : return 1.0          ;
+		case kMilliseconds : return 1000.0       ;
+		case kGames        : return 15.0         ;
+		case kFilm         : return 24.0         ;
+		case kPALFrame     : return 25.0         ;
+		case kNTSCFrame    : return 30.0         ;
+		case kShowScan     : return 48.0         ;
+		case kPALField     : return 50.0         ;
+		case kNTSCField    : return 60.0         ;
+		case k6000FPS      : return 6000.0       ;
+		default            : return 24.0         ;
+	}
+}
+
+
+// ------------------------------------------- MMatrix
+
+MMatrix::MMatrix() {
+	for(int i=0; i<4; i++)
+		for(int j=0; j<4; j++)
+			matrix[i][j] = ( i == j ) ? 1.0 : 0.0;
+}
+
+MMatrix::MMatrix( const double m[4][4] ) {
+	memcpy(matrix, m, sizeof(matrix));
+}
+
+MMatrix MMatrix::operator*( const MMatrix &other ) const {
+	MMatrix res;
+	for(int i=0; i<4; i++) {
+		for(int j=0; j<4; j++) {
+			res.matrix[i][j] = 0.0;
+			for(int k=0; k<4; k++) res.matrix[i][j] += matrix[i][k] * other.matrix[k][j];
+		}
+	}
+	return res;
+}
+
+MStatus MMatrix::get( double dest[4][4] ) const {
+	memcpy(dest, matrix, sizeof(matrix));
+	return MS::kSuccess;
+}
+
+
+// ------------------------------------------- Scene
+
+namespace MayaStub {
+
+vector<Node*> &nodes() {
+	static vector<Node*> sceneNodes;
+	return sceneNodes;
+}
+
+Node *addFluid( const string &name, unsigned int rx, unsigned int ry, unsigned int rz ) {
+
+	Node *node = new Node;
+	node->name = name;
+	node->type = MFn::kFluid;
+
+	MMatrix identity;
+	identity.get(node->matrix);
+
+	node->resolution[0] = rx;
+	node->resolution[1] = ry;
+	node->resolution[2] = rz;
+	node->dimensions[0] = node->dimensions[1] = node->dimensions[2] = 10.0;
+
+	node->attributes["dynamicOffsetX"] = 0.0;
+	node->attributes["dynamicOffsetY"] = 0.0;
+	node->attributes["dynamicOffsetZ"] = 0.0;
+
+	const size_t size = size_t(rx)*ry*rz;
+	node->density    .assign(size, 0.0f);
+	node->pressure   .assign(size, 0.0f);
+	node->temperature.assign(size, 0.0f);
+	node->fuel       .assign(size, 0.0f);
+	node->falloff    .assign(size, 0.0f);
+	for(int c=0; c<3; c++) {
+		node->color[c].assign(size, 0.0f);
+		node->coord[c].assign(size, 0.0f);
+	}
+	node->velocity[0].assign( size_t(rx+1)*ry*rz, 0.0f );
+	node->velocity[1].assign( size_t(rx)*(ry+1)*rz, 0.0f );
+	node->velocity[2].assign( size_t(rx)*ry*(rz+1), 0.0f );
+
+	nodes().push_back(node);
+	return node;
+}
+
+Node *findNode( const string &name ) {
+	for(vector<Node*>::iterator it=nodes().begin(); it!=nodes().end(); ++it) {
+		if( (*it)->name == name ) return *it;
+	}
+	return NULL;
+}
+
+void clearScene() {
+	for(vector<Node*>::iterator it=nodes().begin(); it!=nodes().end(); ++it) {
+		delete *it;
+	}
+	nodes().clear();
+}
+
+}
+
+
+// ------------------------------------------- MPlug
+
+MStatus MPlug::getValue( double &value ) const {
+	if( !m_node ) return MS::kFailure;
+	map<string,double>::const_iterator it = m_node->attributes.find(m_attr);
+	if( it == m_node->attributes.end() ) return MS::kFailure;
+	value = it->second;
+	return MS::kSuccess;
+}
+
+MStatus MPlug::getValue( float &value ) const {
+	double v = 0.0;
+	MStatus status = getValue(v);
+	if( status ) value = (float) v;
+	return status;
+}
+
+MStatus MPlug::getValue( int &value ) const {
+	double v = 0.0;
+	MStatus status = getValue(v);
+	if( status ) value = (int) v;
+	return status;
+}
+
+
+// ------------------------------------------- MDagPath
+
+MObject MDagPath::node( MStatus *status ) const {
+	if( status ) *status = m_node ? MS::kSuccess : MS::kFailure;
+	return MObject(m_node);
+}
+
+MMatrix MDagPath::inclusiveMatrix( MStatus *status ) const {
+	if( !m_node ) {
+		if( status ) *status = MS::kFailure;
+		return MMatrix();
+	}
+	if( status ) *status = MS::kSuccess;
+	return MMatrix(m_node->matrix);
+}
+
+
+// ------------------------------------------- Function sets
+
+MFnDependencyNode::MFnDependencyNode( MObject object, MStatus *status ) : m_node(object.node()) {
+	if( status ) *status = m_node ? MS::kSuccess : MS::kInvalidParameter;
+}
+
+bool MFnDependencyNode::hasObj( const MObject &object ) const {
+	return !object.isNull();
+}
+
+MStatus MFnDependencyNode::setObject( const MObject &object ) {
+	if( !hasObj(object) ) return MS::kInvalidParameter;
+	m_node = object.node();
+	return MS::kSuccess;
+}
+
+MString MFnDependencyNode::name( MStatus *status ) const {
+	if( status ) *status = m_node ? MS::kSuccess : MS::kFailure;
+	return m_node ? MString(m_node->name.c_str()) : MString();
+}
+
+MPlug MFnDependencyNode::findPlug( const MString &attrName, MStatus *status ) const {
+	bool found = m_node && m_node->attributes.count(attrName.asChar());
+	if( status ) *status = found ? MS::kSuccess : MS::kInvalidParameter;
+	return found ? MPlug(m_node, attrName.asChar()) : MPlug();
+}
+
+
+MFnDagNode::MFnDagNode( const MDagPath &path, MStatus *status ) {
+	m_node = path.m_node;
+	if( status ) *status = m_node ? MS::kSuccess : MS::kInvalidParameter;
+}
+
+
+bool MFnFluid::hasObj( const MObject &object ) const {
+	return !object.isNull() && object.node()->type == MFn::kFluid;
+}
+
+float *MFnFluid::density( MStatus *status ) {
+	if( status ) *status = MS::kSuccess;
+	return &m_node->density[0];
+}
+
+float *MFnFluid::pressure( MStatus *status ) {
+	if( status ) *status = MS::kSuccess;
+	return &m_node->pressure[0];
+}
+
+float *MFnFluid::temperature( MStatus *status ) {
+	if( status ) *status = MS::kSuccess;
+	return &m_node->temperature[0];
+}
+
+float *MFnFluid::fuel( MStatus *status ) {
+	if( status ) *status = MS::kSuccess;
+	return &m_node->fuel[0];
+}
+
+float *MFnFluid::falloff( MStatus *status ) {
+	if( status ) *status = MS::kSuccess;
+	return &m_node->falloff[0];
+}
+
+MStatus MFnFluid::getColors( float *&r, float *&g, float *&b ) {
+	r = &m_node->color[0][0];
+	g = &m_node->color[1][0];
+	b = &m_node->color[2][0];
+	return MS::kSuccess;
+}
+
+MStatus MFnFluid::getCoordinates( float *&u, float *&v, float *&w ) {
+	u = &m_node->coord[0][0];
+	v = &m_node->coord[1][0];
+	w = &m_node->coord[2][0];
+	return MS::kSuccess;
+}
+
+MStatus MFnFluid::getVelocity( float *&x, float *&y, float *&z ) {
+	x = &m_node->velocity[0][0];
+	y = &m_node->velocity[1][0];
+	z = &m_node->velocity[2][0];
+	return MS::kSuccess;
+}
+
+MStatus MFnFluid::getResolution( unsigned &x, unsigned &y, unsigned &z ) const {
+	if( !m_node ) return MS::kFailure;
+	x = m_node->resolution[0];
+	y = m_node->resolution[1];
+	z = m_node->resolution[2];
+	return MS::kSuccess;
+}
+
+MStatus MFnFluid::getDimensions( double &x, double &y, double &z ) const {
+	if( !m_node ) return MS::kFailure;
+	x = m_node->dimensions[0];
+	y = m_node->dimensions[1];
+	z = m_node->dimensions[2];
+	return MS::kSuccess;
+}
+
+
+// ------------------------------------------- MItDag
+
+MItDag::MItDag( TraversalType /*type*/, MFn::Type filter, MStatus *status ) : m_filter(filter), m_index(0) {
+	skip();
+	if( status ) *status = MS::kSuccess;
+}
+
+void MItDag::skip() {
+	vector<MayaStub::Node*> &all = MayaStub::nodes();
+	while( m_index < all.size() && m_filter != MFn::kInvalid && all[m_index]->type != m_filter ) m_index++;
+}
+
+bool MItDag::isDone( MStatus *status ) const {
+	if( status ) *status = MS::kSuccess;
+	return m_index >= MayaStub::nodes().size();
+}
+
+MStatus MItDag::next() {
+	m_index++;
+	skip();
+	return MS::kSuccess;
+}
+
+MStatus MItDag::getPath( MDagPath &path ) const {
+	if( isDone() ) return MS::kFailure;
+	path.m_node = MayaStub::nodes()[m_index];
+	return MS::kSuccess;
+}
@@ -0,0 +1,416 @@
+// Copyright (c) 2011 Prime Focus Film.
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions
+// are met:
+//
+// Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+// Redistributions in binary form must reproduce the above copyright
+// notice, this list of conditions and the following disclaimer in the
+// documentation and/or other materials provided with the
+// distribution. Neither the name of Prime Focus Film nor the
+// names of its contributors may be used to endorse or promote
+// products derived from this software without specific prior written
+// permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+// FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+// COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+// INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+// HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+// OF THE POSSIBILITY OF SUCH DAMAGE.
+
+
+#ifndef MAYA_STUB_H
+#define MAYA_STUB_H
+
+// Minimal stand-in for the part of the Maya API used by the plugin.
+//
+// It lets the real plugin sources ( field3D_Format.cpp, maya_Tools.cpp )
+// be compiled and driven outside of Maya, e.g. by field3d_session_bench.
+// Fluids live in a tiny in-memory "scene" ( see MayaStub:: below ) which
+// the driver fills with synthetic data. Only the behaviour needed by the
+// plugin is emulated, nothing more.
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <map>
+
+
+// ------------------------------------------- MStatus
+
+class MStatus {
+public:
+	enum MStatusCode {
+		kSuccess = 0        ,
+		kFailure            ,
+		kInsufficientMemory ,
+		kInvalidParameter   ,
+		kLicenseFailure     ,
+		kUnknownParameter   ,
+		kNotImplemented     ,
+		kNotFound           ,
+		kEndOfFile
+	};
+
+	MStatus()                   : m_code(kSuccess) {}
+	MStatus( MStatusCode code ) : m_code(code)     {}
+
+	bool        error      () const { return m_code != kSuccess; }
+	MStatusCode statusCode () const { return m_code; }
+	void        perror     ( const char *msg ) const { std::cerr << msg << " : MStatus " << int(m_code) << std::endl; }
+
+	operator bool          () const { return m_code == kSuccess; }
+	bool operator==        ( const MStatus &other ) const { return m_code == other.m_code; }
+	bool operator!=        ( const MStatus &other ) const { return m_code != other.m_code; }
+	bool operator==        ( MStatusCode code     ) const { return m_code == code; }
+	bool operator!=        ( MStatusCode code     ) const { return m_code != code; }
+
+	friend bool operator== ( MStatusCode code, const MStatus &status ) { return code == status.m_code; }
+	friend bool operator!= ( MStatusCode code, const MStatus &status ) { return code != status.m_code; }
+
+private:
+	MStatusCode m_code;
+};
+
+typedef MStatus MS;
+
+#define CHECK_MSTATUS_AND_RETURN(_status, _retVal) \
+	{ MStatus _maya_status = (_status); \
+	  if ( MStatus::kSuccess != _maya_status ) { \
+		std::cerr << "\nAPI error detected in " << __FILE__ << " at line " << __LINE__ << std::endl; \
+		_maya_status.perror(""); \
+		return (_retVal); } }
+
+#define CHECK_MSTATUS_AND_RETURN_IT(_status) \
+	CHECK_MSTATUS_AND_RETURN((_status), (_status))
+
+#define CHECK_MSTATUS(_status) \
+	{ MStatus _maya_status = (_status); \
+	  if ( MStatus::kSuccess != _maya_status ) { \
+		std::cerr << "\nAPI error detected in " << __FILE__ << " at line " << __LINE__ << std::endl; \
+		_maya_status.perror(""); } }
+
+
+// ------------------------------------------- MString
+
+class MString {
+public:
+	MString()                       {}
+	MString( const char *str )      : m_str( str ? str : "" ) {}
+	MString( const MString &other ) : m_str( other.m_str )    {}
+
+	const char   *asChar () const { return m_str.c_str(); }
+	unsigned int  length () const { return (unsigned int) m_str.size(); }
+
+	MString &operator=  ( const MString &other ) { m_str = other.m_str; return *this; }
+	MString &operator+= ( const MString &other ) { m_str += other.m_str; return *this; }
+	MString  operator+  ( const MString &other ) const { return MString( (m_str + other.m_str).c_str() ); }
+	MString  operator+  ( const char    *other ) const { return MString( (m_str + other).c_str() ); }
+	bool     operator== ( const MString &other ) const { return m_str == other.m_str; }
+	bool     operator!= ( const MString &other ) const { return m_str != other.m_str; }
+
+	friend MString       operator+  ( const char *a, const MString &b ) { return MString( (std::string(a) + b.m_str).c_str() ); }
+	friend std::ostream &operator<< ( std::ostream &out, const MString &str ) { return out << str.m_str; }
+
+private:
+	std::string m_str;
+};
+
+
+// ------------------------------------------- MTime
+
+class MTime {
+public:
+	enum Unit { kInvalid, kHours, kMinutes, kSeconds, kMilliseconds, kGames, kFilm, kPALFrame, kNTSCFrame, kShowScan, kPALField, kNTSCField, k6000FPS };
+
+	MTime()                                    : m_seconds(0.0) {}
+	MTime( double value, Unit unit = kFilm )   : m_seconds( value / ticksPerSecond(unit) ) {}
+
+	// unit of the scene's frames, film in the stand-in
+	static Unit uiUnit()             { return kFilm; }
+
+	double value () const            { return m_seconds * 24.0; }
+	double as    ( Unit unit ) const { return m_seconds * ticksPerSecond(unit); }
+
+	MTime operator+  ( const MTime &other ) const { MTime t; t.m_seconds = m_seconds + other.m_seconds; return t; }
+	MTime operator-  ( const MTime &other ) const { MTime t; t.m_seconds = m_seconds - other.m_seconds; return t; }
+	bool  operator== ( const MTime &other ) const { return m_seconds == other.m_seconds; }
+	bool  operator!= ( const MTime &other ) const { return m_seconds != other.m_seconds; }
+	bool  operator<  ( const MTime &other ) const { return m_seconds <  other.m_seconds; }
+	bool  operator>  ( const MTime &other ) const { return m_seconds >  other.m_seconds; }
+	bool  operator<= ( const MTime &other ) const { return m_seconds <= other.m_seconds; }
+	bool  operator>= ( const MTime &other ) const { return m_seconds >= other.m_seconds; }
+
+private:
+	static double ticksPerSecond( Unit unit );
+	double m_seconds;
+};
+
+
+// ------------------------------------------- Arrays
+
+template< typename T >
+class MStubArray {
+public:
+	MStubArray()                                   {}
+	MStubArray( unsigned int length, T init = T() ) : m_data(length, init) {}
+	MStubArray( const T src[], unsigned int count ) : m_data(src, src+count) {}
+
+	unsigned int length    () const                  { return (unsigned int) m_data.size(); }
+	MStatus      setLength ( unsigned int length )   { m_data.resize(length); return MS::kSuccess; }
+	MStatus      append    ( T element )             { m_data.push_back(element); return MS::kSuccess; }
+	MStatus      set       ( T element, unsigned int index ) { m_data[index] = element; return MS::kSuccess; }
+	MStatus      clear     ()                        { m_data.clear(); return MS::kSuccess; }
+	MStatus      get       ( T dest[] ) const        { for(size_t i=0; i<m_data.size(); i++) dest[i] = m_data[i]; return MS::kSuccess; }
+
+	T       &operator[] ( unsigned int index )       { return m_data[index]; }
+	const T &operator[] ( unsigned int index ) const { return m_data[index]; }
+
+private:
+	std::vector<T> m_data;
+};
+
+class MFloatArray  : public MStubArray<float>  {
+public:
+	MFloatArray() {}
+	MFloatArray( unsigned int length, float init = 0.0f ) : MStubArray<float>(length, init) {}
+	MFloatArray( const float src[], unsigned int count )  : MStubArray<float>(src, count)   {}
+};
+
+class MDoubleArray : public MStubArray<double> {
+public:
+	MDoubleArray() {}
+	MDoubleArray( unsigned int length, double init = 0.0 ) : MStubArray<double>(length, init) {}
+	MDoubleArray( const double src[], unsigned int count )  : MStubArray<double>(src, count)   {}
+};
+
+class MIntArray         : public MStubArray<int>   {};
+class MVector           { public: double x, y, z; };
+class MVectorArray      : public MStubArray<MVector> {};
+class MFloatVectorArray : public MStubArray<MVector> {};
+
+
+// ------------------------------------------- MMatrix
+
+class MMatrix {
+public:
+	MMatrix();
+	MMatrix( const double m[4][4] );
+
+	MMatrix operator* ( const MMatrix &other ) const;
+	MStatus get       ( double dest[4][4] ) const;
+
+	double matrix[4][4];
+};
+
+
+// ------------------------------------------- Scene
+
+namespace MFn {
+	enum Type { kInvalid, kTransform, kFluid };
+}
+
+namespace MayaStub {
+
+// A node of the stand-in scene. Fluid channels are stored with
+// Maya's own layouts so the plugin reads them as it would in Maya.
+struct Node {
+	std::string                      name        ;
+	MFn::Type                        type        ;
+	double                           matrix[4][4];
+	std::map<std::string, double>    attributes  ;
+
+	// fluid only
+	unsigned int                     resolution[3];
+	double                           dimensions[3];
+	std::vector<float>               density, pressure, temperature, fuel, falloff;
+	std::vector<float>               color[3]    ;
+	std::vector<float>               coord[3]    ;
+	std::vector<float>               velocity[3] ;
+};
+
+// create a fluid shape with all its channels allocated ( and zeroed )
+Node *addFluid    ( const std::string &name, unsigned int rx, unsigned int ry, unsigned int rz );
+Node *findNode    ( const std::string &name );
+void  clearScene  ();
+
+// all nodes, in creation order
+std::vector<Node*> &nodes();
+
+}
+
+
+// ------------------------------------------- Function sets
+
+class MObject {
+public:
+	MObject()                      : m_node(NULL) {}
+	MObject( MayaStub::Node *node ) : m_node(node) {}
+
+	bool            isNull () const { return m_node == NULL; }
+	MayaStub::Node *node   () const { return m_node; }
+
+private:
+	MayaStub::Node *m_node;
+};
+
+
+class MPlug {
+public:
+	MPlug()                                                 : m_node(NULL) {}
+	MPlug( MayaStub::Node *node, const std::string &attr )  : m_node(node), m_attr(attr) {}
+
+	MStatus getValue( double &value ) const;
+	MStatus getValue( float  &value ) const;
+	MStatus getValue( int    &value ) const;
+
+private:
+	MayaStub::Node *m_node;
+	std::string     m_attr;
+};
+
+
+class MDagPath {
+public:
+	MDagPath() : m_node(NULL) {}
+
+	MObject node            ( MStatus *status = NULL ) const;
+	MMatrix inclusiveMatrix ( MStatus *status = NULL ) const;
+
+	MayaStub::Node *m_node;
+};
+
+
+class MFnDependencyNode {
+public:
+	MFnDependencyNode()                                       : m_node(NULL) {}
+	MFnDependencyNode( MObject object, MStatus *status = NULL );
+	virtual ~MFnDependencyNode() {}
+
+	virtual bool    hasObj    ( const MObject &object ) const;
+	MStatus         setObject ( const MObject &object );
+	MString         name      ( MStatus *status = NULL ) const;
+	MPlug           findPlug  ( const MString &attrName, MStatus *status = NULL ) const;
+
+protected:
+	MayaStub::Node *m_node;
+};
+
+
+class MFnDagNode : public MFnDependencyNode {
+public:
+	MFnDagNode() {}
+	MFnDagNode( const MDagPath &path, MStatus *status = NULL );
+};
+
+
+class MFnFluid : public MFnDagNode {
+public:
+	MFnFluid() {}
+
+	bool    hasObj         ( const MObject &object ) const;
+
+	float  *density        ( MStatus *status = NULL );
+	float  *pressure       ( MStatus *status = NULL );
+	float  *temperature    ( MStatus *status = NULL );
+	float  *fuel           ( MStatus *status = NULL );
+	float  *falloff        ( MStatus *status = NULL );
+	MStatus getColors      ( float *&r, float *&g, float *&b );
+	MStatus getCoordinates ( float *&u, float *&v, float *&w );
+	MStatus getVelocity    ( float *&x, float *&y, float *&z );
+
+	MStatus getResolution  ( unsigned &x, unsigned &y, unsigned &z ) const;
+	MStatus getDimensions  ( double   &x, double   &y, double   &z ) const;
+};
+
+
+class MItDag {
+public:
+	enum TraversalType { kInvalidType, kDepthFirst, kBreadthFirst };
+
+	MItDag( TraversalType type = kDepthFirst, MFn::Type filter = MFn::kInvalid, MStatus *status = NULL );
+
+	bool    isDone  ( MStatus *status = NULL ) const;
+	MStatus next    ();
+	MStatus getPath ( MDagPath &path ) const;
+
+private:
+	void skip();
+
+	MFn::Type  m_filter;
+	size_t     m_index ;
+};
+
+
+// ------------------------------------------- Cache format
+
+class MPxCacheFormat {
+public:
+	enum FileAccessMode { kRead, kWrite, kReadWrite };
+
+	MPxCacheFormat()          {}
+	virtual ~MPxCacheFormat() {}
+
+	virtual MStatus  open             ( const MString &, FileAccessMode ) { return MS::kFailure; }
+	virtual void     close            () {}
+	virtual MStatus  isValid          () { return MS::kFailure; }
+	virtual MStatus  rewind           () { return MS::kFailure; }
+	virtual MString  extension        () { return MString(); }
+
+	virtual MStatus  readHeader       () { return MS::kFailure; }
+	virtual MStatus  writeHeader      ( const MString &, MTime &, MTime & ) { return MS::kFailure; }
+
+	virtual void     beginWriteChunk  () {}
+	virtual void     endWriteChunk    () {}
+	virtual MStatus  beginReadChunk   () { return MS::kFailure; }
+	virtual void     endReadChunk     () {}
+
+	virtual MStatus  writeTime        ( MTime & ) { return MS::kFailure; }
+	virtual MStatus  readTime         ( MTime & ) { return MS::kFailure; }
+	virtual MStatus  findTime         ( MTime &, MTime & ) { return MS::kFailure; }
+	virtual MStatus  readNextTime     ( MTime & ) { return MS::kFailure; }
+
+	virtual unsigned readArraySize    () { return 0; }
+	virtual MStatus  writeDoubleArray ( const MDoubleArray & ) { return MS::kFailure; }
+	virtual MStatus  writeFloatArray  ( const MFloatArray &  ) { return MS::kFailure; }
+	virtual MStatus  readDoubleArray  ( MDoubleArray &, unsigned ) { return MS::kFailure; }
+	virtual MStatus  readFloatArray   ( MFloatArray &,  unsigned ) { return MS::kFailure; }
+
+	virtual MStatus  writeChannelName ( const MString & ) { return MS::kFailure; }
+	virtual MStatus  findChannelName  ( const MString & ) { return MS::kFailure; }
+	virtual MStatus  readChannelName  ( MString & )       { return MS::kFailure; }
+};
+
+
+// ------------------------------------------- Unused by the stub, declared for the includes
+
+class MTypeId           {};
+class MArgList          {};
+class MDataBlock        {};
+class MDataHandle       {};
+class MPlugArray        {};
+class MPxNode           {};
+class MFnNumericAttribute {};
+class MGlobal           {};
+class MAnimControl      {};
+class MItSelectionList  {};
+
+class MFnPlugin {
+public:
+	MFnPlugin( MObject, const char * = NULL, const char * = NULL, const char * = NULL ) {}
+	MStatus registerCacheFormat   ( const MString &, void *(*)() ) { return MS::kSuccess; }
+	MStatus deregisterCacheFormat ( const MString & )              { return MS::kSuccess; }
+};
+
+#endif
@@ -0,0 +1,2 @@
+// Maya API stand-in, see ../MayaStub.h
+#include "../MayaStub.h"
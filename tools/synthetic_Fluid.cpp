@@ -0,0 +1,99 @@
+// Copyright (c) 2011 Prime Focus Film.
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions
+// are met:
+//
+// Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+// Redistributions in binary form must reproduce the above copyright
+// notice, this list of conditions and the following disclaimer in the
+// documentation and/or other materials provided with the
+// distribution. Neither the name of Prime Focus Film nor the
+// names of its contributors may be used to endorse or promote
+// products derived from this software without specific prior written
+// permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+// FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+// COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+// INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+// HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+// OF THE POSSIBILITY OF SUCH DAMAGE.
+
+
+#include "synthetic_Fluid.h"
+
+#include <cmath>
+
+namespace SyntheticFluid {
+
+// cheap deterministic noise in [0,1]
+static float hashNoise( unsigned int i, unsigned int j, unsigned int k ) {
+	unsigned int h = i*73856093u ^ j*19349663u ^ k*83492791u;
+	h = (h ^ (h >> 13)) * 0x5bd1e995u;
+	h = h ^ (h >> 15);
+	return (h & 0xffffff) / float(0xffffff);
+}
+
+
+void make( const unsigned int res[3], float sparsity, Fluid &fluid, float shift ) {
+
+	for(int c=0; c<3; c++) fluid.res[c] = res[c];
+
+	const unsigned int nx = res[0], ny = res[1], nz = res[2];
+	const double       pi = 3.14159265358979;
+
+	// radius of the blob in normalized coordinates [-1,1]^3
+	double radius = ( sparsity >= 1.0f ) ? 1e10 : 2.0 * pow( 3.0 * sparsity / ( 4.0 * pi ), 1.0/3.0 );
+
+	fluid.density.assign( nx*ny*nz, 0.0f );
+	for(int c=0; c<3; c++) fluid.color[c].assign( nx*ny*nz, 0.0f );
+	fluid.velocity[0].assign( (nx+1)*ny*nz, 0.0f );
+	fluid.velocity[1].assign( nx*(ny+1)*nz, 0.0f );
+	fluid.velocity[2].assign( nx*ny*(nz+1), 0.0f );
+
+	size_t occupied = 0;
+	for(unsigned int k=0; k<nz; k++) {
+		for(unsigned int j=0; j<ny; j++) {
+			for(unsigned int i=0; i<nx; i++) {
+
+				double x = 2.0*(i+0.5)/nx - 1.0 - shift;
+				double y = 2.0*(j+0.5)/ny - 1.0;
+				double z = 2.0*(k+0.5)/nz - 1.0;
+				double d = sqrt(x*x + y*y + z*z);
+				if( d >= radius ) continue;
+
+				float n   = hashNoise(i,j,k);
+				float val = (float) ( 0.1 + 0.9 * n * ( sparsity >= 1.0f ? 1.0 : 1.0 - d/radius ) );
+
+				size_t idx = i + nx*j + nx*ny*k;
+				fluid.density[idx]  = val;
+				fluid.color[0][idx] = val;
+				fluid.color[1][idx] = 0.5f * val;
+				fluid.color[2][idx] = 1.0f - val;
+				occupied++;
+
+				// faces of this voxel : swirl around the y axis
+				fluid.velocity[0][ i   + (nx+1)*j + (nx+1)*ny*k ] = (float) -z;
+				fluid.velocity[0][ i+1 + (nx+1)*j + (nx+1)*ny*k ] = (float) -z;
+				fluid.velocity[1][ i   + nx*j     + nx*(ny+1)*k ] = n;
+				fluid.velocity[1][ i   + nx*(j+1) + nx*(ny+1)*k ] = n;
+				fluid.velocity[2][ i   + nx*j     + nx*ny*k     ] = (float) x;
+				fluid.velocity[2][ i   + nx*j     + nx*ny*(k+1) ] = (float) x;
+			}
+		}
+	}
+
+	fluid.occupancy = double(occupied) / double(nx*ny*nz);
+}
+
+}
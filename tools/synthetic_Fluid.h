@@ -0,0 +1,60 @@
+// Copyright (c) 2011 Prime Focus Film.
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions
+// are met:
+//
+// Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+// Redistributions in binary form must reproduce the above copyright
+// notice, this list of conditions and the following disclaimer in the
+// documentation and/or other materials provided with the
+// distribution. Neither the name of Prime Focus Film nor the
+// names of its contributors may be used to endorse or promote
+// products derived from this software without specific prior written
+// permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+// FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+// COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+// INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+// HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+// OF THE POSSIBILITY OF SUCH DAMAGE.
+
+
+#ifndef SYNTHETIC_FLUID_H
+#define SYNTHETIC_FLUID_H
+
+#include <vector>
+
+// Synthetic fluid data used by the standalone tools. Channels use the
+// same memory layouts as Maya's MFnFluid so they can be handed to the
+// Field3DTools write templates as is.
+
+namespace SyntheticFluid {
+
+struct Fluid {
+	unsigned int        res[3]     ;
+	std::vector<float>  density    ;   // scalar channel
+	std::vector<float>  color[3]   ;   // vector channel ( one array per component, as MFnFluid::getColors )
+	std::vector<float>  velocity[3];   // MAC channel    ( face centered, as MFnFluid::getVelocity )
+	double              occupancy  ;   // fraction of non empty voxels
+};
+
+// Builds a spherical blob whose volume is roughly 'sparsity' times the
+// container volume. Outside the blob every channel is exactly 0 so that
+// sparse formats can cull it. 'shift' moves the blob along x ( in
+// normalized [-1,1] coordinates ) to animate a sequence.
+void make( const unsigned int res[3], float sparsity, Fluid &fluid, float shift = 0.0f );
+
+}
+
+#endif